@@ -0,0 +1,422 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "manager.h"
+
+#ifdef _WIN32
+	#include "conventions/x86MsCdecl.h"
+	#include "conventions/x86MsThiscall.h"
+
+	typedef x86MsCdecl CdeclConvention;
+	typedef x86MsThiscall ThiscallConvention;
+
+	#define NOINLINE __declspec(noinline)
+	#define THISCALL_NAME "convention/ms_thiscall"
+	#define CDECL_NAME "convention/ms_cdecl"
+#elif defined DYNAMICHOOKS_X64
+	#include "conventions/x64SystemV.h"
+
+	// Methods take this as their first argument
+	typedef x64SystemV CdeclConvention;
+	typedef x64SystemV ThiscallConvention;
+
+	#define NOINLINE __attribute__((noinline))
+	#define THISCALL_NAME "convention/x64_sysv_method"
+	#define CDECL_NAME "convention/x64_sysv"
+#else
+	#include "conventions/x86GccCdecl.h"
+	#include "conventions/x86GccThiscall.h"
+
+	typedef x86GccCdecl CdeclConvention;
+	typedef x86GccThiscall ThiscallConvention;
+
+	#define NOINLINE __attribute__((noinline))
+	#define THISCALL_NAME "convention/gcc_thiscall"
+	#define CDECL_NAME "convention/gcc_cdecl"
+#endif
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+// Number of calls per measurement
+#define CALL_ITERATIONS 1000000
+
+// Number of hooks that are installed and removed per measurement
+#define HOOK_ITERATIONS 1000
+
+// Every benchmark is measured several times and the fastest run is reported
+#define REPETITIONS 5
+
+// Number of callbacks of the "N callbacks" benchmarks
+#define MANY_CALLBACKS 4
+
+
+// ============================================================================
+// >> BenchResult_t
+// ============================================================================
+struct BenchResult_t
+{
+	std::string m_Name;
+
+	// Nanoseconds per call or per hook operation
+	double m_fNanoseconds;
+};
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+std::vector<BenchResult_t> g_Results;
+
+// Results are added to this value, so the calls can't be optimized away
+volatile int g_iSink = 0;
+
+
+// ============================================================================
+// >> Benchmarked functions
+// ============================================================================
+NOINLINE int Int0()
+{
+	return g_iSink;
+}
+
+NOINLINE int Int2(int a, int b)
+{
+	return a + b;
+}
+
+NOINLINE int Int4(int a, int b, int c, int d)
+{
+	return a + b + c + d;
+}
+
+NOINLINE int Int8(int a, int b, int c, int d, int e, int f, int g, int h)
+{
+	return a + b + c + d + e + f + g + h;
+}
+
+NOINLINE float ReturnFloat(int a, int b)
+{
+	return (float) a / (float) (b | 1);
+}
+
+NOINLINE double ReturnDouble(int a, int b)
+{
+	return (double) a / (double) (b | 1);
+}
+
+NOINLINE long long ReturnLongLong(int a, int b)
+{
+	return (long long) a * b;
+}
+
+class MyClass
+{
+public:
+	NOINLINE int Method(int a, int b)
+	{
+		return a + b + m_iValue;
+	}
+
+public:
+	int m_iValue;
+};
+
+
+// ============================================================================
+// >> Benchmark loops
+// ============================================================================
+// The functions are called through volatile pointers, so they can't be
+// inlined into the loops.
+typedef void (*LoopFn)();
+
+void LoopInt0()
+{
+	int (* volatile pFunc)() = &Int0;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += pFunc();
+}
+
+void LoopInt2()
+{
+	int (* volatile pFunc)(int, int) = &Int2;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += pFunc(i, 2);
+}
+
+void LoopInt4()
+{
+	int (* volatile pFunc)(int, int, int, int) = &Int4;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += pFunc(i, 2, 3, 4);
+}
+
+void LoopInt8()
+{
+	int (* volatile pFunc)(int, int, int, int, int, int, int, int) = &Int8;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += pFunc(i, 2, 3, 4, 5, 6, 7, 8);
+}
+
+void LoopFloat()
+{
+	float (* volatile pFunc)(int, int) = &ReturnFloat;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += (int) pFunc(i, 2);
+}
+
+void LoopDouble()
+{
+	double (* volatile pFunc)(int, int) = &ReturnDouble;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += (int) pFunc(i, 2);
+}
+
+void LoopLongLong()
+{
+	long long (* volatile pFunc)(int, int) = &ReturnLongLong;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += (int) pFunc(i, 2);
+}
+
+void LoopMethod()
+{
+	MyClass obj;
+	obj.m_iValue = 1;
+
+	int (MyClass::* volatile pMethod)(int, int) = &MyClass::Method;
+	for(int i=0; i < CALL_ITERATIONS; i++)
+		g_iSink += (obj.*pMethod)(i, 2);
+}
+
+
+// ============================================================================
+// >> Callbacks
+// ============================================================================
+// Every callback needs its own address, because a callback can only be added
+// once.
+template<int N>
+bool Noop(HookType_t eHookType, CHook* pHook)
+{
+	return false;
+}
+
+HookHandlerFn* g_pCallbacks[MANY_CALLBACKS] = {
+	(HookHandlerFn *) (void *) &Noop<0>,
+	(HookHandlerFn *) (void *) &Noop<1>,
+	(HookHandlerFn *) (void *) &Noop<2>,
+	(HookHandlerFn *) (void *) &Noop<3>
+};
+
+void AddCallbacks(CHook* pHook, int iPreCount, int iPostCount)
+{
+	for(int i=0; i < iPreCount; i++)
+		pHook->AddCallback(HOOKTYPE_PRE, g_pCallbacks[i]);
+
+	for(int i=0; i < iPostCount; i++)
+		pHook->AddCallback(HOOKTYPE_POST, g_pCallbacks[i]);
+}
+
+
+// ============================================================================
+// >> Measurement
+// ============================================================================
+double GetNanoseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void AddResult(const char* szName, double fNanoseconds)
+{
+	BenchResult_t result;
+	result.m_Name = szName;
+	result.m_fNanoseconds = fNanoseconds;
+	g_Results.push_back(result);
+}
+
+/*
+Measures the time per call of the given loop.
+*/
+void MeasureCalls(const char* szName, LoopFn pLoop)
+{
+	// Warm up the caches and the branch predictors
+	pLoop();
+
+	double fBest = 0;
+	for(int i=0; i < REPETITIONS; i++)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		pLoop();
+
+		double fNanoseconds = GetNanoseconds(start) / CALL_ITERATIONS;
+		if (i == 0 || fNanoseconds < fBest)
+			fBest = fNanoseconds;
+	}
+
+	AddResult(szName, fBest);
+}
+
+/*
+Hooks the given function, measures the time per call of the loop and removes
+the hook again.
+*/
+void MeasureHook(const char* szName, LoopFn pLoop, void* pFunc, ICallingConvention* pConvention,
+	int iPreCount, int iPostCount, RegisterMode_t eRegisterMode=REGISTERMODE_SHARED)
+{
+	CHookManager* pHookMngr = GetHookManager();
+	CHook* pHook = pHookMngr->HookFunction(pFunc, pConvention, eRegisterMode);
+	AddCallbacks(pHook, iPreCount, iPostCount);
+
+	MeasureCalls(szName, pLoop);
+	pHookMngr->UnhookFunction(pFunc);
+}
+
+std::vector<DataType_t> GetIntArgs(int iCount)
+{
+	return std::vector<DataType_t>(iCount, DATA_TYPE_INT);
+}
+
+/*
+Measures how long it takes to install and remove a hook.
+*/
+void MeasureInstall()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	double fBestHook = 0;
+	double fBestUnhook = 0;
+	for(int i=0; i < REPETITIONS; i++)
+	{
+		double fHook = 0;
+		double fUnhook = 0;
+		for(int j=0; j < HOOK_ITERATIONS; j++)
+		{
+			CdeclConvention* pConvention = new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			pHookMngr->HookFunction((void *) &Int2, pConvention);
+			fHook += GetNanoseconds(start);
+
+			start = std::chrono::steady_clock::now();
+			pHookMngr->UnhookFunction((void *) &Int2);
+			fUnhook += GetNanoseconds(start);
+		}
+
+		fHook /= HOOK_ITERATIONS;
+		fUnhook /= HOOK_ITERATIONS;
+		if (i == 0 || fHook < fBestHook)
+			fBestHook = fHook;
+
+		if (i == 0 || fUnhook < fBestUnhook)
+			fBestUnhook = fUnhook;
+	}
+
+	AddResult("install/hook", fBestHook);
+	AddResult("install/unhook", fBestUnhook);
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	// Unhooked functions
+	MeasureCalls("baseline/int0", &LoopInt0);
+	MeasureCalls("baseline/int2", &LoopInt2);
+	MeasureCalls("baseline/int4", &LoopInt4);
+	MeasureCalls("baseline/int8", &LoopInt8);
+	MeasureCalls("baseline/float", &LoopFloat);
+	MeasureCalls("baseline/double", &LoopDouble);
+	MeasureCalls("baseline/long_long", &LoopLongLong);
+	MeasureCalls("baseline/method", &LoopMethod);
+
+	// Number of callbacks
+	void* pInt2 = (void *) &Int2;
+	MeasureHook("callbacks/pre0_post0", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 0, 0);
+	MeasureHook("callbacks/pre1_post0", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 0);
+	MeasureHook("callbacks/preN_post0", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), MANY_CALLBACKS, 0);
+	MeasureHook("callbacks/pre0_post1", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 0, 1);
+	MeasureHook("callbacks/pre0_postN", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 0, MANY_CALLBACKS);
+	MeasureHook("callbacks/pre1_post1", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 1);
+	MeasureHook("callbacks/preN_postN", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), MANY_CALLBACKS, MANY_CALLBACKS);
+
+	// Calling conventions
+	std::vector<DataType_t> vecMethodArgs;
+	vecMethodArgs.push_back(DATA_TYPE_POINTER);
+	vecMethodArgs.push_back(DATA_TYPE_INT);
+	vecMethodArgs.push_back(DATA_TYPE_INT);
+
+	int (MyClass::*pMethod)(int, int) = &MyClass::Method;
+	MeasureHook(CDECL_NAME, &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 1);
+	MeasureHook(THISCALL_NAME, &LoopMethod, (void *&) pMethod, new ThiscallConvention(vecMethodArgs, DATA_TYPE_INT), 1, 1);
+
+	// Number of arguments
+	MeasureHook("arguments/int0", &LoopInt0, (void *) &Int0, new CdeclConvention(GetIntArgs(0), DATA_TYPE_INT), 1, 1);
+	MeasureHook("arguments/int2", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 1);
+	MeasureHook("arguments/int4", &LoopInt4, (void *) &Int4, new CdeclConvention(GetIntArgs(4), DATA_TYPE_INT), 1, 1);
+	MeasureHook("arguments/int8", &LoopInt8, (void *) &Int8, new CdeclConvention(GetIntArgs(8), DATA_TYPE_INT), 1, 1);
+
+	// Return types
+	MeasureHook("return/float", &LoopFloat, (void *) &ReturnFloat, new CdeclConvention(GetIntArgs(2), DATA_TYPE_FLOAT), 1, 1);
+	MeasureHook("return/double", &LoopDouble, (void *) &ReturnDouble, new CdeclConvention(GetIntArgs(2), DATA_TYPE_DOUBLE), 1, 1);
+	MeasureHook("return/long_long", &LoopLongLong, (void *) &ReturnLongLong, new CdeclConvention(GetIntArgs(2), DATA_TYPE_LONG_LONG), 1, 1);
+
+	// Register modes
+	MeasureHook("register_mode/shared", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 1, REGISTERMODE_SHARED);
+	MeasureHook("register_mode/thread", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 1, REGISTERMODE_THREAD);
+	MeasureHook("register_mode/stack", &LoopInt2, pInt2, new CdeclConvention(GetIntArgs(2), DATA_TYPE_INT), 1, 1, REGISTERMODE_STACK);
+
+	// Hook installation
+	MeasureInstall();
+
+	// Print the results as JSON, so they can be compared by run_tests.py
+	printf("{\n");
+	printf("\t\"unit\": \"ns\",\n");
+	printf("\t\"results\": {\n");
+	for(unsigned int i=0; i < g_Results.size(); i++)
+	{
+		printf("\t\t\"%s\": %.3f%s\n", g_Results[i].m_Name.c_str(), g_Results[i].m_fNanoseconds,
+			i + 1 < g_Results.size() ? "," : "");
+	}
+	printf("\t}\n");
+	printf("}\n");
+
+	return 0;
+}
@@ -0,0 +1,24 @@
+set -e
+
+# The prebuilt AsmJit library is 32-bit, so a 64-bit build of it is required
+ASMJIT_LIBRARY=${ASMJIT_LIBRARY:?"set ASMJIT_LIBRARY to a 64-bit build of AsmJit"}
+
+mkdir -p Build/unix-x64
+cd Build/unix-x64
+cmake ../../src -G"Unix Makefiles" -DASMJIT_STATIC=1 -DDYNAMICHOOKS_X64=1 -DASMJIT_LIBRARY="$ASMJIT_LIBRARY"
+make
+cd ../..
+
+mkdir -p Build/unix-x64-tests
+cd Build/unix-x64-tests
+cmake ../../tests -G"Unix Makefiles" -DASMJIT_STATIC=1 -DDYNAMICHOOKS_X64=1 -DASMJIT_LIBRARY="$ASMJIT_LIBRARY"
+make
+cd ../..
+
+mkdir -p Build/unix-x64-bench
+cd Build/unix-x64-bench
+cmake ../../bench -G"Unix Makefiles" -DASMJIT_STATIC=1 -DDYNAMICHOOKS_X64=1 -DASMJIT_LIBRARY="$ASMJIT_LIBRARY"
+make
+cd ../..
+
+python3 run_tests.py Build/unix-x64-tests --bench Build/unix-x64-bench/bench_hooks
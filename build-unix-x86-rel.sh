@@ -12,4 +12,10 @@ cmake ../../tests -G"Unix Makefiles" -DASMJIT_STATIC=1
 make
 cd ../..
 
-python3 run_tests.py Build/unix-x86-tests
\ No newline at end of file
+mkdir -p Build/unix-x86-bench
+cd Build/unix-x86-bench
+cmake ../../bench -G"Unix Makefiles" -DASMJIT_STATIC=1
+make
+cd ../..
+
+python3 run_tests.py Build/unix-x86-tests --bench Build/unix-x86-bench/bench_hooks
\ No newline at end of file
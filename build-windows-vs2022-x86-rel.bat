@@ -10,7 +10,13 @@ cmake ..\..\tests -G"Visual Studio 17" -A Win32 -DASMJIT_STATIC=1 || goto :error
 ::msbuild Tests.sln /p:Configuration=Release || goto :error
 cd ..\..
 
-::python run_tests.py Build/vs2022-x86-tests/Release || goto :error
+mkdir .\Build\vs2022-x86-bench
+cd .\Build\vs2022-x86-bench
+cmake ..\..\bench -G"Visual Studio 17" -A Win32 -DASMJIT_STATIC=1 || goto :error
+::msbuild Bench.sln /p:Configuration=Release || goto :error
+cd ..\..
+
+::python run_tests.py Build/vs2022-x86-tests/Release --bench Build/vs2022-x86-bench/Release/bench_hooks.exe || goto :error
 goto :EOF
 
 :error
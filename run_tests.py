@@ -3,6 +3,8 @@ from __future__ import print_function
 import sys
 import subprocess
 import os
+import json
+import argparse
 
 def is_test_file(name, path):
     """
@@ -14,17 +16,12 @@ def is_test_file(name, path):
 
     return os.path.isfile(path) and name.startswith('test_')
 
-def main(args):
+def run_tests(test_dir):
     """
-    Run all test files in the given test directory.
+    Run all test files in the given test directory. Return True if all tests
+    were successful.
     """
 
-    if len(args) != 2:
-        raise SyntaxError(
-            'Invalid syntax: python run_tests.py <path to test directory>')
-
-    test_dir = args[1]
-
     test_count = 0
     success_count = 0
     for name in os.listdir(test_dir):
@@ -47,7 +44,89 @@ def main(args):
     print('{0} of {1} tests finished sucessfully.'.format(
         success_count, test_count))
 
-    if test_count != success_count:
+    return test_count == success_count
+
+def run_benchmark(path):
+    """
+    Run the given benchmark executable and return its results as a dict that
+    maps the benchmark names to nanoseconds.
+    """
+
+    print('Benchmarking {0}...'.format(os.path.basename(path)))
+    output = subprocess.check_output(path)
+    return json.loads(output.decode('utf-8'))['results']
+
+def compare_benchmark(results, baseline, threshold):
+    """
+    Print the results next to the baseline. Return the number of benchmarks
+    that are slower than the baseline by more than the given threshold.
+    """
+
+    regression_count = 0
+    for name in sorted(results):
+        current = results[name]
+        if name not in baseline:
+            print('  {0:<32} {1:>10.3f} ns       (new)'.format(name, current))
+            continue
+
+        previous = baseline[name]
+        change = (current - previous) / previous if previous else 0
+        status = ''
+        if change > threshold:
+            status = 'REGRESSION'
+            regression_count += 1
+
+        print('  {0:<32} {1:>10.3f} ns {2:>+7.1%} {3}'.format(
+            name, current, change, status))
+
+    print('{0} of {1} benchmarks regressed by more than {2:.0%}.'.format(
+        regression_count, len(results), threshold))
+
+    return regression_count
+
+def main(args):
+    """
+    Run all tests and optionally the benchmarks.
+    """
+
+    parser = argparse.ArgumentParser(
+        description='Run the tests and benchmarks of DynamicHooks.')
+    parser.add_argument('test_dir', nargs='?',
+        help='path to the test directory')
+    parser.add_argument('--bench', metavar='PATH',
+        help='path to the benchmark executable')
+    parser.add_argument('--baseline', metavar='FILE',
+        help='compare the benchmark results against a saved baseline')
+    parser.add_argument('--save-baseline', metavar='FILE',
+        help='save the benchmark results as a new baseline')
+    parser.add_argument('--threshold', type=float, default=0.1,
+        help='relative slowdown that counts as a regression (default: 0.1)')
+    options = parser.parse_args(args[1:])
+
+    if options.test_dir is None and options.bench is None:
+        parser.error('a test directory or --bench is required')
+
+    success = True
+    if options.test_dir is not None:
+        success = run_tests(options.test_dir)
+
+    if options.bench is not None:
+        results = run_benchmark(options.bench)
+
+        baseline = {}
+        if options.baseline is not None:
+            with open(options.baseline) as f:
+                baseline = json.load(f)['results']
+
+        if compare_benchmark(results, baseline, options.threshold):
+            success = False
+
+        if options.save_baseline is not None:
+            with open(options.save_baseline, 'w') as f:
+                json.dump({'unit': 'ns', 'results': results}, f, indent=4,
+                    sort_keys=True)
+
+    if not success:
         sys.exit(1)
 
 if __name__ == '__main__':
@@ -0,0 +1,477 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from
+* the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software in a
+* product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include <string.h>
+
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+#ifdef __linux__
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+#endif
+
+#include "arena.h"
+
+using namespace asmjit;
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+// Shared memory of a dual mapped trampoline slab
+#if defined __linux__
+	typedef int SlabFile_t;
+	#define SLAB_NO_FILE -1
+#elif defined _WIN32
+	typedef HANDLE SlabFile_t;
+	#define SLAB_NO_FILE NULL
+#endif
+
+
+// ============================================================================
+// >> Trampoline slabs
+// ============================================================================
+/*
+Returns true if every byte of a slab at <pSlab> can be reached from <pFunc>
+with a relative jump and vice versa.
+*/
+static bool IsSlabNear(void* pSlab, void* pFunc)
+{
+	// rel32 wraps around in 32-bit address spaces
+	if (sizeof(void *) == 4)
+		return true;
+
+	long long iDistance = (long long) (size_t) pSlab - (long long) (size_t) pFunc;
+	if (iDistance < 0)
+		iDistance = -iDistance;
+
+	return iDistance < 0x7FFFFFFFLL - TRAMPOLINE_SLAB_SIZE;
+}
+
+/*
+Creates the shared memory of a dual mapped slab. Returns SLAB_NO_FILE if the
+system doesn't support it.
+*/
+static SlabFile_t CreateSlabFile()
+{
+#if defined __linux__
+#ifdef SYS_memfd_create
+	int iFile = syscall(SYS_memfd_create, "DynamicHooks", 0);
+	if (iFile != -1 && ftruncate(iFile, TRAMPOLINE_SLAB_SIZE) != 0)
+	{
+		close(iFile);
+		return SLAB_NO_FILE;
+	}
+	return iFile;
+#else
+	return SLAB_NO_FILE;
+#endif
+#elif defined _WIN32
+	return CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_EXECUTE_READWRITE, 0, TRAMPOLINE_SLAB_SIZE, NULL);
+#endif
+}
+
+static void CloseSlabFile(SlabFile_t file)
+{
+#if defined __linux__
+	close(file);
+#elif defined _WIN32
+	CloseHandle(file);
+#endif
+}
+
+/*
+Maps the writable view of a dual mapped slab or returns NULL.
+*/
+static void* MapWritableView(SlabFile_t file)
+{
+#if defined __linux__
+	void* pView = mmap(NULL, TRAMPOLINE_SLAB_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, file, 0);
+	return pView == MAP_FAILED ? NULL : pView;
+#elif defined _WIN32
+	return MapViewOfFile(file, FILE_MAP_READ|FILE_MAP_WRITE, 0, 0, TRAMPOLINE_SLAB_SIZE);
+#endif
+}
+
+/*
+Maps the executable view of a slab at the given address or somewhere else.
+Without a file, the view is also writable.
+*/
+static void* MapExecutableView(void* pHint, SlabFile_t file)
+{
+#if defined __linux__
+	void* pView;
+	if (file == SLAB_NO_FILE)
+		pView = mmap(pHint, TRAMPOLINE_SLAB_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	else
+		pView = mmap(pHint, TRAMPOLINE_SLAB_SIZE, PROT_READ|PROT_EXEC, MAP_SHARED, file, 0);
+
+	return pView == MAP_FAILED ? NULL : pView;
+#elif defined _WIN32
+	// Both fail if the address is already in use
+	if (file == SLAB_NO_FILE)
+		return VirtualAlloc(pHint, TRAMPOLINE_SLAB_SIZE, MEM_COMMIT|MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+
+	return MapViewOfFileEx(file, FILE_MAP_READ|FILE_MAP_EXECUTE, 0, 0, TRAMPOLINE_SLAB_SIZE, pHint);
+#endif
+}
+
+static void UnmapView(void* pView, bool bFile)
+{
+#if defined __linux__
+	munmap(pView, TRAMPOLINE_SLAB_SIZE);
+#elif defined _WIN32
+	if (bFile)
+		UnmapViewOfFile(pView);
+	else
+		VirtualFree(pView, 0, MEM_RELEASE);
+#endif
+}
+
+/*
+Maps the executable view of a slab near the given function or returns NULL.
+*/
+static void* MapExecutableViewNear(void* pFunc, SlabFile_t file)
+{
+	// Try the addresses around the function in steps of 16MB
+	const long long iStep = 16 * 1024 * 1024;
+	long long iFunc = (long long) (size_t) pFunc & ~(TRAMPOLINE_SLAB_SIZE - 1LL);
+	for(long long iDistance=0; iDistance < 0x7FFFFFFFLL; iDistance += iStep)
+	{
+		for(int iSign=1; iSign >= -1; iSign -= 2)
+		{
+			long long iHint = iFunc + iSign * iDistance;
+			if (iHint <= 0 || (iDistance == 0 && iSign == -1))
+				continue;
+
+			// The hint is only a suggestion on Linux, so the address has
+			// to be checked.
+			void* pView = MapExecutableView((void *) (size_t) iHint, file);
+			if (!pView)
+				continue;
+
+			if (IsSlabNear(pView, pFunc))
+				return pView;
+
+			UnmapView(pView, file != SLAB_NO_FILE);
+		}
+	}
+	return NULL;
+}
+
+
+// ============================================================================
+// >> CCodeArena
+// ============================================================================
+/*
+Returns the parameters of the allocator for bridges and post-hook code.
+*/
+static const JitAllocator::CreateParams* GetAllocatorParams(bool bDualMapping)
+{
+	// Write the code through a separate mapping, so no page is writable and
+	// executable at the same time
+	static JitAllocator::CreateParams s_DualParams;
+	static JitAllocator::CreateParams s_Params;
+	s_DualParams.options = JitAllocatorOptions::kUseDualMapping;
+	return bDualMapping ? &s_DualParams : &s_Params;
+}
+
+CCodeArena::CCodeArena() : m_DualAllocator(GetAllocatorParams(true)), m_Allocator(GetAllocatorParams(false))
+{
+	m_pAllocator = &m_DualAllocator;
+	m_pChunkAllocator = NULL;
+	m_iChunkUsed = CODE_ARENA_CHUNK_SIZE;
+}
+
+CCodeArena::~CCodeArena()
+{
+	// The allocators release all chunks
+	for(std::vector<CTrampolineSlab*>::iterator it=m_TrampolineSlabs.begin(); it != m_TrampolineSlabs.end(); it++)
+	{
+		bool bFile = (*it)->m_pWritable != (*it)->m_pBase;
+		if (bFile)
+			UnmapView((*it)->m_pWritable, true);
+
+		UnmapView((*it)->m_pBase, bFile);
+		delete *it;
+	}
+}
+
+void CCodeArena::InitCode(CodeHolder* pCode)
+{
+	pCode->init(Environment::host(), CpuInfo::host().features());
+}
+
+void* CCodeArena::Add(CodeHolder* pCode)
+{
+	if (pCode->flatten() != kErrorOk || pCode->resolveUnresolvedLinks() != kErrorOk)
+		return NULL;
+
+	size_t iSize = pCode->codeSize();
+	if (iSize == 0)
+		return NULL;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	CBlock block;
+	if (!Alloc(iSize, block))
+		return NULL;
+
+	void* pCodeAddr = (unsigned char *) block.m_Span.rx() + block.m_iOffset;
+
+	// Relocate the code to its final address and copy it through the
+	// writable mapping
+	std::vector<unsigned char> buffer(pCode->codeSize());
+	if (pCode->relocateToBase((uint64_t) (size_t) pCodeAddr) != kErrorOk
+		|| pCode->copyFlattenedData(&buffer[0], buffer.size(), CopySectionFlags::kPadTargetBuffer) != kErrorOk
+		|| block.m_pAllocator->write(block.m_Span, block.m_iOffset, &buffer[0], buffer.size()) != kErrorOk)
+	{
+		if (block.m_iClass == -1)
+			block.m_pAllocator->release(block.m_Span.rx());
+		else
+			m_FreeBlocks[block.m_iClass].push_back(block);
+
+		return NULL;
+	}
+
+	m_Blocks[pCodeAddr] = block;
+	return pCodeAddr;
+}
+
+void CCodeArena::Release(void* pCode)
+{
+	if (!pCode)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::map<void*, CBlock>::iterator it = m_Blocks.find(pCode);
+	if (it == m_Blocks.end())
+		return;
+
+	if (it->second.m_iClass == -1)
+		it->second.m_pAllocator->release(pCode);
+	else
+		m_FreeBlocks[it->second.m_iClass].push_back(it->second);
+
+	m_Blocks.erase(it);
+}
+
+bool CCodeArena::AllocSpan(size_t iSize, JitAllocator::Span& span, JitAllocator** ppAllocator)
+{
+	if (m_pAllocator->alloc(span, iSize) != kErrorOk)
+	{
+		// The system might not support dual mapping (e.g. no shared memory).
+		// Continue with writable and executable pages like the trampoline
+		// slabs.
+		if (m_pAllocator != &m_DualAllocator)
+			return false;
+
+		m_pAllocator = &m_Allocator;
+		if (m_pAllocator->alloc(span, iSize) != kErrorOk)
+			return false;
+	}
+
+	*ppAllocator = m_pAllocator;
+	return true;
+}
+
+bool CCodeArena::Alloc(size_t iSize, CBlock& block)
+{
+	// Find the smallest size class that fits
+	int iClass = 0;
+	while (iClass < CODE_ARENA_CLASS_COUNT && (size_t) (CODE_ARENA_ALIGNMENT << iClass) < iSize)
+		iClass++;
+
+	// Large code gets its own span
+	if (iClass == CODE_ARENA_CLASS_COUNT)
+	{
+		block.m_iClass = -1;
+		block.m_iOffset = 0;
+		return AllocSpan(iSize, block.m_Span, &block.m_pAllocator);
+	}
+
+	// Reuse a released block
+	if (!m_FreeBlocks[iClass].empty())
+	{
+		block = m_FreeBlocks[iClass].back();
+		m_FreeBlocks[iClass].pop_back();
+		return true;
+	}
+
+	// Take a new block from the current chunk. The rest of a full chunk is
+	// split into free blocks, so it's not wasted.
+	size_t iClassSize = CODE_ARENA_ALIGNMENT << iClass;
+	if (m_iChunkUsed + iClassSize > CODE_ARENA_CHUNK_SIZE)
+	{
+		for(int i=iClass - 1; i >= 0; i--)
+		{
+			size_t iRestSize = CODE_ARENA_ALIGNMENT << i;
+			if (m_iChunkUsed + iRestSize > CODE_ARENA_CHUNK_SIZE)
+				continue;
+
+			CBlock rest;
+			rest.m_iClass = i;
+			rest.m_Span = m_Chunk;
+			rest.m_pAllocator = m_pChunkAllocator;
+			rest.m_iOffset = m_iChunkUsed;
+			m_FreeBlocks[i].push_back(rest);
+			m_iChunkUsed += iRestSize;
+		}
+
+		if (!AllocSpan(CODE_ARENA_CHUNK_SIZE, m_Chunk, &m_pChunkAllocator))
+		{
+			m_iChunkUsed = CODE_ARENA_CHUNK_SIZE;
+			return false;
+		}
+		m_iChunkUsed = 0;
+	}
+
+	block.m_iClass = iClass;
+	block.m_Span = m_Chunk;
+	block.m_pAllocator = m_pChunkAllocator;
+	block.m_iOffset = m_iChunkUsed;
+	m_iChunkUsed += iClassSize;
+	return true;
+}
+
+CTrampolineSlab* CCodeArena::AddTrampolineSlab(void* pFunc)
+{
+	// Prefer two views of the same memory, so no page is writable and
+	// executable at the same time
+	SlabFile_t file = CreateSlabFile();
+	void* pWritable = NULL;
+	if (file != SLAB_NO_FILE)
+	{
+		pWritable = MapWritableView(file);
+		if (!pWritable)
+		{
+			CloseSlabFile(file);
+			file = SLAB_NO_FILE;
+		}
+	}
+
+	// The views keep the memory alive
+	void* pBase = MapExecutableViewNear(pFunc, file);
+	if (file != SLAB_NO_FILE)
+		CloseSlabFile(file);
+
+	if (!pBase)
+	{
+		if (pWritable)
+			UnmapView(pWritable, true);
+
+		return NULL;
+	}
+
+	CTrampolineSlab* pSlab = new CTrampolineSlab;
+	pSlab->m_pBase = (unsigned char *) pBase;
+	pSlab->m_pWritable = pWritable ? (unsigned char *) pWritable : pSlab->m_pBase;
+	memset(pSlab->m_UsedSlots, 0, sizeof(pSlab->m_UsedSlots));
+	m_TrampolineSlabs.push_back(pSlab);
+	return pSlab;
+}
+
+unsigned char* CCodeArena::AllocTrampoline(void* pFunc, int iSize, unsigned char** ppWritable)
+{
+	int iSlots = (iSize + TRAMPOLINE_SLOT_SIZE - 1) / TRAMPOLINE_SLOT_SIZE;
+	if (iSlots <= 0 || iSlots > TRAMPOLINE_SLAB_SLOTS)
+		return NULL;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	// Search a near slab with enough free slots in a row. A new slab is only
+	// mapped if there is none.
+	for(int iPass=0; iPass < 2; iPass++)
+	{
+		for(std::vector<CTrampolineSlab*>::iterator it=m_TrampolineSlabs.begin(); it != m_TrampolineSlabs.end(); it++)
+		{
+			CTrampolineSlab* pSlab = *it;
+			if (!IsSlabNear(pSlab->m_pBase, pFunc))
+				continue;
+
+			int iFree = 0;
+			for(int i=0; i < TRAMPOLINE_SLAB_SLOTS; i++)
+			{
+				if (pSlab->m_UsedSlots[i / 32] & (1u << (i % 32)))
+				{
+					iFree = 0;
+					continue;
+				}
+
+				if (++iFree < iSlots)
+					continue;
+
+				int iFirst = i - iSlots + 1;
+				for(int j=iFirst; j <= i; j++)
+					pSlab->m_UsedSlots[j / 32] |= 1u << (j % 32);
+
+				unsigned char* pTrampoline = pSlab->m_pBase + iFirst * TRAMPOLINE_SLOT_SIZE;
+				m_TrampolineSlots[pTrampoline] = iSlots;
+				*ppWritable = pSlab->m_pWritable + iFirst * TRAMPOLINE_SLOT_SIZE;
+				return pTrampoline;
+			}
+		}
+
+		if (iPass == 0 && !AddTrampolineSlab(pFunc))
+			return NULL;
+	}
+	return NULL;
+}
+
+void CCodeArena::FreeTrampoline(void* pTrampoline)
+{
+	if (!pTrampoline)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::map<void*, int>::iterator slots = m_TrampolineSlots.find(pTrampoline);
+	if (slots == m_TrampolineSlots.end())
+		return;
+
+	for(std::vector<CTrampolineSlab*>::iterator it=m_TrampolineSlabs.begin(); it != m_TrampolineSlabs.end(); it++)
+	{
+		CTrampolineSlab* pSlab = *it;
+		size_t iOffset = (unsigned char *) pTrampoline - pSlab->m_pBase;
+		if (iOffset >= TRAMPOLINE_SLAB_SIZE)
+			continue;
+
+		int iFirst = (int) (iOffset / TRAMPOLINE_SLOT_SIZE);
+		for(int j=iFirst; j < iFirst + slots->second; j++)
+			pSlab->m_UsedSlots[j / 32] &= ~(1u << (j % 32));
+
+		break;
+	}
+	m_TrampolineSlots.erase(slots);
+}
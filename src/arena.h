@@ -0,0 +1,178 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include <map>
+#include <vector>
+#include <mutex>
+
+#include "x86.h"
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+// Blocks are aligned to and sized in multiples of a cache line
+#define CODE_ARENA_ALIGNMENT 64
+
+// Size classes are 64, 128, ..., 2048 Bytes. Larger code gets its own block.
+#define CODE_ARENA_CLASS_COUNT 6
+
+// Size of the chunks that are split into blocks
+#define CODE_ARENA_CHUNK_SIZE 16384
+
+// Trampolines consist of one or more slots of a slab
+#define TRAMPOLINE_SLOT_SIZE 32
+#define TRAMPOLINE_SLAB_SIZE 65536
+#define TRAMPOLINE_SLAB_SLOTS (TRAMPOLINE_SLAB_SIZE / TRAMPOLINE_SLOT_SIZE)
+
+
+// ============================================================================
+// >> CTrampolineSlab
+// ============================================================================
+/*
+A dedicated executable mapping that is split into trampoline slots.
+*/
+class CTrampolineSlab
+{
+public:
+	// Executable view of the slab
+	unsigned char* m_pBase;
+
+	// Writable view of the same memory or m_pBase if the slab couldn't be
+	// mapped twice
+	unsigned char* m_pWritable;
+
+	// One bit per slot that is set if the slot is used
+	unsigned int m_UsedSlots[TRAMPOLINE_SLAB_SLOTS / 32];
+};
+
+
+// ============================================================================
+// >> CCodeArena
+// ============================================================================
+/*
+Executable memory for the generated code of all hooks.
+
+Small code is packed densely into chunks and released blocks are kept in a
+free list per size class, so entries, bridges and post-hook code of
+different hooks share the same pages. All methods can be called by multiple
+threads at the same time.
+
+The memory is mapped twice if the system supports it: The code is written
+through a writable view and executed through a read-only view, so there are
+no writable and executable pages and no protection changes. If dual mapping
+fails, the arena falls back to writable and executable pages.
+*/
+class CCodeArena
+{
+public:
+	CCodeArena();
+	~CCodeArena();
+
+	/*
+	Initializes a CodeHolder for code that will be added to the arena.
+	*/
+	void InitCode(asmjit::CodeHolder* pCode);
+
+	/*
+	Copies the code to the arena. Returns the address of the code or NULL.
+	*/
+	void* Add(asmjit::CodeHolder* pCode);
+
+	/*
+	Releases code that has been added before. NULL is ignored.
+	*/
+	void Release(void* pCode);
+
+	/*
+	Allocates executable memory for a trampoline of the given function. It's
+	located within +-2GB of the function, so relative jumps between them
+	always reach. The trampoline has to be written through the address that
+	is stored in <ppWritable>. Returns NULL on failure.
+	*/
+	unsigned char* AllocTrampoline(void* pFunc, int iSize, unsigned char** ppWritable);
+
+	/*
+	Releases a trampoline. NULL is ignored.
+	*/
+	void FreeTrampoline(void* pTrampoline);
+
+private:
+	class CBlock
+	{
+	public:
+		// Size class or -1 if the block has its own span
+		int m_iClass;
+
+		// The span that contains the block and the offset of the block in it
+		asmjit::JitAllocator::Span m_Span;
+		size_t m_iOffset;
+
+		// The allocator of the span
+		asmjit::JitAllocator* m_pAllocator;
+	};
+
+	bool AllocSpan(size_t iSize, asmjit::JitAllocator::Span& span, asmjit::JitAllocator** ppAllocator);
+	bool Alloc(size_t iSize, CBlock& block);
+	CTrampolineSlab* AddTrampolineSlab(void* pFunc);
+
+private:
+	std::mutex m_Mutex;
+
+	// Allocators with and without dual mapping. The first one is used until
+	// it fails.
+	asmjit::JitAllocator m_DualAllocator;
+	asmjit::JitAllocator m_Allocator;
+	asmjit::JitAllocator* m_pAllocator;
+
+	// The chunk that new blocks are taken from, its allocator and the used
+	// part of it
+	asmjit::JitAllocator::Span m_Chunk;
+	asmjit::JitAllocator* m_pChunkAllocator;
+	size_t m_iChunkUsed;
+
+	// Released blocks of every size class
+	std::vector<CBlock> m_FreeBlocks[CODE_ARENA_CLASS_COUNT];
+
+	// Blocks in use indexed by their address
+	std::map<void*, CBlock> m_Blocks;
+
+	// Slabs for trampolines and the number of slots of every trampoline
+	std::vector<CTrampolineSlab*> m_TrampolineSlabs;
+	std::map<void*, int> m_TrampolineSlots;
+};
+
+#endif // _ARENA_H
@@ -32,6 +32,12 @@
 // >> INCLUDES
 // ============================================================================
 #include "asm.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined __x86_64__ || defined _M_X64
+#define ASM_X64
+#endif
 
 #ifndef _WIN32
 
@@ -62,13 +68,27 @@
 */
 void check_thunks(unsigned char *dest, unsigned char *pc)
 {
-#if defined _WIN32
+	check_thunks_ex(dest, dest, pc);
+}
+
+/**
+* Same as check_thunks, but the code will be executed at exec_dest.
+*
+* @param dest		Destination buffer where a call opcode + addr (5 bytes) has just been written.
+* @param exec_dest	Address of dest when the code is executed.
+* @param pc		The program counter value that needs to be set (usually the next address from the source).
+* @noreturn
+*/
+void check_thunks_ex(unsigned char *dest, unsigned char *exec_dest, unsigned char *pc)
+{
+#if defined _WIN32 || defined ASM_X64
+	/* -fPIC thunks are only used by 32-bit code */
 	return;
 #else
 	/* Step write address back 4 to the start of the function address */
 	unsigned char *writeaddr = dest - 4;
 	unsigned char *calloffset = *(unsigned char **)writeaddr;
-	unsigned char *calladdr = (unsigned char *)(dest + (intptr_t)calloffset);
+	unsigned char *calladdr = (unsigned char *)(exec_dest + (intptr_t)calloffset);
 
 	/* Lookup name of function being called */
 	if ((*calladdr == 0x8B) && (*(calladdr+2) == 0x24) && (*(calladdr+3) == 0xC3))
@@ -126,12 +146,19 @@ void check_thunks(unsigned char *dest, unsigned char *pc)
 //if dest is not NULL, it will copy the bytes to dest as well as fix CALLs and JMPs
 //http://www.devmaster.net/forums/showthread.php?t=2311
 int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
+	return copy_bytes_ex(func, dest, dest, required_len);
+}
+
+//same as copy_bytes, but CALLs and JMPs are fixed for execution at exec_dest
+int copy_bytes_ex(unsigned char *func, unsigned char* dest, unsigned char* exec_dest, int required_len) {
 	int bytecount = 0;
+	intptr_t exec_delta = dest ? exec_dest - dest : 0;
 
 	while(bytecount < required_len && *func != 0xCC)
 	{
 		// prefixes F0h, F2h, F3h, 66h, 67h, D8h-DFh, 2Eh, 36h, 3Eh, 26h, 64h and 65h
 		int operandSize = 4;
+		int rexW = 0;
 		int FPU = 0;
 		int twoByte = 0;
 		unsigned char opcode = 0x90;
@@ -141,7 +168,12 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 			*func == 0xF3 ||
 			(*func & 0xFC) == 0x64 ||
 			(*func & 0xF8) == 0xD8 ||
+#ifdef ASM_X64
+			// Segment overrides. 62h is EVEX and 63h MOVSXD in 64-bit mode.
+			(*func & 0xE7) == 0x26)
+#else
 			(*func & 0x7E) == 0x62)
+#endif
 		{
 			if(*func == 0x66)
 			{
@@ -165,6 +197,19 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 			bytecount++;
 		}
 
+#ifdef ASM_X64
+		// REX prefix. It must be the last prefix.
+		if((*func & 0xF0) == 0x40)
+		{
+			rexW = *func & 0x08;
+			if (dest)
+				*dest++ = *func++;
+			else
+				func++;
+			bytecount++;
+		}
+#endif
+
 		// two-byte opcode byte
 		if(*func == 0x0F)
 		{
@@ -239,6 +284,13 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 		// Dword displacement, no base
 		if((modRM & 0xC5) == 0x05) {
 			if (dest) {
+#ifdef ASM_X64
+				// RIP-relative. The source and the copy are shifted by the
+				// same distance, so the instruction length doesn't matter.
+				if((modRM & 0xC7) == 0x05)
+					*(int32_t*)dest = (int32_t)((func + *(int32_t*)func) - (dest + exec_delta));
+				else
+#endif
 				*(unsigned int*)dest = *(unsigned int*)func;
 				dest += 4;
 			}
@@ -303,6 +355,17 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 				func += 2;
 				bytecount += 2;
 			}
+#ifdef ASM_X64
+			else if((opcode & 0xF8) == 0xB8 && rexW) // MOV r64, imm64
+			{
+				if (dest) {
+					*(uint64_t*)dest = *(uint64_t*)func;
+					dest += 8;
+				}
+				func += 8;
+				bytecount += 8;
+			}
+#endif
 			else if((opcode & 0xFC) == 0x80 ||
 				(opcode & 0xC7) == 0x05 ||
 				(opcode & 0xF8) == 0xB8 ||
@@ -318,17 +381,17 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 					if ((opcode & 0xFE) == 0xE8) {
 						if (operandSize == 4)
 						{
-							*(long*)dest = ((func + *(long*)func) - dest);
+							*(int32_t*)dest = (int32_t)((func + *(int32_t*)func) - (dest + exec_delta));
 
 							//pRED* edit. func is the current address of the call address, +4 is the next instruction, so the value of $pc
-							check_thunks(dest+4, func+4);
+							check_thunks_ex(dest+4, dest+4+exec_delta, func+4);
 						}
 						else
-							*(short*)dest = ((func + *(short*)func) - dest);
+							*(short*)dest = ((func + *(short*)func) - (dest + exec_delta));
 
 					} else {
 						if (operandSize == 4)
-							*(unsigned long*)dest = *(unsigned long*)func;
+							*(unsigned int*)dest = *(unsigned int*)func;
 						else
 							*(unsigned short*)dest = *(unsigned short*)func;
 					}
@@ -358,8 +421,9 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 			else if((opcode & 0xF0) == 0x80) // Jcc -i
 			{
 				if (dest) {
+					//Fix Jcc offset
 					if (operandSize == 4)
-						*(unsigned long*)dest = *(unsigned long*)func;
+						*(int32_t*)dest = (int32_t)((func + *(int32_t*)func) - (dest + exec_delta));
 					else
 						*(unsigned short*)dest = *(unsigned short*)func;
 
@@ -377,7 +441,7 @@ int copy_bytes(unsigned char *func, unsigned char* dest, int required_len) {
 //insert a specific JMP instruction at the given location
 void inject_jmp(void* src, void* dest) {
 	*(unsigned char*)src = OP_JMP;
-	*(long*)((unsigned char*)src+1) = (long)((unsigned char*)dest - ((unsigned char*)src + OP_JMP_SIZE));
+	*(int32_t*)((unsigned char*)src+1) = (int32_t)((unsigned char*)dest - ((unsigned char*)src + OP_JMP_SIZE));
 }
 
 //fill a given block with NOPs
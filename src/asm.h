@@ -48,12 +48,16 @@ extern "C" {
 #endif
 
 	void check_thunks(unsigned char *dest, unsigned char *pc);
+	void check_thunks_ex(unsigned char *dest, unsigned char *exec_dest, unsigned char *pc);
 
 	//if dest is NULL, returns minimum number of bytes needed to be copied
 	//if dest is not NULL, it will copy the bytes to dest as well as fix CALLs and JMPs
 	//http://www.devmaster.net/forums/showthread.php?t=2311
 	int copy_bytes(unsigned char *func, unsigned char* dest, int required_len);
 
+	//same as copy_bytes, but CALLs and JMPs are fixed for execution at exec_dest
+	int copy_bytes_ex(unsigned char *func, unsigned char* dest, unsigned char* exec_dest, int required_len);
+
 	//insert a specific JMP instruction at the given location
 	void inject_jmp(void* src, void* dest);
 
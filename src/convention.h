@@ -60,7 +60,31 @@ enum DataType_t
 	DATA_TYPE_FLOAT,
 	DATA_TYPE_DOUBLE,
 	DATA_TYPE_POINTER,
-	DATA_TYPE_STRING
+	DATA_TYPE_STRING,
+
+	// 128-bit SSE vector (__m128, __m128d, __m128i)
+	DATA_TYPE_M128,
+
+	// Object passed by value. The size, alignment and float eightbytes are
+	// encoded in the lower bits, use MakeObjectType() to create it.
+	DATA_TYPE_OBJECT = 0x40000000
+};
+
+
+// ============================================================================
+// >> FloatEightbyte_t
+// ============================================================================
+/*
+Eightbytes (8 byte halves) of an object that only contain float or double
+members. x64SystemV passes them via xmm registers if the object isn't bigger
+than 16 bytes. All other eightbytes are passed via integer registers.
+*/
+enum FloatEightbyte_t
+{
+	FLOAT_EIGHTBYTE_NONE = 0,
+	FLOAT_EIGHTBYTE_LOW = 1,
+	FLOAT_EIGHTBYTE_HIGH = 2,
+	FLOAT_EIGHTBYTE_BOTH = FLOAT_EIGHTBYTE_LOW | FLOAT_EIGHTBYTE_HIGH
 };
 
 
@@ -85,6 +109,62 @@ inline int Align(int size, int alignment)
 	return size + (alignment - unaligned);
 }
 
+/*
+Returns a data type that describes an object (e.g. a struct or class) that
+is passed or returned by value.
+
+@param <iSize>:
+The size of the object in bytes (sizeof).
+
+@param <iAlignment>:
+The alignment of the object in bytes (alignof).
+
+@param <iFloatEightbytes>:
+A combination of FloatEightbyte_t values. Only required for small objects
+with float or double members that are passed to x64SystemV functions, e.g.
+FLOAT_EIGHTBYTE_BOTH for struct { float x, y, z; }.
+*/
+inline DataType_t MakeObjectType(int iSize, int iAlignment=4, int iFloatEightbytes=FLOAT_EIGHTBYTE_NONE)
+{
+	int iShift = 0;
+	while ((1 << iShift) < iAlignment)
+		iShift++;
+
+	return (DataType_t) (DATA_TYPE_OBJECT | ((iFloatEightbytes & FLOAT_EIGHTBYTE_BOTH) << 28) | (iShift << 24) | (iSize & 0xFFFFFF));
+}
+
+/*
+Returns true if the data type was created with MakeObjectType().
+*/
+inline bool IsObjectType(DataType_t type)
+{
+	return (type & DATA_TYPE_OBJECT) != 0;
+}
+
+/*
+Returns the unaligned size of an object type.
+*/
+inline int GetObjectSize(DataType_t type)
+{
+	return type & 0xFFFFFF;
+}
+
+/*
+Returns the alignment of an object type.
+*/
+inline int GetObjectAlignment(DataType_t type)
+{
+	return 1 << ((type >> 24) & 0xF);
+}
+
+/*
+Returns the FloatEightbyte_t values of an object type.
+*/
+inline int GetObjectFloatEightbytes(DataType_t type)
+{
+	return (type >> 28) & FLOAT_EIGHTBYTE_BOTH;
+}
+
 /*
 Returns the size of a data type after applying alignment.
 
@@ -96,6 +176,9 @@ The alignment that should be used.
 */
 inline int GetDataTypeSize(DataType_t type, int iAlignment=4)
 {
+	if (IsObjectType(type))
+		return Align(GetObjectSize(type), iAlignment);
+
 	switch(type)
 	{
 		case DATA_TYPE_VOID:		return 0;
@@ -114,11 +197,65 @@ inline int GetDataTypeSize(DataType_t type, int iAlignment=4)
 		case DATA_TYPE_DOUBLE:		return Align(sizeof(double),				iAlignment);
 		case DATA_TYPE_POINTER:		return Align(sizeof(void *),				iAlignment);
 		case DATA_TYPE_STRING:		return Align(sizeof(char *),				iAlignment);
+		case DATA_TYPE_M128:		return Align(16,							iAlignment);
 		default: puts("Unknown data type.");
 	}
 	return 0;
 }
 
+/*
+Returns true if the data type is passed and returned via SSE registers by
+conventions that support it.
+
+@param <type>:
+The data type you would like to check.
+*/
+inline bool IsVectorDataType(DataType_t type)
+{
+	return type == DATA_TYPE_FLOAT || type == DATA_TYPE_DOUBLE || type == DATA_TYPE_M128;
+}
+
+/*
+Returns true if a 32-bit x86 function returns the given type via a hidden
+pointer, which is passed as an additional first argument. MSVC returns
+objects of 1, 2, 4 and 8 bytes via eax and edx. GCC returns all objects via
+a hidden pointer.
+
+@param <type>:
+The return type of the function.
+*/
+inline bool IsReturnedViaPointer(DataType_t type)
+{
+	if (!IsObjectType(type))
+		return false;
+
+#ifdef _WIN32
+	int iSize = GetObjectSize(type);
+	return iSize != 1 && iSize != 2 && iSize != 4 && iSize != 8;
+#else
+	return true;
+#endif
+}
+
+// ============================================================================
+// >> ArgumentLocation_t
+// ============================================================================
+/*
+Describes where an argument is located when the hooked function is called.
+*/
+struct ArgumentLocation_t
+{
+	// The register that holds the argument. If it's ESP (or RSP in 64-bit
+	// mode), the argument is located on the stack at m_iOffset relative to
+	// the saved stack pointer.
+	Register_t m_eRegister;
+	int m_iOffset;
+
+	// Size of the argument after applying alignment
+	int m_iSize;
+};
+
+
 // ============================================================================
 // >> CLASSES
 // ============================================================================
@@ -162,6 +299,15 @@ public:
 	*/
 	virtual int GetPopSize() = 0;
 
+	/*
+	Returns the number of bytes that should be reserved in the scratch area of
+	every register frame. See CRegisters::GetScratch().
+	*/
+	virtual int GetScratchSize()
+	{
+		return 0;
+	}
+
 	/*
 	Returns a pointer to the argument at the given index.
 
@@ -189,11 +335,35 @@ public:
 	*/
 	virtual void ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr) = 0;
 
+	/*
+	Adds the location of the next argument to m_ArgumentLocations. This
+	should be called by the constructor once per argument.
+
+	@param <reg>:
+	The register that holds the argument or ESP.
+
+	@param <iOffset>:
+	Offset relative to the saved stack pointer if <reg> is ESP.
+	*/
+	void AddArgumentLocation(Register_t reg, int iOffset, int iSize)
+	{
+		ArgumentLocation_t location;
+		location.m_eRegister = reg;
+		location.m_iOffset = iOffset;
+		location.m_iSize = iSize;
+		m_ArgumentLocations.push_back(location);
+	}
+
 public:
 	std::vector<DataType_t> m_vecArgTypes;
 	DataType_t m_returnType;
 	int m_iAlignment;
 	bool m_bHooked;
+
+	// Location of every argument. CHook resolves arguments with this table
+	// without calling GetArgumentPtr() and ArgumentPtrChanged(). Calling
+	// conventions that need to compute them dynamically leave it empty.
+	std::vector<ArgumentLocation_t> m_ArgumentLocations;
 };
 
 #endif // _CONVENTION_H
\ No newline at end of file
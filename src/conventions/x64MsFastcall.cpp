@@ -0,0 +1,198 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "x64MsFastcall.h"
+#include <algorithm>
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+// Size of the return address and the shadow space
+#define SHADOW_SPACE_END 40
+
+static const Register_t s_IntegerRegisters[] = {RCX, RDX, R8, R9};
+static const Register_t s_FloatRegisters[] = {XMM0, XMM1, XMM2, XMM3};
+
+
+// ============================================================================
+// >> FUNCTIONS
+// ============================================================================
+/*
+Returns true if the data type is passed and returned like an integer.
+Objects of other sizes and vectors are passed by reference.
+*/
+static bool IsPassedByValue(DataType_t type)
+{
+	if (type == DATA_TYPE_M128)
+		return false;
+
+	if (!IsObjectType(type))
+		return true;
+
+	int iSize = GetObjectSize(type);
+	return iSize == 1 || iSize == 2 || iSize == 4 || iSize == 8;
+}
+
+
+// ============================================================================
+// >> x64MsFastcall
+// ============================================================================
+x64MsFastcall::x64MsFastcall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment) :
+	ICallingConvention(vecArgTypes, returnType, iAlignment)
+{
+	// Objects that don't fit into rax are returned via a hidden pointer in
+	// rcx, which moves all arguments by one position
+	m_bReturnViaPointer = IsObjectType(m_returnType) && !IsPassedByValue(m_returnType);
+
+	int iPosition = 0;
+	if (m_bReturnViaPointer)
+		m_ArgumentRegisters.push_back(s_IntegerRegisters[iPosition++]);
+
+	bool bByReference = false;
+	int iOffset = SHADOW_SPACE_END;
+	for(int i=0; i < vecArgTypes.size(); i++, iPosition++)
+	{
+		ArgumentLocation_t location;
+		location.m_eRegister = RSP;
+		location.m_iOffset = 0;
+		location.m_iSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+
+		m_ByReference.push_back(!IsPassedByValue(m_vecArgTypes[i]));
+		if (m_ByReference[i])
+		{
+			// Only the pointer is stored in the register or stack slot
+			location.m_iSize = 8;
+			bByReference = true;
+		}
+
+		if (iPosition < 4)
+		{
+			bool bFloat = m_vecArgTypes[i] == DATA_TYPE_FLOAT || m_vecArgTypes[i] == DATA_TYPE_DOUBLE;
+			location.m_eRegister = bFloat ? s_FloatRegisters[iPosition] : s_IntegerRegisters[iPosition];
+			m_ArgumentRegisters.push_back(location.m_eRegister);
+		}
+		else
+		{
+			location.m_iOffset = iOffset;
+			iOffset += location.m_iSize;
+		}
+
+		m_Locations.push_back(location);
+	}
+
+	// The table can't describe arguments that are passed by reference
+	if (!bByReference)
+		m_ArgumentLocations = m_Locations;
+}
+
+x64MsFastcall::~x64MsFastcall()
+{
+}
+
+std::list<Register_t> x64MsFastcall::GetRegisters()
+{
+	std::list<Register_t> registers = m_ArgumentRegisters;
+
+	registers.push_back(RSP);
+	registers.push_back(RAX);
+
+	if (IsVectorDataType(m_returnType))
+	{
+		if (std::find(registers.begin(), registers.end(), XMM0) == registers.end())
+			registers.push_back(XMM0);
+	}
+
+#ifndef _WIN32
+	// The handlers use the System V ABI, which doesn't preserve these
+	// registers. The caller expects them to be unchanged.
+	registers.push_back(RSI);
+	registers.push_back(RDI);
+	registers.push_back(XMM6);
+	registers.push_back(XMM7);
+	registers.push_back(XMM8);
+	registers.push_back(XMM9);
+	registers.push_back(XMM10);
+	registers.push_back(XMM11);
+	registers.push_back(XMM12);
+	registers.push_back(XMM13);
+	registers.push_back(XMM14);
+	registers.push_back(XMM15);
+#endif
+
+	return registers;
+}
+
+int x64MsFastcall::GetPopSize()
+{
+	return 0;
+}
+
+void* x64MsFastcall::GetArgumentPtr(int iIndex, CRegisters* pRegisters)
+{
+	ArgumentLocation_t& location = m_Locations[iIndex];
+
+	void* pSlot;
+	if (location.m_eRegister == RSP)
+		pSlot = (void *) (pRegisters->m_rsp->GetValue<unsigned long long>() + location.m_iOffset);
+	else
+		pSlot = pRegisters->GetRegister(location.m_eRegister)->m_pAddress;
+
+	// The caller's copy is modified in place
+	if (m_ByReference[iIndex])
+		return *(void **) pSlot;
+
+	return pSlot;
+}
+
+void x64MsFastcall::ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr)
+{
+}
+
+void* x64MsFastcall::GetReturnPtr(CRegisters* pRegisters)
+{
+	if (IsVectorDataType(m_returnType))
+		return pRegisters->m_xmm0->m_pAddress;
+
+	if (m_bReturnViaPointer)
+	{
+		// The callee returns the hidden pointer via rax
+		return pRegisters->m_rax->GetValue<void *>();
+	}
+
+	return pRegisters->m_rax->m_pAddress;
+}
+
+void x64MsFastcall::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
+{
+}
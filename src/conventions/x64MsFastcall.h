@@ -0,0 +1,104 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _X64_MS_FASTCALL_H
+#define _X64_MS_FASTCALL_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "../convention.h"
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+Source: Windows docs (x64 calling convention)
+
+Registers:
+	- rax = return value
+	- rsp = stack pointer
+	- xmm0 = floating point and vector return value
+
+Parameter passing:
+	- the first four arguments are passed via rcx, rdx, r8 and r9 or via
+	  xmm0 - xmm3 if they are floating point types. Every argument uses the
+	  register that matches its position.
+	- the caller reserves 32 bytes of shadow space for these registers above
+	  the return address
+	- all other arguments are pushed onto the stack (right-to-left) above the
+	  shadow space
+	- objects of 1, 2, 4 or 8 bytes are passed like integers. All other
+	  objects and __m128 values are passed by reference.
+	- caller cleans up the stack
+	- alignment: 8 bytes
+
+Return values:
+	- return values of pointer or intergral type are returned via the rax
+	  register
+	- floating pointer types and __m128 values are returned via the xmm0
+	  register
+	- objects of 1, 2, 4 or 8 bytes are returned via rax. All other objects
+	  are returned via a hidden pointer in rcx, which is returned via rax.
+
+Only available in 64-bit mode. Functions that use this convention on other
+systems can be declared with __attribute__((ms_abi)).
+*/
+class x64MsFastcall: public ICallingConvention
+{
+public:
+	x64MsFastcall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment=8);
+	~x64MsFastcall();
+
+	virtual std::list<Register_t> GetRegisters();
+	virtual int GetPopSize();
+
+	virtual void* GetArgumentPtr(int iIndex, CRegisters* pRegisters);
+	virtual void ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr);
+
+	virtual void* GetReturnPtr(CRegisters* pRegisters);
+	virtual void ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr);
+
+private:
+	// True if the return value is an object that is returned via a hidden
+	// pointer in rcx
+	bool m_bReturnViaPointer;
+
+	// Location of every argument and whether the location only holds a
+	// pointer to the argument
+	std::vector<ArgumentLocation_t> m_Locations;
+	std::vector<bool> m_ByReference;
+
+	// Registers that hold arguments
+	std::list<Register_t> m_ArgumentRegisters;
+};
+
+#endif // _X64_MS_FASTCALL_H
@@ -0,0 +1,249 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "x64SystemV.h"
+#include <string.h>
+#include <algorithm>
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+static const Register_t s_IntegerRegisters[] = {RDI, RSI, RDX, RCX, R8, R9};
+static const Register_t s_FloatRegisters[] = {XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7};
+
+
+// ============================================================================
+// >> x64SystemV
+// ============================================================================
+x64SystemV::x64SystemV(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment) :
+	ICallingConvention(vecArgTypes, returnType, iAlignment)
+{
+	// Objects up to 16 bytes are returned via rax/rdx and xmm0/xmm1, all
+	// others via a hidden pointer in rdi
+	m_bReturnViaPointer = IsObjectType(m_returnType) && GetObjectSize(m_returnType) > 16;
+	m_ReturnRegisters[0] = IsVectorDataType(m_returnType) ? XMM0 : RAX;
+	m_ReturnRegisters[1] = RDX;
+	m_bSplitReturn = false;
+
+	if (IsObjectType(m_returnType) && !m_bReturnViaPointer)
+	{
+		int iIntegerCount = 0;
+		int iFloatCount = 0;
+		for(int i=0; i < GetObjectWords(m_returnType); i++)
+		{
+			if (IsFloatWord(m_returnType, i))
+				m_ReturnRegisters[i] = iFloatCount++ == 0 ? XMM0 : XMM1;
+			else
+				m_ReturnRegisters[i] = iIntegerCount++ == 0 ? RAX : RDX;
+		}
+
+		m_bSplitReturn = GetObjectWords(m_returnType) > 1;
+	}
+
+	int iIntegerCount = 0;
+	int iFloatCount = 0;
+
+	if (m_bReturnViaPointer)
+		m_ArgumentRegisters.push_back(s_IntegerRegisters[iIntegerCount++]);
+
+	bool bSplit = false;
+
+	// Skip the return address
+	int iOffset = 8;
+	for(int i=0; i < vecArgTypes.size(); i++)
+	{
+		ArgumentLocation_t location;
+		location.m_eRegister = RSP;
+		location.m_iSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+
+		m_SecondRegister.push_back(RSP);
+
+		bool bObject = IsObjectType(m_vecArgTypes[i]);
+
+		// Objects up to 16 bytes are passed via one or two registers, larger
+		// ones on the stack. Every eightbyte is passed via the next integer
+		// or xmm register, but only if enough of both are left.
+		bool bMemory = bObject && GetObjectSize(m_vecArgTypes[i]) > 16;
+		int iWords = bObject ? GetObjectWords(m_vecArgTypes[i]) : 1;
+
+		int iFloatWords = 0;
+		for(int j=0; j < iWords; j++)
+		{
+			if (IsFloatWord(m_vecArgTypes[i], j))
+				iFloatWords++;
+		}
+
+		if (!bMemory && iFloatCount + iFloatWords <= 8 && iIntegerCount + iWords - iFloatWords <= 6)
+		{
+			for(int j=0; j < iWords; j++)
+			{
+				Register_t reg = IsFloatWord(m_vecArgTypes[i], j) ? s_FloatRegisters[iFloatCount++] : s_IntegerRegisters[iIntegerCount++];
+				m_ArgumentRegisters.push_back(reg);
+
+				if (j == 0)
+				{
+					location.m_eRegister = reg;
+				}
+				else
+				{
+					m_SecondRegister[i] = reg;
+					bSplit = true;
+				}
+			}
+		}
+		else
+		{
+			// Vectors and objects on the stack keep their alignment. The
+			// return address is the only thing between rsp and the first
+			// argument.
+			if (m_vecArgTypes[i] == DATA_TYPE_M128 || (bObject && GetObjectAlignment(m_vecArgTypes[i]) > 8))
+				iOffset = 8 + Align(iOffset - 8, 16);
+
+			location.m_iOffset = iOffset;
+			iOffset += location.m_iSize;
+		}
+
+		if (location.m_eRegister != RSP)
+			location.m_iOffset = 0;
+
+		m_Locations.push_back(location);
+	}
+
+	// The table can't describe split arguments
+	if (!bSplit)
+		m_ArgumentLocations = m_Locations;
+}
+
+x64SystemV::~x64SystemV()
+{
+}
+
+int x64SystemV::GetObjectWords(DataType_t type)
+{
+	return (GetObjectSize(type) + 7) / 8;
+}
+
+bool x64SystemV::IsFloatWord(DataType_t type, int iWord)
+{
+	if (!IsObjectType(type))
+		return IsVectorDataType(type);
+
+	return (GetObjectFloatEightbytes(type) & (1 << iWord)) != 0;
+}
+
+std::list<Register_t> x64SystemV::GetRegisters()
+{
+	std::list<Register_t> registers = m_ArgumentRegisters;
+
+	registers.push_back(RSP);
+
+	// Also holds the number of vector registers used by variadic functions
+	registers.push_back(RAX);
+
+	for(int i=0; i < (m_bSplitReturn ? 2 : 1); i++)
+	{
+		if (std::find(registers.begin(), registers.end(), m_ReturnRegisters[i]) == registers.end())
+			registers.push_back(m_ReturnRegisters[i]);
+	}
+
+	return registers;
+}
+
+int x64SystemV::GetPopSize()
+{
+	return 0;
+}
+
+int x64SystemV::GetScratchSize()
+{
+	// The return value followed by every argument
+	return (int) (m_vecArgTypes.size() + 1) * 16;
+}
+
+void* x64SystemV::GetArgumentPtr(int iIndex, CRegisters* pRegisters)
+{
+	ArgumentLocation_t& location = m_Locations[iIndex];
+	if (location.m_eRegister == RSP)
+		return (void *) (pRegisters->m_rsp->GetValue<unsigned long long>() + location.m_iOffset);
+
+	if (m_SecondRegister[iIndex] != RSP)
+	{
+		// First half in the first register, second half in the other one
+		char* pValue = (char *) pRegisters->GetScratch() + (iIndex + 1) * 16;
+		memcpy(pValue, pRegisters->GetRegister(location.m_eRegister)->m_pAddress, 8);
+		memcpy(pValue + 8, pRegisters->GetRegister(m_SecondRegister[iIndex])->m_pAddress, 8);
+		return pValue;
+	}
+
+	return pRegisters->GetRegister(location.m_eRegister)->m_pAddress;
+}
+
+void x64SystemV::ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr)
+{
+	if (m_SecondRegister[iIndex] == RSP)
+		return;
+
+	memcpy(pRegisters->GetRegister(m_Locations[iIndex].m_eRegister)->m_pAddress, pArgumentPtr, 8);
+	memcpy(pRegisters->GetRegister(m_SecondRegister[iIndex])->m_pAddress, (char *) pArgumentPtr + 8, 8);
+}
+
+void* x64SystemV::GetReturnPtr(CRegisters* pRegisters)
+{
+	if (m_bReturnViaPointer)
+	{
+		// The callee returns the hidden pointer via rax
+		return pRegisters->m_rax->GetValue<void *>();
+	}
+
+	if (m_bSplitReturn)
+	{
+		// First half in the first register, second half in the other one
+		char* pValue = (char *) pRegisters->GetScratch();
+		memcpy(pValue, pRegisters->GetRegister(m_ReturnRegisters[0])->m_pAddress, 8);
+		memcpy(pValue + 8, pRegisters->GetRegister(m_ReturnRegisters[1])->m_pAddress, 8);
+		return pValue;
+	}
+
+	return pRegisters->GetRegister(m_ReturnRegisters[0])->m_pAddress;
+}
+
+void x64SystemV::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
+{
+	if (m_bSplitReturn)
+	{
+		// First half in the first register, second half in the other one
+		memcpy(pRegisters->GetRegister(m_ReturnRegisters[0])->m_pAddress, pReturnPtr, 8);
+		memcpy(pRegisters->GetRegister(m_ReturnRegisters[1])->m_pAddress, (char *) pReturnPtr + 8, 8);
+	}
+}
@@ -0,0 +1,128 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _X64_SYSTEM_V_H
+#define _X64_SYSTEM_V_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "../convention.h"
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+Source: System V AMD64 ABI
+
+Registers:
+	- rax = return value
+	- rsp = stack pointer
+	- xmm0 = floating point and vector return value
+
+Parameter passing:
+	- integral and pointer arguments are passed via rdi, rsi, rdx, rcx, r8
+	  and r9 (in that order)
+	- floating point and __m128 arguments are passed via xmm0 - xmm7 (in
+	  that order)
+	- __m128 arguments on the stack are 16 byte aligned
+	- objects up to 16 bytes are passed via one or two registers if enough
+	  of them are left. Eightbytes that only contain float or double members
+	  are passed via the next xmm register, all others via the next integer
+	  register. Larger objects are copied onto the stack.
+	- all other arguments are pushed onto the stack (right-to-left)
+	- caller cleans up the stack
+	- alignment: 8 bytes
+
+Return values:
+	- return values of pointer or intergral type are returned via the rax
+	  register
+	- floating pointer types and __m128 values are returned via the xmm0
+	  register
+	- objects up to 16 bytes are returned via rax/rdx and xmm0/xmm1 (same
+	  classification as above). Larger objects are returned via a hidden
+	  pointer in rdi, which is returned via rax.
+
+The eightbytes of small objects are classified with the FloatEightbyte_t
+values that have been passed to MakeObjectType(). Objects that contain
+__m128 or long double members are not supported.
+
+Only available in 64-bit mode.
+*/
+class x64SystemV: public ICallingConvention
+{
+public:
+	x64SystemV(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment=8);
+	~x64SystemV();
+
+	virtual std::list<Register_t> GetRegisters();
+	virtual int GetPopSize();
+	virtual int GetScratchSize();
+
+	virtual void* GetArgumentPtr(int iIndex, CRegisters* pRegisters);
+	virtual void ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr);
+
+	virtual void* GetReturnPtr(CRegisters* pRegisters);
+	virtual void ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr);
+
+private:
+	// Number of eightbytes of an object
+	static int GetObjectWords(DataType_t type);
+
+	// True if the given eightbyte of an argument or return value is passed
+	// via an xmm register
+	static bool IsFloatWord(DataType_t type, int iWord);
+
+private:
+	// True if the return value is an object that is returned via two
+	// registers. Its value is assembled in the scratch area of the frame.
+	bool m_bSplitReturn;
+
+	// Registers that hold the return value. The second one is only used if
+	// m_bSplitReturn is true.
+	Register_t m_ReturnRegisters[2];
+
+	// True if the return value is an object that is returned via a hidden
+	// pointer in rdi
+	bool m_bReturnViaPointer;
+
+	// Location of every argument. Objects that are split across two
+	// registers store the register of their second half in m_SecondRegister
+	// (RSP otherwise) and their value is assembled in the scratch area of
+	// the frame.
+	std::vector<ArgumentLocation_t> m_Locations;
+	std::vector<Register_t> m_SecondRegister;
+
+	// Registers that hold arguments
+	std::list<Register_t> m_ArgumentRegisters;
+};
+
+#endif // _X64_SYSTEM_V_H
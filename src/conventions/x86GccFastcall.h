@@ -0,0 +1,66 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _X86_GCC_FASTCALL_H
+#define _X86_GCC_FASTCALL_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "x86GccRegparm.h"
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+Source: GCC docs and i386 backend
+
+Functions declared with __attribute__((fastcall)):
+	- the first two integral or pointer arguments (<= 32 bits) are passed via
+	  the ecx and edx registers
+	- 64-bit integers and objects are always pushed onto the stack and no
+	  further registers are used
+	- callee cleans up the stack
+
+Everything else is the same as in x86GccRegparmBase.
+*/
+extern const Register_t g_FastcallRegisters[2];
+
+class x86GccFastcall: public x86GccRegparmBase
+{
+public:
+	x86GccFastcall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment=4):
+		x86GccRegparmBase(vecArgTypes, returnType, g_FastcallRegisters, 2, true, iAlignment)
+	{
+	}
+};
+
+#endif // _X86_GCC_FASTCALL_H
@@ -0,0 +1,237 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "x86GccRegparm.h"
+#include "x86GccFastcall.h"
+#include <string.h>
+#include <algorithm>
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+const Register_t g_RegparmRegisters[3] = {EAX, EDX, ECX};
+const Register_t g_FastcallRegisters[2] = {ECX, EDX};
+
+// An argument can use up to three registers
+#define MAX_SPLIT_SIZE 12
+
+// Return values use up to two registers
+#define RETURN_SIZE 8
+
+
+// ============================================================================
+// >> x86GccRegparmBase
+// ============================================================================
+x86GccRegparmBase::x86GccRegparmBase(std::vector<DataType_t> vecArgTypes, DataType_t returnType,
+	const Register_t* pRegisters, int iRegisterCount, bool bFastcall, int iAlignment) :
+	ICallingConvention(vecArgTypes, returnType, iAlignment)
+{
+	m_bReturnViaPointer = IsReturnedViaPointer(m_returnType);
+
+	m_bSplitReturn = GetDataTypeSize(m_returnType) > 4 && !m_bReturnViaPointer;
+
+	m_pRegisters = pRegisters;
+	m_iRegisterCount = iRegisterCount;
+	m_bFastcall = bFastcall;
+
+	// The hidden return pointer is passed like the first argument
+	int iNextRegister = 0;
+	if (m_bReturnViaPointer && iRegisterCount > 0)
+		m_ArgumentRegisters.push_back(pRegisters[iNextRegister++]);
+
+	bool bSplit = false;
+	int iOffset = 4;
+	if (m_bReturnViaPointer && iRegisterCount == 0)
+		iOffset += 4;
+
+	for(int i=0; i < m_vecArgTypes.size(); i++)
+	{
+		ArgumentLocation_t location;
+		location.m_eRegister = ESP;
+		location.m_iOffset = iOffset;
+		location.m_iSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+
+		m_FirstRegister.push_back(-1);
+
+		// Fastcall only uses registers for arguments with up to 32 bits that
+		// are not objects
+		bool bFloat = m_vecArgTypes[i] == DATA_TYPE_FLOAT || m_vecArgTypes[i] == DATA_TYPE_DOUBLE;
+		int iWords = location.m_iSize / 4;
+		bool bRegister = !bFloat && iNextRegister + iWords <= iRegisterCount;
+		if (bFastcall && (iWords > 1 || IsObjectType(m_vecArgTypes[i])))
+			bRegister = false;
+
+		if (bRegister)
+		{
+			location.m_eRegister = pRegisters[iNextRegister];
+			location.m_iOffset = 0;
+			for(int j=0; j < iWords; j++)
+				m_ArgumentRegisters.push_back(pRegisters[iNextRegister + j]);
+
+			if (iWords > 1)
+			{
+				m_FirstRegister[i] = iNextRegister;
+				bSplit = true;
+			}
+		}
+		else
+		{
+			iOffset += location.m_iSize;
+		}
+
+		// Integers and objects that don't fit use up the remaining registers
+		if (!bFloat)
+			iNextRegister = std::min(iNextRegister + iWords, iRegisterCount);
+
+		m_Locations.push_back(location);
+	}
+
+	m_iStackSize = iOffset - 4;
+
+	// The table can't describe split arguments
+	if (!bSplit)
+		m_ArgumentLocations = m_Locations;
+}
+
+x86GccRegparmBase::~x86GccRegparmBase()
+{
+}
+
+std::list<Register_t> x86GccRegparmBase::GetRegisters()
+{
+	std::list<Register_t> registers = m_ArgumentRegisters;
+
+	registers.push_back(ESP);
+
+	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
+	{
+		registers.push_back(ST0);
+	}
+	else
+	{
+		if (std::find(registers.begin(), registers.end(), EAX) == registers.end())
+			registers.push_back(EAX);
+
+		if (m_bSplitReturn && std::find(registers.begin(), registers.end(), EDX) == registers.end())
+			registers.push_back(EDX);
+	}
+
+	return registers;
+}
+
+int x86GccRegparmBase::GetPopSize()
+{
+	if (m_bFastcall)
+		return m_iStackSize;
+
+	// Without registers, the callee removes the hidden return pointer like
+	// in cdecl
+	if (m_bReturnViaPointer && m_iRegisterCount == 0)
+		return 4;
+
+	return 0;
+}
+
+int x86GccRegparmBase::GetScratchSize()
+{
+	// The return value followed by every argument
+	return RETURN_SIZE + (int) m_vecArgTypes.size() * MAX_SPLIT_SIZE;
+}
+
+void* x86GccRegparmBase::GetArgumentPtr(int iIndex, CRegisters* pRegisters)
+{
+	ArgumentLocation_t& location = m_Locations[iIndex];
+	if (location.m_eRegister == ESP)
+		return (void *) (pRegisters->m_esp->GetValue<unsigned long>() + location.m_iOffset);
+
+	int iFirstRegister = m_FirstRegister[iIndex];
+	if (iFirstRegister != -1)
+	{
+		// Assemble the value from the consecutive registers
+		char* pValue = (char *) pRegisters->GetScratch() + RETURN_SIZE + iIndex * MAX_SPLIT_SIZE;
+		for(int i=0; i < location.m_iSize / 4; i++)
+			memcpy(pValue + i * 4, pRegisters->GetRegister(m_pRegisters[iFirstRegister + i])->m_pAddress, 4);
+
+		return pValue;
+	}
+
+	return pRegisters->GetRegister(location.m_eRegister)->m_pAddress;
+}
+
+void x86GccRegparmBase::ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr)
+{
+	int iFirstRegister = m_FirstRegister[iIndex];
+	if (iFirstRegister == -1)
+		return;
+
+	ArgumentLocation_t& location = m_Locations[iIndex];
+	for(int i=0; i < location.m_iSize / 4; i++)
+		memcpy(pRegisters->GetRegister(m_pRegisters[iFirstRegister + i])->m_pAddress, (char *) pArgumentPtr + i * 4, 4);
+}
+
+void* x86GccRegparmBase::GetReturnPtr(CRegisters* pRegisters)
+{
+	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
+		return pRegisters->m_st0->m_pAddress;
+
+	if (m_bReturnViaPointer)
+	{
+		// The callee returns the hidden pointer via eax
+		return pRegisters->m_eax->GetValue<void *>();
+	}
+
+	if (m_bSplitReturn)
+	{
+		// First half in eax, second half in edx
+		char* pValue = (char *) pRegisters->GetScratch();
+		memcpy(pValue, pRegisters->m_eax->m_pAddress, 4);
+		memcpy(pValue + 4, pRegisters->m_edx->m_pAddress, 4);
+		return pValue;
+	}
+
+	return pRegisters->m_eax->m_pAddress;
+}
+
+void x86GccRegparmBase::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
+{
+	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE || m_bReturnViaPointer)
+		return;
+
+	if (m_bSplitReturn)
+	{
+		// First half in eax, second half in edx
+		memcpy(pRegisters->m_eax->m_pAddress, pReturnPtr, 4);
+		memcpy(pRegisters->m_edx->m_pAddress, (char *) pReturnPtr + 4, 4);
+	}
+}
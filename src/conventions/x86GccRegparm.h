@@ -0,0 +1,139 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _X86_GCC_REGPARM_H
+#define _X86_GCC_REGPARM_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "../convention.h"
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+Source: GCC docs and i386 backend
+
+Registers:
+	- eax = parameter, return value
+	- edx = parameter, return value
+	- ecx = parameter
+	- esp = stack pointer
+	- st0 = floating point return value
+
+Parameter passing:
+	- integral and pointer arguments are passed via the given registers (in
+	  that order) until they run out
+	- 64-bit integers and objects are passed via as many registers as they
+	  need. If they don't fit, they are pushed onto the stack and no further
+	  registers are used.
+	- floating point arguments are always pushed onto the stack
+	- stack parameter order: right-to-left
+	- alignment: 4 bytes
+
+Return values:
+	- return values of pointer or intergral type (<= 32 bits) are returned via the eax register
+	- integers > 32 bits are returned via the eax and edx registers
+	- floating pointer types are returned via the st0 register
+	- objects are returned via a hidden pointer, which is passed like an
+	  additional first argument. The hidden pointer is returned via eax.
+
+This is the base class of x86GccRegparm<N> and x86GccFastcall.
+*/
+class x86GccRegparmBase: public ICallingConvention
+{
+public:
+	x86GccRegparmBase(std::vector<DataType_t> vecArgTypes, DataType_t returnType,
+		const Register_t* pRegisters, int iRegisterCount, bool bFastcall, int iAlignment=4);
+	~x86GccRegparmBase();
+
+	virtual std::list<Register_t> GetRegisters();
+	virtual int GetPopSize();
+	virtual int GetScratchSize();
+
+	virtual void* GetArgumentPtr(int iIndex, CRegisters* pRegisters);
+	virtual void ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr);
+
+	virtual void* GetReturnPtr(CRegisters* pRegisters);
+	virtual void ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr);
+
+private:
+	// True if the return value is returned via eax and edx. Its value is
+	// assembled in the scratch area of the frame.
+	bool m_bSplitReturn;
+
+	// Registers that can be used for arguments
+	const Register_t* m_pRegisters;
+	int m_iRegisterCount;
+
+	// True if the callee cleans up the stack
+	bool m_bFastcall;
+
+	// True if the return value is an object that is returned via a hidden
+	// pointer
+	bool m_bReturnViaPointer;
+
+	// Size of all arguments on the stack
+	int m_iStackSize;
+
+	// Location of every argument. Arguments that are split across multiple
+	// registers store the index of their first register in m_FirstRegister
+	// (-1 otherwise) and their value is assembled in the scratch area of the
+	// frame.
+	std::vector<ArgumentLocation_t> m_Locations;
+	std::vector<int> m_FirstRegister;
+
+	// Registers that hold arguments
+	std::list<Register_t> m_ArgumentRegisters;
+};
+
+
+/*
+Functions declared with __attribute__((regparm(N))). The first N registers
+of eax, edx and ecx are used for arguments and the caller cleans up the stack.
+*/
+extern const Register_t g_RegparmRegisters[3];
+
+template<int N>
+class x86GccRegparm: public x86GccRegparmBase
+{
+	// GCC only supports regparm(0) to regparm(3)
+	static_assert(N >= 0 && N <= 3, "regparm only supports 0 to 3 registers");
+
+public:
+	x86GccRegparm(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment=4):
+		x86GccRegparmBase(vecArgTypes, returnType, g_RegparmRegisters, N, false, iAlignment)
+	{
+	}
+};
+
+#endif // _X86_GCC_REGPARM_H
@@ -41,8 +41,10 @@
 x86MsCdecl::x86MsCdecl(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment) : 
 	ICallingConvention(vecArgTypes, returnType, iAlignment)
 {
+	m_bReturnViaPointer = IsReturnedViaPointer(m_returnType);
+
 	int iSize = GetDataTypeSize(m_returnType);
-	if (iSize > 4)
+	if (iSize > 4 && !m_bReturnViaPointer)
 	{
 		m_pReturnBuffer = malloc(iSize);
 	}
@@ -53,10 +55,17 @@ x86MsCdecl::x86MsCdecl(std::vector<DataType_t> vecArgTypes, DataType_t returnTyp
 
 	m_pOffsets = new int[vecArgTypes.size()];
 	int iOffset = 4;
+
+	// Skip the hidden return pointer
+	if (m_bReturnViaPointer)
+		iOffset += 4;
+
 	for(int i=0; i < vecArgTypes.size(); i++)
 	{
+		int iArgSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
 		m_pOffsets[i] = iOffset;
-		iOffset += GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+		AddArgumentLocation(ESP, iOffset, iArgSize);
+		iOffset += iArgSize;
 	}
 
 }
@@ -95,6 +104,12 @@ std::list<Register_t> x86MsCdecl::GetRegisters()
 
 int x86MsCdecl::GetPopSize()
 {
+#ifndef _WIN32
+	// GCC's callee removes the hidden return pointer
+	if (m_bReturnViaPointer)
+		return 4;
+#endif
+
 	return 0;
 }
 
@@ -112,11 +127,17 @@ void* x86MsCdecl::GetReturnPtr(CRegisters* pRegisters)
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 		return pRegisters->m_st0->m_pAddress;
 
+	if (m_bReturnViaPointer)
+	{
+		// The object is constructed in place
+		return pRegisters->m_esp->GetPointerValue<void *>(4);
+	}
+
 	if (m_pReturnBuffer)
 	{
 		// First half in eax, second half in edx
-		memcpy(m_pReturnBuffer, pRegisters->m_eax, 4);
-		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx, 4);
+		memcpy(m_pReturnBuffer, pRegisters->m_eax->m_pAddress, 4);
+		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx->m_pAddress, 4);
 		return m_pReturnBuffer;
 	}
 
@@ -128,10 +149,17 @@ void x86MsCdecl::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 		return;
 
+	if (m_bReturnViaPointer)
+	{
+		// The caller expects the hidden pointer in eax
+		pRegisters->m_eax->SetValue<void *>(pReturnPtr);
+		return;
+	}
+
 	if (m_pReturnBuffer)
 	{
 		// First half in eax, second half in edx
-		memcpy(pRegisters->m_eax, m_pReturnBuffer, 4);
-		memcpy(pRegisters->m_edx, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
+		memcpy(pRegisters->m_eax->m_pAddress, m_pReturnBuffer, 4);
+		memcpy(pRegisters->m_edx->m_pAddress, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
 	}
 }
\ No newline at end of file
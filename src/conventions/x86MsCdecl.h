@@ -59,6 +59,9 @@ Return values:
 	- return values of pointer or intergral type (<= 32 bits) are returned via the eax register
 	- integers > 32 bits are returned via the eax and edx registers
 	- floating pointer types are returned via the st0 register
+	- objects are returned via eax and edx or via a hidden pointer that is
+	  pushed after all other arguments (see IsReturnedViaPointer()). The
+	  hidden pointer is returned via eax.
 */
 class x86MsCdecl: public ICallingConvention
 {	
@@ -78,6 +81,10 @@ public:
 private:
 	void* m_pReturnBuffer;
 	int* m_pOffsets;
+
+	// True if the return value is an object that is returned via a hidden
+	// pointer on the stack
+	bool m_bReturnViaPointer;
 };
 
 #endif // _X86_MS_CDECL_H
\ No newline at end of file
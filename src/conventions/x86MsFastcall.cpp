@@ -33,6 +33,13 @@
 // ============================================================================
 #include "x86MsFastcall.h"
 #include <string.h>
+#include <algorithm>
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+static const Register_t s_Registers[] = {ECX, EDX};
 
 
 // ============================================================================
@@ -41,8 +48,10 @@
 x86MsFastcall::x86MsFastcall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment) : 
 	ICallingConvention(vecArgTypes, returnType, iAlignment)
 {
+	m_bReturnViaPointer = IsReturnedViaPointer(m_returnType);
+
 	int iSize = GetDataTypeSize(m_returnType);
-	if (iSize > 4)
+	if (iSize > 4 && !m_bReturnViaPointer)
 	{
 		m_pReturnBuffer = malloc(iSize);
 	}
@@ -51,13 +60,31 @@ x86MsFastcall::x86MsFastcall(std::vector<DataType_t> vecArgTypes, DataType_t ret
 		m_pReturnBuffer = NULL;
 	}
 
-	m_pOffsets = new int[m_vecArgTypes.size()];
+	// The hidden return pointer is passed in ecx
+	int iRegisterCount = 0;
+	if (m_bReturnViaPointer)
+		m_ArgumentRegisters.push_back(s_Registers[iRegisterCount++]);
+
 	int iOffset = 4;
-	for(int i=2; i < m_vecArgTypes.size(); i++)
+	for(int i=0; i < m_vecArgTypes.size(); i++)
 	{
-		m_pOffsets[i] = iOffset;
-		iOffset += GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+		int iArgSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+
+		// The first two integral or pointer arguments (<= 32 bits) are
+		// passed in ecx and edx
+		bool bInteger = !IsObjectType(m_vecArgTypes[i]) && !IsVectorDataType(m_vecArgTypes[i]);
+		if (bInteger && iArgSize <= 4 && iRegisterCount < 2)
+		{
+			m_ArgumentRegisters.push_back(s_Registers[iRegisterCount]);
+			AddArgumentLocation(s_Registers[iRegisterCount++], 0, iArgSize);
+			continue;
+		}
+
+		AddArgumentLocation(ESP, iOffset, iArgSize);
+		iOffset += iArgSize;
 	}
+
+	m_iStackSize = iOffset - 4;
 }
 
 x86MsFastcall::~x86MsFastcall()
@@ -66,28 +93,14 @@ x86MsFastcall::~x86MsFastcall()
 	{
 		free(m_pReturnBuffer);
 	}
-
-	delete[] m_pOffsets;
 }
 
 std::list<Register_t> x86MsFastcall::GetRegisters()
 {
-	std::list<Register_t> registers;
+	std::list<Register_t> registers = m_ArgumentRegisters;
 	
 	registers.push_back(ESP);
 
-	int iArgSize = m_vecArgTypes.size();
-
-	if (iArgSize > 0)
-	{
-		registers.push_back(ECX);
-	}
-
-	if (iArgSize > 1)
-	{
-		registers.push_back(EDX);
-	}
-
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 	{
 		registers.push_back(ST0);
@@ -95,7 +108,7 @@ std::list<Register_t> x86MsFastcall::GetRegisters()
 	else
 	{
 		registers.push_back(EAX);
-		if (m_pReturnBuffer && iArgSize <= 1)
+		if (m_pReturnBuffer && std::find(registers.begin(), registers.end(), EDX) == registers.end())
 		{
 			registers.push_back(EDX);
 		}
@@ -106,29 +119,16 @@ std::list<Register_t> x86MsFastcall::GetRegisters()
 
 int x86MsFastcall::GetPopSize()
 {
-	int iPopSize = 0;
-
-	for(unsigned int i=2; i < m_vecArgTypes.size(); i++)
-	{
-		iPopSize += GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
-	}
-
-	return iPopSize;
+	return m_iStackSize;
 }
 
 void* x86MsFastcall::GetArgumentPtr(int iIndex, CRegisters* pRegisters)
 {
-	if (iIndex == 0)
-	{
-		return pRegisters->m_ecx->m_pAddress;
-	}
+	ArgumentLocation_t& location = m_ArgumentLocations[iIndex];
+	if (location.m_eRegister == ESP)
+		return (void *) (pRegisters->m_esp->GetValue<unsigned long>() + location.m_iOffset);
 
-	if (iIndex == 1)
-	{
-		return pRegisters->m_edx->m_pAddress;
-	}
-
-	return (void *) (pRegisters->m_esp->GetValue<unsigned long>() + m_pOffsets[iIndex]);
+	return pRegisters->GetRegister(location.m_eRegister)->m_pAddress;
 }
 
 void x86MsFastcall::ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr)
@@ -140,11 +140,18 @@ void* x86MsFastcall::GetReturnPtr(CRegisters* pRegisters)
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 		return pRegisters->m_st0->m_pAddress;
 
+	if (m_bReturnViaPointer)
+	{
+		// ecx is gone at this point, but the callee returns the hidden
+		// pointer via eax
+		return pRegisters->m_eax->GetValue<void *>();
+	}
+
 	if (m_pReturnBuffer)
 	{
 		// First half in eax, second half in edx
-		memcpy(m_pReturnBuffer, pRegisters->m_eax, 4);
-		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx, 4);
+		memcpy(m_pReturnBuffer, pRegisters->m_eax->m_pAddress, 4);
+		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx->m_pAddress, 4);
 		return m_pReturnBuffer;
 	}
 
@@ -156,10 +163,13 @@ void x86MsFastcall::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 		return;
 
+	if (m_bReturnViaPointer)
+		return;
+
 	if (m_pReturnBuffer)
 	{
 		// First half in eax, second half in edx
-		memcpy(pRegisters->m_eax, m_pReturnBuffer, 4);
-		memcpy(pRegisters->m_edx, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
+		memcpy(pRegisters->m_eax->m_pAddress, m_pReturnBuffer, 4);
+		memcpy(pRegisters->m_edx->m_pAddress, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
 	}
 }
\ No newline at end of file
@@ -45,12 +45,14 @@ Source: DynCall manual and Windows docs
 
 Registers:
 	- eax = return value
-	- ecx = parameter 0
-	- edx = parameter 1, return value
+	- ecx = first integer parameter
+	- edx = second integer parameter, return value
 	- esp = stack pointer
 	- st0 = floating point return value
 
 Parameter passing:
+	- the first two integral or pointer arguments (<= 32 bits) are passed via
+	  ecx and edx, scanning the parameters from left to right
 	- stack parameter order: right-to-left
 	- callee cleans up the stack
 	- all other arguments are pushed onto the stack
@@ -60,6 +62,8 @@ Return values:
 	- return values of pointer or intergral type (<= 32 bits) are returned via the eax register
 	- integers > 32 bits are returned via the eax and edx registers
 	- floating pointer types are returned via the st0 register
+	- objects are returned via eax and edx or via a hidden pointer in ecx
+	  (see IsReturnedViaPointer()). The hidden pointer is returned via eax.
 */
 class x86MsFastcall: public ICallingConvention
 {	
@@ -78,7 +82,16 @@ public:
 
 private:
 	void* m_pReturnBuffer;
-	int* m_pOffsets;
+
+	// True if the return value is an object that is returned via a hidden
+	// pointer in ecx
+	bool m_bReturnViaPointer;
+
+	// Size of all arguments on the stack
+	int m_iStackSize;
+
+	// Registers that hold arguments
+	std::list<Register_t> m_ArgumentRegisters;
 };
 
 #endif // _X86_MS_FASTCALL_H
\ No newline at end of file
@@ -41,8 +41,10 @@
 x86MsThiscall::x86MsThiscall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment) : 
 	ICallingConvention(vecArgTypes, returnType, iAlignment)
 {
+	m_bReturnViaPointer = IsReturnedViaPointer(m_returnType);
+
 	int iSize = GetDataTypeSize(m_returnType);
-	if (iSize > 4)
+	if (iSize > 4 && !m_bReturnViaPointer)
 	{
 		m_pReturnBuffer = malloc(iSize);
 	}
@@ -53,10 +55,24 @@ x86MsThiscall::x86MsThiscall(std::vector<DataType_t> vecArgTypes, DataType_t ret
 
 	m_pOffsets = new int[m_vecArgTypes.size()];
 	int iOffset = 4;
-	for(int i=1; i < m_vecArgTypes.size(); i++)
+
+	// Skip the hidden return pointer
+	if (m_bReturnViaPointer)
+		iOffset += 4;
+
+	for(int i=0; i < m_vecArgTypes.size(); i++)
 	{
+		int iArgSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+		if (i == 0)
+		{
+			// this pointer
+			AddArgumentLocation(ECX, 0, iArgSize);
+			continue;
+		}
+
 		m_pOffsets[i] = iOffset;
-		iOffset += GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+		AddArgumentLocation(ESP, iOffset, iArgSize);
+		iOffset += iArgSize;
 	}
 }
 
@@ -102,6 +118,10 @@ int x86MsThiscall::GetPopSize()
 		iPopSize += GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
 	}
 
+	// Hidden return pointer
+	if (m_bReturnViaPointer)
+		iPopSize += 4;
+
 	return iPopSize;
 }
 
@@ -124,11 +144,17 @@ void* x86MsThiscall::GetReturnPtr(CRegisters* pRegisters)
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 		return pRegisters->m_st0->m_pAddress;
 
+	if (m_bReturnViaPointer)
+	{
+		// The object is constructed in place
+		return pRegisters->m_esp->GetPointerValue<void *>(4);
+	}
+
 	if (m_pReturnBuffer)
 	{
 		// First half in eax, second half in edx
-		memcpy(m_pReturnBuffer, pRegisters->m_eax, 4);
-		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx, 4);
+		memcpy(m_pReturnBuffer, pRegisters->m_eax->m_pAddress, 4);
+		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx->m_pAddress, 4);
 		return m_pReturnBuffer;
 	}
 
@@ -140,10 +166,17 @@ void x86MsThiscall::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
 	if (m_returnType == DATA_TYPE_FLOAT || m_returnType == DATA_TYPE_DOUBLE)
 		return;
 
+	if (m_bReturnViaPointer)
+	{
+		// The caller expects the hidden pointer in eax
+		pRegisters->m_eax->SetValue<void *>(pReturnPtr);
+		return;
+	}
+
 	if (m_pReturnBuffer)
 	{
 		// First half in eax, second half in edx
-		memcpy(pRegisters->m_eax, m_pReturnBuffer, 4);
-		memcpy(pRegisters->m_edx, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
+		memcpy(pRegisters->m_eax->m_pAddress, m_pReturnBuffer, 4);
+		memcpy(pRegisters->m_edx->m_pAddress, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,179 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "x86MsVectorcall.h"
+#include <string.h>
+#include <algorithm>
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+static const Register_t s_IntegerRegisters[] = {ECX, EDX};
+static const Register_t s_VectorRegisters[] = {XMM0, XMM1, XMM2, XMM3, XMM4, XMM5};
+
+
+// ============================================================================
+// >> x86MsVectorcall
+// ============================================================================
+x86MsVectorcall::x86MsVectorcall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment) :
+	ICallingConvention(vecArgTypes, returnType, iAlignment)
+{
+	m_bReturnViaPointer = IsReturnedViaPointer(m_returnType);
+
+	int iSize = GetDataTypeSize(m_returnType);
+	if (iSize > 4 && !IsVectorDataType(m_returnType) && !m_bReturnViaPointer)
+	{
+		m_pReturnBuffer = malloc(iSize);
+	}
+	else
+	{
+		m_pReturnBuffer = NULL;
+	}
+
+	int iIntegerCount = 0;
+	int iVectorCount = 0;
+
+	// The hidden return pointer is passed in ecx
+	if (m_bReturnViaPointer)
+		m_ArgumentRegisters.push_back(s_IntegerRegisters[iIntegerCount++]);
+
+	int iOffset = 4;
+	for(int i=0; i < m_vecArgTypes.size(); i++)
+	{
+		int iArgSize = GetDataTypeSize(m_vecArgTypes[i], m_iAlignment);
+		if (IsVectorDataType(m_vecArgTypes[i]))
+		{
+			if (iVectorCount < 6)
+			{
+				m_ArgumentRegisters.push_back(s_VectorRegisters[iVectorCount]);
+				AddArgumentLocation(s_VectorRegisters[iVectorCount++], 0, iArgSize);
+				continue;
+			}
+		}
+		else if (!IsObjectType(m_vecArgTypes[i]) && iArgSize <= 4 && iIntegerCount < 2)
+		{
+			m_ArgumentRegisters.push_back(s_IntegerRegisters[iIntegerCount]);
+			AddArgumentLocation(s_IntegerRegisters[iIntegerCount++], 0, iArgSize);
+			continue;
+		}
+
+		AddArgumentLocation(ESP, iOffset, iArgSize);
+		iOffset += iArgSize;
+	}
+
+	m_iStackSize = iOffset - 4;
+}
+
+x86MsVectorcall::~x86MsVectorcall()
+{
+	if (m_pReturnBuffer)
+	{
+		free(m_pReturnBuffer);
+	}
+}
+
+std::list<Register_t> x86MsVectorcall::GetRegisters()
+{
+	std::list<Register_t> registers = m_ArgumentRegisters;
+
+	registers.push_back(ESP);
+
+	if (IsVectorDataType(m_returnType))
+	{
+		if (std::find(registers.begin(), registers.end(), XMM0) == registers.end())
+			registers.push_back(XMM0);
+	}
+	else
+	{
+		registers.push_back(EAX);
+		if (m_pReturnBuffer && std::find(registers.begin(), registers.end(), EDX) == registers.end())
+			registers.push_back(EDX);
+	}
+
+	return registers;
+}
+
+int x86MsVectorcall::GetPopSize()
+{
+	return m_iStackSize;
+}
+
+void* x86MsVectorcall::GetArgumentPtr(int iIndex, CRegisters* pRegisters)
+{
+	ArgumentLocation_t& location = m_ArgumentLocations[iIndex];
+	if (location.m_eRegister == ESP)
+		return (void *) (pRegisters->m_esp->GetValue<unsigned long>() + location.m_iOffset);
+
+	return pRegisters->GetRegister(location.m_eRegister)->m_pAddress;
+}
+
+void x86MsVectorcall::ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr)
+{
+}
+
+void* x86MsVectorcall::GetReturnPtr(CRegisters* pRegisters)
+{
+	if (IsVectorDataType(m_returnType))
+		return pRegisters->m_xmm0->m_pAddress;
+
+	if (m_bReturnViaPointer)
+	{
+		// ecx is gone at this point, but the callee returns the hidden
+		// pointer via eax
+		return pRegisters->m_eax->GetValue<void *>();
+	}
+
+	if (m_pReturnBuffer)
+	{
+		// First half in eax, second half in edx
+		memcpy(m_pReturnBuffer, pRegisters->m_eax->m_pAddress, 4);
+		memcpy((void *) ((unsigned long) m_pReturnBuffer + 4), pRegisters->m_edx->m_pAddress, 4);
+		return m_pReturnBuffer;
+	}
+
+	return pRegisters->m_eax->m_pAddress;
+}
+
+void x86MsVectorcall::ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr)
+{
+	if (IsVectorDataType(m_returnType) || m_bReturnViaPointer)
+		return;
+
+	if (m_pReturnBuffer)
+	{
+		// First half in eax, second half in edx
+		memcpy(pRegisters->m_eax->m_pAddress, m_pReturnBuffer, 4);
+		memcpy(pRegisters->m_edx->m_pAddress, (void *) ((unsigned long) m_pReturnBuffer + 4), 4);
+	}
+}
@@ -0,0 +1,101 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _X86_MS_VECTORCALL_H
+#define _X86_MS_VECTORCALL_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "../convention.h"
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+Source: Windows docs (__vectorcall)
+
+Registers:
+	- eax = return value
+	- ecx = first integer parameter
+	- edx = second integer parameter, return value
+	- xmm0 - xmm5 = first six vector parameters
+	- esp = stack pointer
+	- xmm0 = floating point and vector return value
+
+Parameter passing:
+	- the first two integral or pointer arguments (<= 32 bits) are passed via
+	  ecx and edx, scanning the parameters from left to right
+	- the first six float, double or __m128 arguments are passed via xmm0 -
+	  xmm5, also from left to right
+	- all other arguments are pushed onto the stack (right-to-left)
+	- callee cleans up the stack
+	- alignment: 4 bytes
+
+Return values:
+	- return values of pointer or intergral type (<= 32 bits) are returned via the eax register
+	- integers > 32 bits are returned via the eax and edx registers
+	- float, double and __m128 values are returned via the xmm0 register
+	- objects are returned via eax and edx or via a hidden pointer in ecx
+	  (see IsReturnedViaPointer()). The hidden pointer is returned via eax.
+
+Homogeneous vector aggregates are not supported.
+*/
+class x86MsVectorcall: public ICallingConvention
+{
+public:
+	x86MsVectorcall(std::vector<DataType_t> vecArgTypes, DataType_t returnType, int iAlignment=4);
+	~x86MsVectorcall();
+
+	virtual std::list<Register_t> GetRegisters();
+	virtual int GetPopSize();
+
+	virtual void* GetArgumentPtr(int iIndex, CRegisters* pRegisters);
+	virtual void ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr);
+
+	virtual void* GetReturnPtr(CRegisters* pRegisters);
+	virtual void ReturnPtrChanged(CRegisters* pRegisters, void* pReturnPtr);
+
+private:
+	void* m_pReturnBuffer;
+
+	// True if the return value is an object that is returned via a hidden
+	// pointer in ecx
+	bool m_bReturnViaPointer;
+
+	// Size of all arguments on the stack
+	int m_iStackSize;
+
+	// Registers that hold arguments
+	std::list<Register_t> m_ArgumentRegisters;
+};
+
+#endif // _X86_MS_VECTORCALL_H
@@ -31,7 +31,14 @@
 // ============================================================================
 // >> INCLUDES
 // ============================================================================
+#include <stddef.h>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
 #include "hook.h"
+#include "thread.h"
+#include "arena.h"
 #include "utilities.h"
 #include "asm.h"
 
@@ -45,44 +52,112 @@ using namespace asmjit::x86;
 // ============================================================================
 #define JMP_SIZE 6
 
+#ifdef DYNAMICHOOKS_X64
+	// Size of "jmp [rip]" followed by the absolute address
+	#define RELAY_SIZE 14
+#else
+	#define RELAY_SIZE 0
+#endif
+
 
 // ============================================================================
 // >> CHook
 // ============================================================================
-CHook::CHook(void* pFunc, ICallingConvention* pConvention)
+CHook::CHook(void* pFunc, ICallingConvention* pConvention, RegisterMode_t eRegisterMode, CCodeArena* pCodeArena, CPatchTransaction* pTransaction)
 {
+	m_pCodeArena = pCodeArena;
 	m_pFunc = pFunc;
-	m_pRegistersPre = new CRegisters(pConvention->GetRegisters());
-	m_pRegistersPost = new CRegisters(pConvention->GetRegisters());
+	m_pRegistersPre = new CRegisters(pConvention->GetRegisters(), NULL, pConvention->GetScratchSize());
+	m_pRegistersPost = new CRegisters(pConvention->GetRegisters(), NULL, pConvention->GetScratchSize());
+	m_pSharedRegisters = m_pRegistersPost;
 	m_pCallingConvention = pConvention;
+	m_pArgumentLocations = NULL;
+	if (pConvention->m_ArgumentLocations.size() == pConvention->m_vecArgTypes.size() && !pConvention->m_ArgumentLocations.empty())
+		m_pArgumentLocations = &pConvention->m_ArgumentLocations[0];
+
+	m_eRegisterMode = eRegisterMode;
+	m_pRelay = NULL;
+	m_pEntry = NULL;
+	m_pNewRetAddr = NULL;
+	m_pExitToFunction = NULL;
+	m_pExitToCaller = NULL;
+	m_pExitFromPost = NULL;
+	m_iThreadSlot = AllocThreadSlot();
+	m_pPrevHook = NULL;
+	m_pNextHook = NULL;
+	m_pCallbacks[HOOKTYPE_PRE] = NULL;
+	m_pCallbacks[HOOKTYPE_POST] = NULL;
+	m_pBridge = NULL;
+	m_pPostCallback = NULL;
+	m_eSampleMode = SAMPLEMODE_NONE;
+	m_iSampleInterval = 1;
+	m_fSampleRate = 1;
+	m_bStats = false;
+	m_bValid = false;
+	m_bEnabled = false;
+	m_pTrampoline = NULL;
 
 	unsigned char* pTarget = (unsigned char *) pFunc;
 
 	// Determine the number of bytes we need to copy
 	int iBytesToCopy = copy_bytes(pTarget, NULL, JMP_SIZE);
 
-	// Create an array for the bytes to copy + a jump to the rest of the
-	// function.
-	unsigned char* pCopiedBytes = new unsigned char[iBytesToCopy + JMP_SIZE];
+	// Allocate a slot for the bytes to copy + a jump to the rest of the
+	// function + the relay. It has to be written through another address.
+	unsigned char* pWritable;
+	unsigned char* pCopiedBytes = m_pCodeArena->AllocTrampoline(pFunc, iBytesToCopy + JMP_SIZE + RELAY_SIZE, &pWritable);
+	if (!pCopiedBytes)
+		return;
 
-	// Fill the array with NOP instructions
-	memset(pCopiedBytes, 0x90, iBytesToCopy + JMP_SIZE);
+	// Fill the slot with NOP instructions
+	memset(pWritable, 0x90, iBytesToCopy + JMP_SIZE + RELAY_SIZE);
 
-	// Copy the required bytes to our array
-	SetMemPatchable(pCopiedBytes, iBytesToCopy + JMP_SIZE);
-	copy_bytes(pTarget, pCopiedBytes, JMP_SIZE);
+	// Copy the required bytes to our slot
+	copy_bytes_ex(pTarget, pWritable, pCopiedBytes, JMP_SIZE);
 
-	// Write a jump after the copied bytes to the function/bridge + number of bytes to copy
-	WriteJMP(pCopiedBytes + iBytesToCopy, pTarget + iBytesToCopy);
+	// Write a jump after the copied bytes to the function/bridge + number of
+	// bytes to copy. The destination is shifted like the source, so the
+	// offset is calculated for the executable address.
+	inject_jmp(pWritable + iBytesToCopy, pTarget + iBytesToCopy + (pWritable - pCopiedBytes));
 
-	// Save the trampoline
+	// Save the trampoline and the original bytes
 	m_pTrampoline = (void *) pCopiedBytes;
+	m_OriginalBytes.assign(pTarget, pTarget + iBytesToCopy);
 
-	// Create the bridge function
-	CreateBridge();
+	// Create the entry and the new return address, which jump to the current
+	// bridge and post-hook code. Then create the bridge function.
+	if (!CreateEntries() || !CreateBridge())
+	{
+		ReleaseCode();
+		return;
+	}
 
-	// Write a jump to the bridge
-	WriteJMP((unsigned char *) pFunc, m_pBridge);
+#ifdef DYNAMICHOOKS_X64
+	// The slot is located near the function, so it can reach the relay with
+	// a relative jump. The relay jumps to the absolute address of the entry.
+	unsigned char* pRelay = pWritable + iBytesToCopy + JMP_SIZE;
+	pRelay[0] = 0xFF;
+	pRelay[1] = 0x25;
+	memset(pRelay + 2, 0, 4);
+	memcpy(pRelay + 6, &m_pEntry, sizeof(m_pEntry));
+	m_pRelay = pCopiedBytes + iBytesToCopy + JMP_SIZE;
+#else
+	m_pRelay = m_pEntry;
+#endif
+
+	// Write a jump to the relay, unless it's part of a batch
+	if (pTransaction)
+	{
+		pTransaction->AddJMP(pFunc, m_pRelay);
+	}
+	else if (!WriteJMP((unsigned char *) pFunc, m_pRelay))
+	{
+		ReleaseCode();
+		return;
+	}
+
+	m_bValid = true;
+	m_bEnabled = true;
 
 	// Flag the convention as hooked and being taken care of
 	m_pCallingConvention->m_bHooked = true;
@@ -90,427 +165,1359 @@ CHook::CHook(void* pFunc, ICallingConvention* pConvention)
 
 CHook::~CHook()
 {
-	// Copy back the previously copied bytes
-	copy_bytes((unsigned char *) m_pTrampoline, (unsigned char *) m_pFunc, JMP_SIZE);
+	// Copy back the original bytes
+	SetEnabled(false);
+
+	// Free the trampoline slot and all generated code
+	ReleaseCode();
+	ReleaseRetiredCode(true);
 
-	// Free the trampoline array
-	free(m_pTrampoline);
+	free(m_pCallbacks[HOOKTYPE_PRE]);
+	free(m_pCallbacks[HOOKTYPE_POST]);
 
-	// Free the asm bridge and new return address
-	m_asmjit_rt.release(m_pBridge);
-	m_asmjit_rt.release(m_pNewRetAddr);
+	// Delete the registers of all threads
+	FreeThreadSlot(m_iThreadSlot);
 	
 	delete m_pRegistersPre;
 	delete m_pRegistersPost;
 	delete m_pCallingConvention;
 }
 
+void CHook::ReleaseCode()
+{
+	m_pCodeArena->FreeTrampoline(m_pTrampoline);
+	m_pCodeArena->Release(m_pEntry);
+	m_pCodeArena->Release(m_pNewRetAddr);
+	m_pCodeArena->Release(m_pExitToFunction);
+	m_pCodeArena->Release(m_pExitToCaller);
+	m_pCodeArena->Release(m_pExitFromPost);
+	m_pCodeArena->Release(m_pBridge.load());
+	m_pCodeArena->Release(m_pPostCallback.load());
+
+	m_pTrampoline = NULL;
+	m_pEntry = NULL;
+	m_pNewRetAddr = NULL;
+	m_pExitToFunction = NULL;
+	m_pExitToCaller = NULL;
+	m_pExitFromPost = NULL;
+	m_pBridge = NULL;
+	m_pPostCallback = NULL;
+}
+
+bool CHook::IsValid()
+{
+	return m_bValid;
+}
+
+bool CHook::SetEnabled(bool bEnabled)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!m_bValid)
+		return false;
+
+	if (m_bEnabled == bEnabled)
+		return true;
+
+	// Threads that run into the patch execute the trampoline or the entry
+	CPatchTransaction transaction;
+	if (bEnabled)
+		transaction.AddJMP(m_pFunc, m_pRelay);
+	else
+		transaction.AddWrite(m_pFunc, &m_OriginalBytes[0], (int) m_OriginalBytes.size(), m_pTrampoline);
+
+	if (!transaction.Commit())
+		return false;
+
+	m_bEnabled = bEnabled;
+	return true;
+}
+
+bool CHook::IsEnabled()
+{
+	return m_bEnabled;
+}
+
+void CHook::SetSampleInterval(int iInterval)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_eSampleMode = iInterval > 1 ? SAMPLEMODE_INTERVAL : SAMPLEMODE_NONE;
+	m_iSampleInterval = iInterval > 1 ? iInterval : 1;
+	UpdateBridge(NULL);
+}
+
+void CHook::SetSampleRate(double fRate)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_eSampleMode = fRate < 1 ? SAMPLEMODE_RATE : SAMPLEMODE_NONE;
+	m_fSampleRate = fRate < 1 ? fRate : 1;
+	UpdateBridge(NULL);
+}
+
+void CHook::SetStatsEnabled(bool bEnabled)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_bStats = bEnabled;
+	UpdateBridge(NULL);
+}
+
+HookStats_t CHook::GetStats()
+{
+	HookStats_t stats;
+	memset(&stats, 0, sizeof(stats));
+	CollectHookStats(m_iThreadSlot, &stats);
+	return stats;
+}
+
+/*
+Draws the number of calls until the next sampled call of SAMPLEMODE_RATE.
+Called by the bridge after a sampled call.
+*/
+static void __cdecl ResetSampleCountdown(CThreadHookState* pState, CHook* pHook)
+{
+	// xorshift32
+	unsigned int x = pState->m_iRandomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	pState->m_iRandomState = x;
+
+	// The distance between two sampled calls is geometrically distributed
+	double fUniform = (x + 1.0) / 4294967297.0;
+	double fCountdown = 1;
+	if (pHook->m_fSampleRate > 0)
+		fCountdown = floor(log(fUniform) / log(1 - pHook->m_fSampleRate)) + 1;
+
+	pState->m_iSampleCountdown = fCountdown < INT_MAX ? (int) fCountdown : INT_MAX;
+}
+
+/*
+Allocates an array for the given number of callbacks.
+*/
+static CCallbackArray* AllocCallbackArray(int iCount)
+{
+	CCallbackArray* pCallbacks = (CCallbackArray *) malloc(
+		offsetof(CCallbackArray, m_pCallbacks) + iCount * sizeof(HookHandlerFn *));
+
+	pCallbacks->m_iCount = iCount;
+	return pCallbacks;
+}
+
 void CHook::AddCallback(HookType_t eHookType, HookHandlerFn* pCallback)
 {
 	if (!pCallback)
 		return;
 
-	if (!IsCallbackRegistered(eHookType, pCallback))
-		m_hookHandler[eHookType].push_back(pCallback);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (IsCallbackRegistered(eHookType, pCallback))
+		return;
+
+	// Copy the current callbacks and append the new one
+	CCallbackArray* pOldCallbacks = m_pCallbacks[eHookType];
+	int iOldCount = pOldCallbacks ? pOldCallbacks->m_iCount : 0;
+
+	CCallbackArray* pCallbacks = AllocCallbackArray(iOldCount + 1);
+	for(int i=0; i < iOldCount; i++)
+		pCallbacks->m_pCallbacks[i] = pOldCallbacks->m_pCallbacks[i];
+
+	pCallbacks->m_pCallbacks[iOldCount] = pCallback;
+	SetCallbacks(eHookType, pCallbacks);
 }
 
 void CHook::RemoveCallback(HookType_t eHookType, HookHandlerFn* pCallback)
 {
-	if (IsCallbackRegistered(eHookType, pCallback))
-		m_hookHandler[eHookType].remove(pCallback);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!IsCallbackRegistered(eHookType, pCallback))
+		return;
+
+	// Copy all callbacks except the removed one
+	CCallbackArray* pOldCallbacks = m_pCallbacks[eHookType];
+	CCallbackArray* pCallbacks = NULL;
+	if (pOldCallbacks->m_iCount > 1)
+	{
+		pCallbacks = AllocCallbackArray(pOldCallbacks->m_iCount - 1);
+		int iCount = 0;
+		for(int i=0; i < pOldCallbacks->m_iCount; i++)
+		{
+			if (pOldCallbacks->m_pCallbacks[i] != pCallback)
+				pCallbacks->m_pCallbacks[iCount++] = pOldCallbacks->m_pCallbacks[i];
+		}
+	}
+
+	SetCallbacks(eHookType, pCallbacks);
 }
 
 bool CHook::IsCallbackRegistered(HookType_t eHookType, HookHandlerFn* pCallback)
 {
-	std::list<HookHandlerFn *> callbacks = m_hookHandler[eHookType];
-	for(std::list<HookHandlerFn *>::iterator it=callbacks.begin(); it != callbacks.end(); it++)
+	bool bRegistered = false;
+
+	EnterReadSection();
+	CCallbackArray* pCallbacks = m_pCallbacks[eHookType].load(std::memory_order_acquire);
+	if (pCallbacks)
 	{
-		if (*it == pCallback)
-			return true;
+		for(int i=0; i < pCallbacks->m_iCount; i++)
+		{
+			if (pCallbacks->m_pCallbacks[i] == pCallback)
+			{
+				bRegistered = true;
+				break;
+			}
+		}
 	}
-	return false;
-}
+	LeaveReadSection();
 
+	return bRegistered;
+}
 
-CRegisters* CHook::GetRegisters()
+int CHook::GetCallbackCount(HookType_t eHookType)
 {
-	if (m_bUsePreRegisters)
-		return m_pRegistersPre;
+	CCallbackArray* pCallbacks = m_pCallbacks[eHookType];
+	return pCallbacks ? pCallbacks->m_iCount : 0;
+}
 
-	return m_pRegistersPost;
+void CHook::SetCallbacks(HookType_t eHookType, CCallbackArray* pCallbacks)
+{
+	CCallbackArray* pOldCallbacks = m_pCallbacks[eHookType];
+	m_pCallbacks[eHookType].store(pCallbacks, std::memory_order_release);
+	UpdateBridge(pOldCallbacks);
 }
 
-bool CHook::HookHandler(HookType_t eHookType)
+void CHook::UpdateBridge(CCallbackArray* pOldCallbacks)
 {
-	m_bUsePreRegisters = (eHookType == HOOKTYPE_PRE);
+	CRetiredCode retired;
+	retired.m_pCallbacks = pOldCallbacks;
+	retired.m_pBridge = m_pBridge;
+	retired.m_pPostCallback = m_pPostCallback;
 
-	bool bOverride = false;
-	std::list<HookHandlerFn *> callbacks = this->m_hookHandler[eHookType];
-	for(std::list<HookHandlerFn *>::iterator it=callbacks.begin(); it != callbacks.end(); it++)
+	// If the new code can't be created, the previous code is still in use
+	if (!CreateBridge())
 	{
-		bool result = ((HookHandlerFn) *it)(eHookType, this);
-		if (result)
-			bOverride = true;
+		retired.m_pBridge = NULL;
+		retired.m_pPostCallback = NULL;
 	}
-	return bOverride;
+
+	// Threads might still be using the previous code and callbacks, so they
+	// are released after a grace period.
+	retired.m_pGracePeriod = new CGracePeriod;
+	m_RetiredCode.push_back(retired);
+	ReleaseRetiredCode(false);
 }
 
-void* __cdecl CHook::GetReturnAddress(void* pESP)
+void CHook::ReleaseRetiredCode(bool bForce)
 {
-	if (m_RetAddr.count(pESP) == 0)
-		puts("Unable to find return address. You are going to crash now!");
+	std::list<CRetiredCode>::iterator it=m_RetiredCode.begin();
+	while (it != m_RetiredCode.end())
+	{
+		if (!bForce && !it->m_pGracePeriod->HasElapsed())
+		{
+			it++;
+			continue;
+		}
 
-	void* pRetAddr = m_RetAddr[pESP].back();
-	m_RetAddr[pESP].pop_back();
+		if (it->m_pBridge)
+			m_pCodeArena->Release(it->m_pBridge);
 
-	return pRetAddr;
+		if (it->m_pPostCallback)
+			m_pCodeArena->Release(it->m_pPostCallback);
+
+		free(it->m_pCallbacks);
+		delete it->m_pGracePeriod;
+		it = m_RetiredCode.erase(it);
+	}
 }
 
-void __cdecl CHook::SetReturnAddress(void* pRetAddr, void* pESP)
+
+CRegisters* CHook::GetThreadRegisters()
 {
-	m_RetAddr[pESP].push_back(pRetAddr);
+	if (m_eRegisterMode == REGISTERMODE_THREAD)
+	{
+		CThreadHookState* pState = GetThreadHookState(this);
+		if (pState->m_bUsePreRegisters)
+			return pState->m_pRegistersPre;
+
+		return pState->m_pRegistersPost;
+	}
+
+	if (m_eRegisterMode == REGISTERMODE_STACK)
+	{
+		// Move the registers to the frame of the current invocation
+		CThreadHookState* pState = GetThreadHookState(this);
+		CRegisters* pRegisters = pState->m_bUsePreRegisters ? pState->m_pRegistersPre : pState->m_pRegistersPost;
+		if (pRegisters->m_pFrame != pState->m_pStackFrame)
+			pRegisters->SetFrame(pState->m_pStackFrame);
+
+		return pRegisters;
+	}
+
+	return m_pSharedRegisters;
+}
+
+bool CHook::CreateEntries()
+{
+	// The bridge can be replaced at any time, so always jump to the current
+	// one. Replaced code isn't released while a thread is in a read section.
+	CodeHolder entry;
+	m_pCodeArena->InitCode(&entry);
+	x86::Assembler a(&entry);
+
+	Write_EnterReadSection(a);
+#ifdef DYNAMICHOOKS_X64
+	// r11 is neither used for arguments nor preserved across calls
+	a.mov(r11, imm(&m_pBridge));
+	a.jmp(qword_ptr(r11));
+#else
+	a.jmp(dword_ptr_abs((uint64_t) &m_pBridge));
+#endif
+
+	m_pEntry = m_pCodeArena->Add(&entry);
+	if (!m_pEntry)
+		return false;
+
+	// The same applies to the post-hook code. Calls that are still running
+	// will return to it, even if the post-hook code has been replaced.
+	CodeHolder post;
+	m_pCodeArena->InitCode(&post);
+	x86::Assembler b(&post);
+
+	Write_EnterReadSection(b);
+#ifdef DYNAMICHOOKS_X64
+	// r11 is not used for return values either
+	b.mov(r11, imm(&m_pPostCallback));
+	b.jmp(qword_ptr(r11));
+#else
+	b.jmp(dword_ptr_abs((uint64_t) &m_pPostCallback));
+#endif
+
+	m_pNewRetAddr = m_pCodeArena->Add(&post);
+	if (!m_pNewRetAddr)
+		return false;
+
+	// Replaceable code jumps to these exits to leave its read section, so a
+	// thread never executes it after the grace period could have elapsed.
+	int iPopSize = m_pCallingConvention->GetPopSize();
+
+	// Continue with the original function
+	CodeHolder function;
+	m_pCodeArena->InitCode(&function);
+	x86::Assembler c(&function);
+
+	Write_LeaveReadSection(c);
+	c.jmp(m_pTrampoline);
+
+	m_pExitToFunction = m_pCodeArena->Add(&function);
+	if (!m_pExitToFunction)
+		return false;
+
+	// Return to the caller if a pre-hook has overridden the function
+	CodeHolder caller;
+	m_pCodeArena->InitCode(&caller);
+	x86::Assembler d(&caller);
+
+	Write_LeaveReadSection(d);
+	d.ret(imm(iPopSize));
+
+	m_pExitToCaller = m_pCodeArena->Add(&caller);
+	if (!m_pExitToCaller)
+		return false;
+
+	// Return to the original caller after the post-hook code. eax holds the
+	// context and the scratch registers are on the stack. The read section
+	// of the popped entry is left as well.
+	CodeHolder post_exit;
+	m_pCodeArena->InitCode(&post_exit);
+	x86::Assembler e(&post_exit);
+
+	e.dec(dword_ptr(zax, offsetof(CThreadContext, m_iReadDepth)));
+	Write_LeaveReadSection(e, zax);
+	e.pop(zdx);
+	e.pop(zcx);
+	e.pop(zax);
+	e.add(zsp, imm(iPopSize));
+	e.ret();
+
+	m_pExitFromPost = m_pCodeArena->Add(&post_exit);
+	return m_pExitFromPost != NULL;
 }
 
 bool CHook::CreateBridge()
 {
+	void* pPostCallback = CreatePostCallback();
+	if (!pPostCallback)
+		return false;
+
 	CodeHolder code;
-	code.init(m_asmjit_rt.environment(), m_asmjit_rt.cpuFeatures());
+	m_pCodeArena->InitCode(&code);
 	x86::Assembler a(&code);
 
 	Label label_override = a.newLabel();
 
-	// Write a redirect to the post-hook code
-	Write_ModifyReturnAddress(a);
+	// Only write the parts that are used by the current callbacks. If there
+	// are none, the bridge directly jumps to the trampoline.
+	bool bPre = GetCallbackCount(HOOKTYPE_PRE) > 0;
+	bool bPost = GetCallbackCount(HOOKTYPE_POST) > 0;
 
-	// Call the pre-hook handler and jump to label_override if true was returned
-	Write_CallHandler(a, HOOKTYPE_PRE, m_pRegistersPre);
-	a.cmp(eax, true);
-	
-	// Restore the previously saved registers, so any changes will be applied
-	Write_RestoreRegisters(a, m_pRegistersPre);
+	// Calls that are not sampled jump to label_skip
+	Label label_skip = a.newLabel();
+	bool bSample = (bPre || bPost || m_bStats) && m_eSampleMode != SAMPLEMODE_NONE;
+	if (bSample)
+		Write_Sample(a, label_skip);
+
+	if (m_bStats)
+		Write_IncrementStat(a, offsetof(HookStats_t, m_iCalls));
+
+	// Write a redirect to the post-hook code. The statistics also need it to
+	// stop the timer.
+	if (bPost || m_bStats)
+		Write_ModifyReturnAddress(a);
+
+	// Call the pre-hook handlers and jump to label_override if one of them
+	// returned true
+	if (bPre)
+	{
+		Write_CallHandler(a, HOOKTYPE_PRE);
+		a.test(al, al);
+		a.jnz(label_override);
 
-	a.je(label_override);
+		// Restore the previously saved registers, so any changes will be
+		// applied
+		Write_RestoreRegisters(a, HOOKTYPE_PRE);
+	}
+
+	if (m_bStats)
+		Write_StartTimer(a);
 
 	// Jump to the trampoline
-	a.jmp(m_pTrampoline);
+	a.jmp(m_pExitToFunction);
 
-	// This code will be executed if a pre-hook returns true
-	a.bind(label_override);
+	if (bPre)
+	{
+		// This code will be executed if a pre-hook returns true
+		a.bind(label_override);
+		Write_RestoreRegisters(a, HOOKTYPE_PRE);
+		if (m_bStats)
+			Write_IncrementStat(a, offsetof(HookStats_t, m_iOverrides));
+
+		// Finally, return to the caller
+		// This will still call post hooks, but will skip the original
+		// function.
+		a.jmp(m_pExitToCaller);
+	}
 
-	// Finally, return to the caller
-	// This will still call post hooks, but will skip the original function.
-	a.ret(imm(m_pCallingConvention->GetPopSize()));
+	if (bSample)
+	{
+		// Calls that are not sampled only restore eax and ecx
+		a.bind(label_skip);
+		a.pop(zcx);
+		a.pop(zax);
+		a.jmp(m_pExitToFunction);
+	}
+
+	void* pBridge = m_pCodeArena->Add(&code);
+	if (!pBridge)
+	{
+		m_pCodeArena->Release(pPostCallback);
+		return false;
+	}
 
-	return m_asmjit_rt.add(&m_pBridge, &code);
+	// Publish the new code. The previous code has to be retired by the
+	// caller.
+	m_pPostCallback.store(pPostCallback, std::memory_order_release);
+	m_pBridge.store(pBridge, std::memory_order_release);
+	return true;
 }
 
-void CHook::Write_ModifyReturnAddress(x86::Assembler& a)
+void CHook::Write_Sample(x86::Assembler& a, Label& label_skip)
 {
-	// Save scratch registers that are used by SetReturnAddress
-	static void* pEAX = NULL;
-	static void* pECX = NULL;
-	static void* pEDX = NULL;
-	a.mov(dword_ptr_abs((uint64_t) &pEAX), eax);
-	a.mov(dword_ptr_abs((uint64_t) &pECX), ecx);
-	a.mov(dword_ptr_abs((uint64_t) &pEDX), edx);
+	// Decrement the countdown of the thread and skip the call if it didn't
+	// reach zero. eax and ecx are restored by the caller at label_skip.
+	a.push(zax);
+	a.push(zcx);
+	Write_LoadThreadState(a);
+	a.dec(dword_ptr(zax, offsetof(CThreadHookState, m_iSampleCountdown)));
+	a.jg(label_skip);
+
+	// This call is sampled, so reset the countdown
+	if (m_eSampleMode == SAMPLEMODE_INTERVAL)
+	{
+		a.mov(dword_ptr(zax, offsetof(CThreadHookState, m_iSampleCountdown)), m_iSampleInterval);
+	}
+	else
+	{
+		Write_CallFunction(a, (void *) &ResetSampleCountdown, zax, imm(this));
+	}
 
-	// Store the return address in eax
-	a.mov(eax, dword_ptr(esp));
-	
-	// Save the original return address by using the current esp as the key.
-	// This should be unique until we have returned to the original caller.
-	void (__cdecl CHook::*SetReturnAddress)(void*, void*) = &CHook::SetReturnAddress;
-	a.push(esp);
-	a.push(eax);
-	a.push(this);
-	a.call((void *&) SetReturnAddress);
-	a.add(esp, 12);
-	
-	// Restore scratch registers
-	a.mov(eax, dword_ptr_abs((uint64_t) &pEAX));
-	a.mov(ecx, dword_ptr_abs((uint64_t) &pECX));
-	a.mov(edx, dword_ptr_abs((uint64_t) &pEDX));
+	a.pop(zcx);
+	a.pop(zax);
+}
+
+void CHook::Write_IncrementStat(x86::Assembler& a, int iOffset)
+{
+	// The counters of the thread are only written by the thread itself, so
+	// they don't need a locked instruction
+	a.push(zax);
+	a.push(zcx);
+	Write_LoadThreadState(a);
+#ifdef DYNAMICHOOKS_X64
+	a.add(qword_ptr(zax, offsetof(CThreadHookState, m_Stats) + iOffset), 1);
+#else
+	a.add(dword_ptr(zax, offsetof(CThreadHookState, m_Stats) + iOffset), 1);
+	a.adc(dword_ptr(zax, offsetof(CThreadHookState, m_Stats) + iOffset + 4), 0);
+#endif
+	a.pop(zcx);
+	a.pop(zax);
+}
+
+void CHook::Write_StartTimer(x86::Assembler& a)
+{
+	Label label_done = a.newLabel();
+
+	// Save scratch registers. The return address is now above them.
+	a.push(zax);
+	a.push(zcx);
+	a.push(zdx);
+
+	// The top entry of the shadow stack belongs to this call, unless the
+	// stack was full. The context has been created by
+	// Write_ModifyReturnAddress.
+	Write_LoadThreadContext(a, zcx);
+	a.mov(zcx, native_ptr(zcx, offsetof(CThreadContext, m_pReturnStackTop)));
+	a.lea(zax, native_ptr(zsp, 3 * NATIVE_SIZE));
+	a.cmp(native_ptr(zcx, (int) offsetof(ReturnAddress_t, m_pStackPointer) - (int) sizeof(ReturnAddress_t)), zax);
+	a.jne(label_done);
+
+	a.rdtsc();
+	a.mov(dword_ptr(zcx, (int) offsetof(ReturnAddress_t, m_iTimestamp) - (int) sizeof(ReturnAddress_t)), eax);
+	a.mov(dword_ptr(zcx, (int) offsetof(ReturnAddress_t, m_iTimestamp) + 4 - (int) sizeof(ReturnAddress_t)), edx);
+
+	a.bind(label_done);
+	a.pop(zdx);
+	a.pop(zcx);
+	a.pop(zax);
+}
+
+void CHook::Write_StopTimer(x86::Assembler& a)
+{
+	Label label_zero = a.newLabel();
+	Label label_high = a.newLabel();
+	Label label_record = a.newLabel();
+	Label label_done = a.newLabel();
+
+	// eax = context, ecx = entry of this call. Both are preserved. edx is
+	// a saved scratch register. Calls that have been redirected by a bridge
+	// without statistics don't have a timestamp.
+	a.mov(edx, dword_ptr(zcx, offsetof(ReturnAddress_t, m_iTimestamp)));
+	a.or_(edx, dword_ptr(zcx, offsetof(ReturnAddress_t, m_iTimestamp) + 4));
+	a.jz(label_done);
+
+	a.push(zax);
+	a.push(zcx);
+
+	// edx:eax = elapsed ticks
+	a.rdtsc();
+	a.sub(eax, dword_ptr(zcx, offsetof(ReturnAddress_t, m_iTimestamp)));
+	a.sbb(edx, dword_ptr(zcx, offsetof(ReturnAddress_t, m_iTimestamp) + 4));
+
+	// ecx = index of the highest set bit. The TSCs of different CPUs might
+	// be slightly apart, so negative values are counted as zero.
+	a.test(edx, edx);
+	a.js(label_zero);
+	a.jnz(label_high);
+	a.bsr(ecx, eax);
+	a.jnz(label_record);
+
+	a.bind(label_zero);
+	a.xor_(ecx, ecx);
+	a.jmp(label_record);
+
+	a.bind(label_high);
+	a.bsr(ecx, edx);
+	a.add(ecx, 32);
+
+	// The state has been created by the bridge that wrote the timestamp
+	a.bind(label_record);
+	a.mov(zax, native_ptr(zsp, NATIVE_SIZE));
+	a.mov(zax, native_ptr(zax, offsetof(CThreadContext, m_ppHookStates)));
+	a.mov(zax, native_ptr(zax, m_iThreadSlot * sizeof(CThreadHookState *)));
+#ifdef DYNAMICHOOKS_X64
+	a.add(qword_ptr(zax, zcx, 3, offsetof(CThreadHookState, m_Stats) + offsetof(HookStats_t, m_LatencyHistogram)), 1);
+#else
+	a.add(dword_ptr(zax, zcx, 3, offsetof(CThreadHookState, m_Stats) + offsetof(HookStats_t, m_LatencyHistogram)), 1);
+	a.adc(dword_ptr(zax, zcx, 3, offsetof(CThreadHookState, m_Stats) + offsetof(HookStats_t, m_LatencyHistogram) + 4), 0);
+#endif
+
+	a.pop(zcx);
+	a.pop(zax);
+	a.bind(label_done);
+}
+
+void CHook::Write_ModifyReturnAddress(x86::Assembler& a)
+{
+	Label label_discard = a.newLabel();
+	Label label_push = a.newLabel();
+	Label label_overflow = a.newLabel();
+	Label label_done = a.newLabel();
+
+	// Save scratch registers. The return address is now above them.
+	a.push(zax);
+	a.push(zcx);
+	a.push(zdx);
+
+	// eax = context, ecx = top of the shadow stack, edx = original esp. The
+	// original esp is used as the key. It's unique until we have returned to
+	// the original caller.
+	Write_GetThreadContext(a);
+	a.mov(zcx, native_ptr(zax, offsetof(CThreadContext, m_pReturnStackTop)));
+	a.lea(zdx, native_ptr(zsp, 3 * NATIVE_SIZE));
+
+	// Discard entries of calls that have been left without returning and
+	// leave their read sections. The sentinel stops this loop.
+	a.bind(label_discard);
+	a.cmp(native_ptr(zcx, (int) offsetof(ReturnAddress_t, m_pStackPointer) - (int) sizeof(ReturnAddress_t)), zdx);
+	a.ja(label_push);
+	a.sub(zcx, sizeof(ReturnAddress_t));
+	a.dec(dword_ptr(zax, offsetof(CThreadContext, m_iReadDepth)));
+	a.jmp(label_discard);
+
+	// If the shadow stack is full, the return address isn't modified and the
+	// post-hooks are skipped.
+	a.bind(label_push);
+	a.cmp(zcx, native_ptr(zax, offsetof(CThreadContext, m_pReturnStackEnd)));
+	a.jae(label_overflow);
+
+	// Push the original return address
+	a.mov(native_ptr(zcx, offsetof(ReturnAddress_t, m_pStackPointer)), zdx);
+	a.mov(zdx, native_ptr(zsp, 3 * NATIVE_SIZE));
+	a.mov(native_ptr(zcx, offsetof(ReturnAddress_t, m_pAddress)), zdx);
+	a.mov(dword_ptr(zcx, offsetof(ReturnAddress_t, m_iTimestamp)), 0);
+	a.mov(dword_ptr(zcx, offsetof(ReturnAddress_t, m_iTimestamp) + 4), 0);
+	a.add(zcx, sizeof(ReturnAddress_t));
+
+	// The entry stays in a read section until it's popped, so the post-hook
+	// code, the trampoline and the new return address aren't released while
+	// the original function is running
+	a.inc(dword_ptr(zax, offsetof(CThreadContext, m_iReadDepth)));
 
 	// Override the return address. This is a redirect to our post-hook code
-	CreatePostCallback();
-	a.mov(dword_ptr(esp), imm(m_pNewRetAddr));
+	a.mov(zdx, imm(m_pNewRetAddr));
+	a.mov(native_ptr(zsp, 3 * NATIVE_SIZE), zdx);
+	a.jmp(label_done);
+
+	a.bind(label_overflow);
+	a.inc(dword_ptr(zax, offsetof(CThreadContext, m_iReturnStackOverflows)));
+
+	a.bind(label_done);
+	a.mov(native_ptr(zax, offsetof(CThreadContext, m_pReturnStackTop)), zcx);
+
+	// Restore scratch registers
+	a.pop(zdx);
+	a.pop(zcx);
+	a.pop(zax);
 }
 
-bool CHook::CreatePostCallback()
+void* CHook::CreatePostCallback()
 {
 	CodeHolder code;
-	code.init(m_asmjit_rt.environment(), m_asmjit_rt.cpuFeatures());
+	m_pCodeArena->InitCode(&code);
 	x86::Assembler a(&code);
 
+	Label label_pop = a.newLabel();
+	Label label_found = a.newLabel();
+	Label label_not_found = a.newLabel();
+
 	int iPopSize = m_pCallingConvention->GetPopSize();
 
 	// Subtract the previously added bytes (stack size + return address), so
 	// that we can access the arguments again
-	a.sub(esp, imm(iPopSize+4));
-
-	// Call the post-hook handler
-	Write_CallHandler(a, HOOKTYPE_POST, m_pRegistersPost);
+	a.sub(zsp, imm(iPopSize + NATIVE_SIZE));
 
-	// Restore the previously saved registers, so any changes will be applied
-	Write_RestoreRegisters(a, m_pRegistersPost);
-
-	// Save scratch registers that are used by GetReturnAddress
-	static void* pEAX = NULL;
-	static void* pECX = NULL;
-	static void* pEDX = NULL;
-	a.mov(dword_ptr_abs((uint64_t) &pEAX), eax);
-	a.mov(dword_ptr_abs((uint64_t) &pECX), ecx);
-	a.mov(dword_ptr_abs((uint64_t) &pEDX), edx);
-	
-	// Get the original return address
-	void* (__cdecl CHook::*GetReturnAddress)(void*) = &CHook::GetReturnAddress;
-	a.push(esp);
-	a.push(this);
-	a.call((void *&) GetReturnAddress);
-	a.add(esp, 8);
-
-	// Save the original return address
-	static void* pRetAddr = NULL;
-	a.mov(dword_ptr_abs((uint64_t) &pRetAddr), eax);
-	
-	// Restore scratch registers
-	a.mov(eax, dword_ptr_abs((uint64_t) &pEAX));
-	a.mov(ecx, dword_ptr_abs((uint64_t) &pECX));
-	a.mov(edx, dword_ptr_abs((uint64_t) &pEDX));
+	// Calls that have been redirected before the last post-hook was removed
+	// still return to this code, so it's always created. But it doesn't need
+	// to save and restore the registers without post-hooks.
+	if (GetCallbackCount(HOOKTYPE_POST) > 0)
+	{
+		// Call the post-hook handlers
+		Write_CallHandler(a, HOOKTYPE_POST);
 
-	// Add the bytes again to the stack (stack size + return address), so we
-	// don't corrupt the stack.
-	a.add(esp, imm(iPopSize+4));
+		// Restore the previously saved registers, so any changes will be
+		// applied
+		Write_RestoreRegisters(a, HOOKTYPE_POST);
+	}
 
-	// Jump to the original return address
-	a.jmp(dword_ptr_abs((uint64_t) &pRetAddr));
+	// Save scratch registers
+	a.push(zax);
+	a.push(zcx);
+	a.push(zdx);
+
+	// eax = context, ecx = top of the shadow stack, edx = key of this call.
+	// The bridge has already created the context.
+	Write_LoadThreadContext(a, zax);
+	a.mov(zcx, native_ptr(zax, offsetof(CThreadContext, m_pReturnStackTop)));
+	a.lea(zdx, native_ptr(zsp, 3 * NATIVE_SIZE));
+
+	// Pop entries until we find ours. Entries with a lower key belong to
+	// calls that have been left without returning, so their read sections
+	// are left. A higher key (e.g. the sentinel) means that our entry is
+	// missing.
+	a.bind(label_pop);
+	a.sub(zcx, sizeof(ReturnAddress_t));
+	a.cmp(native_ptr(zcx, offsetof(ReturnAddress_t, m_pStackPointer)), zdx);
+	a.jae(label_found);
+	a.dec(dword_ptr(zax, offsetof(CThreadContext, m_iReadDepth)));
+	a.jmp(label_pop);
+
+	a.bind(label_found);
+	a.jne(label_not_found);
+	a.mov(native_ptr(zax, offsetof(CThreadContext, m_pReturnStackTop)), zcx);
+
+	if (m_bStats)
+		Write_StopTimer(a);
+
+	// Write the original return address to the last stack slot the function
+	// has popped, so we can simply return to it
+	a.mov(zcx, native_ptr(zcx, offsetof(ReturnAddress_t, m_pAddress)));
+	a.mov(native_ptr(zsp, 3 * NATIVE_SIZE + iPopSize), zcx);
+
+	// Restore scratch registers, add the bytes again to the stack (stack
+	// size), so we don't corrupt the stack, and return to the original caller
+	a.jmp(m_pExitFromPost);
+
+	a.bind(label_not_found);
+	a.and_(zsp, -16);
+	a.call((void *) &ReturnAddressNotFound);
 
 	// Generate the code
-	return m_asmjit_rt.add(&m_pNewRetAddr, &code);
+	return m_pCodeArena->Add(&code);
 }
 
-void CHook::Write_CallHandler(x86::Assembler& a, HookType_t type, CRegisters* pRegisters)
+void CHook::Write_CallHandler(x86::Assembler& a, HookType_t type)
 {
-	bool (__cdecl CHook::*HookHandler)(HookType_t) = &CHook::HookHandler;
+	CCallbackArray* pCallbacks = m_pCallbacks[type];
+	int iCount = GetCallbackCount(type);
 
 	// Save the registers so that we can access them in our handlers
-	Write_SaveRegisters(a, pRegisters);
+	Write_SaveRegisters(a, type);
+
+	// Let GetRegisters() know which registers the handlers have to use
+	if (m_eRegisterMode == REGISTERMODE_STACK)
+	{
+		// Save the previous binding in the reserved stack space, because the
+		// handlers might call the function again.
+		Write_LoadThreadState(a);
+		a.mov(zcx, native_ptr(zax, offsetof(CThreadHookState, m_pStackFrame)));
+		a.mov(native_ptr(zsp), zcx);
+		a.movzx(ecx, byte_ptr(zax, offsetof(CThreadHookState, m_bUsePreRegisters)));
+		a.mov(native_ptr(zsp, NATIVE_SIZE), zcx);
+
+		a.lea(zcx, native_ptr(zsp, 2 * NATIVE_SIZE + FRAME_ALIGNMENT - 1));
+		a.and_(zcx, -FRAME_ALIGNMENT);
+		a.mov(native_ptr(zax, offsetof(CThreadHookState, m_pStackFrame)), zcx);
+		a.mov(byte_ptr(zax, offsetof(CThreadHookState, m_bUsePreRegisters)), type == HOOKTYPE_PRE);
+	}
+	else if (m_eRegisterMode == REGISTERMODE_THREAD)
+	{
+		// The state has already been created while saving the registers
+		Write_LoadThreadContext(a, zax);
+		a.mov(zax, native_ptr(zax, offsetof(CThreadContext, m_ppHookStates)));
+		a.mov(zax, native_ptr(zax, m_iThreadSlot * sizeof(CThreadHookState *)));
+		a.mov(byte_ptr(zax, offsetof(CThreadHookState, m_bUsePreRegisters)), type == HOOKTYPE_PRE);
+	}
+	else
+	{
+		CRegisters* pRegisters = type == HOOKTYPE_PRE ? m_pRegistersPre : m_pRegistersPost;
+#ifdef DYNAMICHOOKS_X64
+		a.mov(zax, imm(&m_pSharedRegisters));
+		a.mov(zcx, imm(pRegisters));
+		a.mov(native_ptr(zax), zcx);
+#else
+		a.mov(dword_ptr_abs((uint64_t) &m_pSharedRegisters), imm(pRegisters));
+#endif
+	}
+
+	// Call all handlers directly and combine their results in bl
+#ifdef DYNAMICHOOKS_X64
+	// Pushing rbx preserves 16-Byte stack alignment
+	a.push(rbx);
+	a.xor_(ebx, ebx);
+#ifdef _WIN32
+	// Shadow space
+	a.sub(rsp, 32);
+#endif
+	for(int i=0; i < iCount; i++)
+	{
+		a.mov(zarg0.r32(), type);
+		a.mov(zarg1, imm(this));
+		a.call((void *) pCallbacks->m_pCallbacks[i]);
+		a.or_(bl, al);
+	}
+#ifdef _WIN32
+	a.add(rsp, 32);
+#endif
+#else
+	// Pushing ebx and the two arguments preserves 16-Byte stack alignment
+	// for Linux
+	a.push(ebx);
+	a.xor_(ebx, ebx);
+	for(int i=0; i < iCount; i++)
+	{
+		a.push(this);
+		a.push(type);
+		a.call((void *) pCallbacks->m_pCallbacks[i]);
+		a.add(esp, 8);
+		a.or_(bl, al);
+	}
+#endif
 
-	// Call the global hook handler
-	// Subtract 4 bytes to preserve 16-Byte stack alignment for Linux
-	a.sub(esp, 4);
-	a.push(type);
-	a.push(this);
-	a.call((void *&) HookHandler);
-	a.add(esp, 12);
+	if (m_eRegisterMode == REGISTERMODE_STACK)
+	{
+		// Restore the previous binding. The state exists at this point.
+		Write_LoadThreadContext(a, zcx);
+		a.mov(zcx, native_ptr(zcx, offsetof(CThreadContext, m_ppHookStates)));
+		a.mov(zcx, native_ptr(zcx, m_iThreadSlot * sizeof(CThreadHookState *)));
+		a.mov(zdx, native_ptr(zsp, NATIVE_SIZE));
+		a.mov(native_ptr(zcx, offsetof(CThreadHookState, m_pStackFrame)), zdx);
+		a.mov(zdx, native_ptr(zsp, 2 * NATIVE_SIZE));
+		a.mov(byte_ptr(zcx, offsetof(CThreadHookState, m_bUsePreRegisters)), dl);
+	}
+
+	// Return the combined result in al
+	a.mov(eax, ebx);
+	a.pop(zbx);
 }
 
-void CHook::Write_SaveRegisters(x86::Assembler& a, CRegisters* pRegisters)
+void CHook::Write_SaveRegisters(x86::Assembler& a, HookType_t type)
 {
+#ifdef DYNAMICHOOKS_X64
+	// Absolute addresses can't be encoded in 64-bit mode, so the shared
+	// frame is accessed like the frame of a thread
+	Write_SaveThreadRegisters(a, type);
+#else
+	if (m_eRegisterMode != REGISTERMODE_SHARED)
+	{
+		Write_SaveThreadRegisters(a, type);
+		return;
+	}
+
+	CRegisters* pRegisters = type == HOOKTYPE_PRE ? m_pRegistersPre : m_pRegistersPost;
 	std::list<Register_t> vecRegistersToSave = m_pCallingConvention->GetRegisters();
 	for(std::list<Register_t>::iterator it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
 	{
-		switch(*it)
-		{
-		// ========================================================================
-		// >> 8-bit General purpose registers
-		// ========================================================================
-		case AL: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_al->m_pAddress), al); break;
-		case CL: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_cl->m_pAddress), cl); break;
-		case DL: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_dl->m_pAddress), dl); break;
-		case BL: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_bl->m_pAddress), bl); break;
-
-		case AH: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_ah->m_pAddress), ah); break;
-		case CH: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_ch->m_pAddress), ch); break;
-		case DH: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_dh->m_pAddress), dh); break;
-		case BH: a.mov(byte_ptr_abs((uint64_t) pRegisters->m_bh->m_pAddress), bh); break;
-
-		// ========================================================================
-		// >> 16-bit General purpose registers
-		// ========================================================================
-		case AX: a.mov(word_ptr_abs((uint64_t) pRegisters->m_ax->m_pAddress), ax); break;
-		case CX: a.mov(word_ptr_abs((uint64_t) pRegisters->m_cx->m_pAddress), cx); break;
-		case DX: a.mov(word_ptr_abs((uint64_t) pRegisters->m_dx->m_pAddress), dx); break;
-		case BX: a.mov(word_ptr_abs((uint64_t) pRegisters->m_bx->m_pAddress), bx); break;
-		case SP: a.mov(word_ptr_abs((uint64_t) pRegisters->m_sp->m_pAddress), sp); break;
-		case BP: a.mov(word_ptr_abs((uint64_t) pRegisters->m_bp->m_pAddress), bp); break;
-		case SI: a.mov(word_ptr_abs((uint64_t) pRegisters->m_si->m_pAddress), si); break;
-		case DI: a.mov(word_ptr_abs((uint64_t) pRegisters->m_di->m_pAddress), di); break;
-
-		// ========================================================================
-		// >> 32-bit General purpose registers
-		// ========================================================================
-		case EAX: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_eax->m_pAddress), eax); break;
-		case ECX: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_ecx->m_pAddress), ecx); break;
-		case EDX: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_edx->m_pAddress), edx); break;
-		case EBX: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_ebx->m_pAddress), ebx); break;
-		case ESP: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_esp->m_pAddress), esp); break;
-		case EBP: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_ebp->m_pAddress), ebp); break;
-		case ESI: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_esi->m_pAddress), esi); break;
-		case EDI: a.mov(dword_ptr_abs((uint64_t) pRegisters->m_edi->m_pAddress), edi); break;
-
-		// ========================================================================
-		// >> 64-bit MM (MMX) registers
-		// ========================================================================
-		case MM0: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm0->m_pAddress), mm0); break;
-		case MM1: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm1->m_pAddress), mm1); break;
-		case MM2: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm2->m_pAddress), mm2); break;
-		case MM3: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm3->m_pAddress), mm3); break;
-		case MM4: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm4->m_pAddress), mm4); break;
-		case MM5: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm5->m_pAddress), mm5); break;
-		case MM6: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm6->m_pAddress), mm6); break;
-		case MM7: a.movq(qword_ptr_abs((uint64_t) pRegisters->m_mm7->m_pAddress), mm7); break;
-
-		// ========================================================================
-		// >> 128-bit XMM registers
-		// ========================================================================
-		// TODO: Also provide movups?
-		case XMM0: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm0->m_pAddress), xmm0); break;
-		case XMM1: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm1->m_pAddress), xmm1); break;
-		case XMM2: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm2->m_pAddress), xmm2); break;
-		case XMM3: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm3->m_pAddress), xmm3); break;
-		case XMM4: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm4->m_pAddress), xmm4); break;
-		case XMM5: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm5->m_pAddress), xmm5); break;
-		case XMM6: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm6->m_pAddress), xmm6); break;
-		case XMM7: a.movaps(dqword_ptr_abs((uint64_t) pRegisters->m_xmm7->m_pAddress), xmm7); break;
-
-		// ========================================================================
-		// >> 16-bit Segment registers
-		// ========================================================================
-		case CS: a.mov(word_ptr_abs((uint64_t) pRegisters->m_cs->m_pAddress), cs); break;
-		case SS: a.mov(word_ptr_abs((uint64_t) pRegisters->m_ss->m_pAddress), ss); break;
-		case DS: a.mov(word_ptr_abs((uint64_t) pRegisters->m_ds->m_pAddress), ds); break;
-		case ES: a.mov(word_ptr_abs((uint64_t) pRegisters->m_es->m_pAddress), es); break;
-		case FS: a.mov(word_ptr_abs((uint64_t) pRegisters->m_fs->m_pAddress), fs); break;
-		case GS: a.mov(word_ptr_abs((uint64_t) pRegisters->m_gs->m_pAddress), gs); break;
-
-		// ========================================================================
-		// >> 80-bit FPU registers
-		// ========================================================================
-		case ST0:
-		{
-			switch(GetDataTypeSize(this->m_pCallingConvention->m_returnType))
-			{
-				case SIZE_DWORD: a.fstp(dword_ptr_abs((uint64_t) pRegisters->m_st0->m_pAddress)); break;
-				case SIZE_QWORD: a.fstp(qword_ptr_abs((uint64_t) pRegisters->m_st0->m_pAddress)); break;
-				case SIZE_TWORD: a.fstp(tword_ptr_abs((uint64_t) pRegisters->m_st0->m_pAddress)); break;
-			}
-			break;
-		}
-		//case ST1: a.mov(tword_ptr_abs(pRegisters->m_st1->m_pAddress), st1); break;
-		//case ST2: a.mov(tword_ptr_abs(pRegisters->m_st2->m_pAddress), st2); break;
-		//case ST3: a.mov(tword_ptr_abs(pRegisters->m_st3->m_pAddress), st3); break;
-		//case ST4: a.mov(tword_ptr_abs(pRegisters->m_st4->m_pAddress), st4); break;
-		//case ST5: a.mov(tword_ptr_abs(pRegisters->m_st5->m_pAddress), st5); break;
-		//case ST6: a.mov(tword_ptr_abs(pRegisters->m_st6->m_pAddress), st6); break;
-		//case ST7: a.mov(tword_ptr_abs(pRegisters->m_st7->m_pAddress), st7); break;
-
-		default: puts("Unsupported register.");
-		}
+		CRegister* pRegister = pRegisters->GetRegister(*it);
+		Write_SaveRegister(a, *it, ptr_abs((uint64_t) pRegister->m_pAddress, pRegister->m_iSize));
 	}
+#endif
 }
 
-void CHook::Write_RestoreRegisters(x86::Assembler& a, CRegisters* pRegisters)
+void CHook::Write_RestoreRegisters(x86::Assembler& a, HookType_t type)
 {
+#ifdef DYNAMICHOOKS_X64
+	Write_RestoreThreadRegisters(a, type);
+#else
+	if (m_eRegisterMode != REGISTERMODE_SHARED)
+	{
+		Write_RestoreThreadRegisters(a, type);
+		return;
+	}
+
+	CRegisters* pRegisters = type == HOOKTYPE_PRE ? m_pRegistersPre : m_pRegistersPost;
 	std::list<Register_t> vecRegistersToSave = m_pCallingConvention->GetRegisters();
 	for(std::list<Register_t>::iterator it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
 	{
-		switch(*it)
+		CRegister* pRegister = pRegisters->GetRegister(*it);
+		Write_RestoreRegister(a, *it, ptr_abs((uint64_t) pRegister->m_pAddress, pRegister->m_iSize));
+	}
+#endif
+}
+
+int CHook::GetStackReserve()
+{
+	// Two slots for the previous binding, the frame and space to align it
+	int iReserve = 2 * NATIVE_SIZE + m_pRegistersPre->m_iFrameSize + FRAME_ALIGNMENT - 1;
+
+	// Keep the stack 16-Byte aligned
+	return (iReserve + 15) & ~15;
+}
+
+void CHook::Write_LoadThreadState(x86::Assembler& a)
+{
+	Label label_slow = a.newLabel();
+	Label label_done = a.newLabel();
+
+	// Fast path: eax = context->m_ppHookStates[m_iThreadSlot]
+	Write_LoadThreadContext(a, zax);
+	a.test(zax, zax);
+	a.jz(label_slow);
+	a.cmp(dword_ptr(zax, offsetof(CThreadContext, m_iHookStateCount)), m_iThreadSlot);
+	a.jle(label_slow);
+	a.mov(zax, native_ptr(zax, offsetof(CThreadContext, m_ppHookStates)));
+	a.mov(zax, native_ptr(zax, m_iThreadSlot * sizeof(CThreadHookState *)));
+	a.test(zax, zax);
+	a.jnz(label_done);
+
+	// Slow path: This thread hasn't called the function before
+	a.bind(label_slow);
+	Write_CallFunction(a, (void *) &GetThreadHookState, imm(this));
+
+	a.bind(label_done);
+}
+
+void CHook::Write_LoadThreadFrame(x86::Assembler& a, HookType_t type)
+{
+	if (m_eRegisterMode == REGISTERMODE_STACK)
+	{
+		// The frame is located in the reserved stack space above the two
+		// pushed registers
+		a.lea(zax, native_ptr(zsp, 4 * NATIVE_SIZE + FRAME_ALIGNMENT - 1));
+		a.and_(zax, -FRAME_ALIGNMENT);
+		return;
+	}
+
+	if (m_eRegisterMode == REGISTERMODE_SHARED)
+	{
+		// Only used in 64-bit mode (see Write_SaveRegisters)
+		CRegisters* pRegisters = type == HOOKTYPE_PRE ? m_pRegistersPre : m_pRegistersPost;
+		a.mov(zax, imm(pRegisters->m_pFrame));
+		return;
+	}
+
+	Write_LoadThreadState(a);
+
+	// Load the frame of the thread's CRegisters object
+	if (type == HOOKTYPE_PRE)
+		a.mov(zax, native_ptr(zax, offsetof(CThreadHookState, m_pRegistersPre)));
+	else
+		a.mov(zax, native_ptr(zax, offsetof(CThreadHookState, m_pRegistersPost)));
+
+	a.mov(zax, native_ptr(zax, offsetof(CRegisters, m_pFrame)));
+}
+
+/*
+eax holds the frame of the thread and ecx is used as a scratch register while
+saving and restoring registers in REGISTERMODE_THREAD and REGISTERMODE_STACK.
+These registers (and their parts) have to be handled separately.
+*/
+enum ScratchGroup_t
+{
+	SCRATCH_GROUP_NONE,
+	SCRATCH_GROUP_EAX,
+	SCRATCH_GROUP_ECX,
+	SCRATCH_GROUP_ESP
+};
+
+static ScratchGroup_t GetScratchGroup(Register_t reg)
+{
+	switch(reg)
+	{
+		case AL: case AH: case AX: case EAX: return SCRATCH_GROUP_EAX;
+		case CL: case CH: case CX: case ECX: return SCRATCH_GROUP_ECX;
+		case SP: case ESP: return SCRATCH_GROUP_ESP;
+#ifdef DYNAMICHOOKS_X64
+		case RAX: return SCRATCH_GROUP_EAX;
+		case RCX: return SCRATCH_GROUP_ECX;
+		case RSP: return SCRATCH_GROUP_ESP;
+#endif
+	}
+	return SCRATCH_GROUP_NONE;
+}
+
+/*
+Returns the part of ecx that matches the given part of eax or esp.
+*/
+static Register_t GetScratchAlias(Register_t reg)
+{
+	switch(reg)
+	{
+		case AL: return CL;
+		case AH: return CH;
+		case AX: case SP: return CX;
+		case EAX: case ESP: return ECX;
+#ifdef DYNAMICHOOKS_X64
+		case RAX: case RSP: return RCX;
+#endif
+	}
+	return reg;
+}
+
+void CHook::Write_SaveThreadRegisters(x86::Assembler& a, HookType_t type)
+{
+	std::list<Register_t> vecRegistersToSave = m_pCallingConvention->GetRegisters();
+	std::list<Register_t>::iterator it;
+
+	// All CRegisters objects of this hook share the same layout, so we can
+	// use our own as a template for the offsets.
+	CRegisters* pLayout = m_pRegistersPre;
+
+	// Number of bytes between esp and the original stack pointer after
+	// pushing eax and ecx
+	int iStackOffset = 2 * NATIVE_SIZE;
+	if (m_eRegisterMode == REGISTERMODE_STACK)
+	{
+		// Reserve space for the frame. It's released when the registers are
+		// restored.
+		a.sub(zsp, GetStackReserve());
+		iStackOffset += GetStackReserve();
+	}
+
+	a.push(zax);
+	a.push(zcx);
+	Write_LoadThreadFrame(a, type);
+
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_NONE)
+			Write_SaveRegister(a, *it, ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+	}
+
+	// Save the original value of eax through ecx
+	a.mov(zcx, native_ptr(zsp, NATIVE_SIZE));
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_EAX)
+			Write_SaveRegister(a, GetScratchAlias(*it), ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+	}
+
+	// Save the original stack pointer
+	a.lea(zcx, native_ptr(zsp, iStackOffset));
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_ESP)
+			Write_SaveRegister(a, GetScratchAlias(*it), ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+	}
+
+	// Finally, save ecx itself
+	a.mov(zcx, native_ptr(zsp));
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_ECX)
+			Write_SaveRegister(a, *it, ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+	}
+
+	a.pop(zcx);
+	a.pop(zax);
+}
+
+void CHook::Write_RestoreThreadRegisters(x86::Assembler& a, HookType_t type)
+{
+	std::list<Register_t> vecRegistersToSave = m_pCallingConvention->GetRegisters();
+	std::list<Register_t>::iterator it;
+	CRegisters* pLayout = m_pRegistersPre;
+
+	// The reserved stack space is released with the stack pointer
+	bool bRestoreStackPointer = m_eRegisterMode == REGISTERMODE_STACK;
+	int iStackOffset = bRestoreStackPointer ? 2 * NATIVE_SIZE + GetStackReserve() : 2 * NATIVE_SIZE;
+
+	a.push(zax);
+	a.push(zcx);
+	Write_LoadThreadFrame(a, type);
+
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_NONE)
+			Write_RestoreRegister(a, *it, ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+		else if (GetScratchGroup(*it) == SCRATCH_GROUP_ESP)
+			bRestoreStackPointer = true;
+	}
+
+	// The new values of eax and ecx are written to their stack slots, so
+	// they will be applied when they get popped.
+	a.mov(zcx, native_ptr(zsp));
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_ECX)
+			Write_RestoreRegister(a, *it, ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+	}
+	a.mov(native_ptr(zsp), zcx);
+
+	a.mov(zcx, native_ptr(zsp, NATIVE_SIZE));
+	for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
+	{
+		if (GetScratchGroup(*it) == SCRATCH_GROUP_EAX)
+			Write_RestoreRegister(a, GetScratchAlias(*it), ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+	}
+	a.mov(native_ptr(zsp, NATIVE_SIZE), zcx);
+
+	if (bRestoreStackPointer)
+	{
+		// Calculate the new stack pointer in ecx and move the two stack slots
+		// below it, so the pops will end up at the restored stack pointer.
+		a.lea(zcx, native_ptr(zsp, iStackOffset));
+		for(it=vecRegistersToSave.begin(); it != vecRegistersToSave.end(); it++)
 		{
-		// ========================================================================
-		// >> 8-bit General purpose registers
-		// ========================================================================
-		case AL: a.mov(al, byte_ptr_abs((uint64_t) pRegisters->m_al->m_pAddress)); break;
-		case CL: a.mov(cl, byte_ptr_abs((uint64_t) pRegisters->m_cl->m_pAddress)); break;
-		case DL: a.mov(dl, byte_ptr_abs((uint64_t) pRegisters->m_dl->m_pAddress)); break;
-		case BL: a.mov(bl, byte_ptr_abs((uint64_t) pRegisters->m_bl->m_pAddress)); break;
-
-		case AH: a.mov(ah, byte_ptr_abs((uint64_t) pRegisters->m_ah->m_pAddress)); break;
-		case CH: a.mov(ch, byte_ptr_abs((uint64_t) pRegisters->m_ch->m_pAddress)); break;
-		case DH: a.mov(dh, byte_ptr_abs((uint64_t) pRegisters->m_dh->m_pAddress)); break;
-		case BH: a.mov(bh, byte_ptr_abs((uint64_t) pRegisters->m_bh->m_pAddress)); break;
-
-		// ========================================================================
-		// >> 16-bit General purpose registers
-		// ========================================================================
-		case AX: a.mov(ax, word_ptr_abs((uint64_t) pRegisters->m_ax->m_pAddress)); break;
-		case CX: a.mov(cx, word_ptr_abs((uint64_t) pRegisters->m_cx->m_pAddress)); break;
-		case DX: a.mov(dx, word_ptr_abs((uint64_t) pRegisters->m_dx->m_pAddress)); break;
-		case BX: a.mov(bx, word_ptr_abs((uint64_t) pRegisters->m_bx->m_pAddress)); break;
-		case SP: a.mov(sp, word_ptr_abs((uint64_t) pRegisters->m_sp->m_pAddress)); break;
-		case BP: a.mov(bp, word_ptr_abs((uint64_t) pRegisters->m_bp->m_pAddress)); break;
-		case SI: a.mov(si, word_ptr_abs((uint64_t) pRegisters->m_si->m_pAddress)); break;
-		case DI: a.mov(di, word_ptr_abs((uint64_t) pRegisters->m_di->m_pAddress)); break;
-
-		// ========================================================================
-		// >> 32-bit General purpose registers
-		// ========================================================================
-		case EAX: a.mov(eax, dword_ptr_abs((uint64_t) pRegisters->m_eax->m_pAddress)); break;
-		case ECX: a.mov(ecx, dword_ptr_abs((uint64_t) pRegisters->m_ecx->m_pAddress)); break;
-		case EDX: a.mov(edx, dword_ptr_abs((uint64_t) pRegisters->m_edx->m_pAddress)); break;
-		case EBX: a.mov(ebx, dword_ptr_abs((uint64_t) pRegisters->m_ebx->m_pAddress)); break;
-		case ESP: a.mov(esp, dword_ptr_abs((uint64_t) pRegisters->m_esp->m_pAddress)); break;
-		case EBP: a.mov(ebp, dword_ptr_abs((uint64_t) pRegisters->m_ebp->m_pAddress)); break;
-		case ESI: a.mov(esi, dword_ptr_abs((uint64_t) pRegisters->m_esi->m_pAddress)); break;
-		case EDI: a.mov(edi, dword_ptr_abs((uint64_t) pRegisters->m_edi->m_pAddress)); break;
-
-		// ========================================================================
-		// >> 64-bit MM (MMX) registers
-		// ========================================================================
-		case MM0: a.movq(mm0, dqword_ptr_abs((uint64_t) pRegisters->m_mm0->m_pAddress)); break;
-		case MM1: a.movq(mm1, dqword_ptr_abs((uint64_t) pRegisters->m_mm1->m_pAddress)); break;
-		case MM2: a.movq(mm2, dqword_ptr_abs((uint64_t) pRegisters->m_mm2->m_pAddress)); break;
-		case MM3: a.movq(mm3, dqword_ptr_abs((uint64_t) pRegisters->m_mm3->m_pAddress)); break;
-		case MM4: a.movq(mm4, dqword_ptr_abs((uint64_t) pRegisters->m_mm4->m_pAddress)); break;
-		case MM5: a.movq(mm5, dqword_ptr_abs((uint64_t) pRegisters->m_mm5->m_pAddress)); break;
-		case MM6: a.movq(mm6, dqword_ptr_abs((uint64_t) pRegisters->m_mm6->m_pAddress)); break;
-		case MM7: a.movq(mm7, dqword_ptr_abs((uint64_t) pRegisters->m_mm7->m_pAddress)); break;
-
-		// ========================================================================
-		// >> 128-bit XMM registers
-		// ========================================================================
-		// TODO: Also provide movups?
-		case XMM0: a.movaps(xmm0, dqword_ptr_abs((uint64_t) pRegisters->m_xmm0->m_pAddress)); break;
-		case XMM1: a.movaps(xmm1, dqword_ptr_abs((uint64_t) pRegisters->m_xmm1->m_pAddress)); break;
-		case XMM2: a.movaps(xmm2, dqword_ptr_abs((uint64_t) pRegisters->m_xmm2->m_pAddress)); break;
-		case XMM3: a.movaps(xmm3, dqword_ptr_abs((uint64_t) pRegisters->m_xmm3->m_pAddress)); break;
-		case XMM4: a.movaps(xmm4, dqword_ptr_abs((uint64_t) pRegisters->m_xmm4->m_pAddress)); break;
-		case XMM5: a.movaps(xmm5, dqword_ptr_abs((uint64_t) pRegisters->m_xmm5->m_pAddress)); break;
-		case XMM6: a.movaps(xmm6, dqword_ptr_abs((uint64_t) pRegisters->m_xmm6->m_pAddress)); break;
-		case XMM7: a.movaps(xmm7, dqword_ptr_abs((uint64_t) pRegisters->m_xmm7->m_pAddress)); break;
-
-		// ========================================================================
-		// >> 16-bit Segment registers
-		// ========================================================================
-		case CS: a.mov(cs, word_ptr_abs((uint64_t) pRegisters->m_cs->m_pAddress)); break;
-		case SS: a.mov(ss, word_ptr_abs((uint64_t) pRegisters->m_ss->m_pAddress)); break;
-		case DS: a.mov(ds, word_ptr_abs((uint64_t) pRegisters->m_ds->m_pAddress)); break;
-		case ES: a.mov(es, word_ptr_abs((uint64_t) pRegisters->m_es->m_pAddress)); break;
-		case FS: a.mov(fs, word_ptr_abs((uint64_t) pRegisters->m_fs->m_pAddress)); break;
-		case GS: a.mov(gs, word_ptr_abs((uint64_t) pRegisters->m_gs->m_pAddress)); break;
-
-		// ========================================================================
-		// >> 80-bit FPU registers
-		// ========================================================================
-		case ST0:
+			if (GetScratchGroup(*it) == SCRATCH_GROUP_ESP)
+				Write_RestoreRegister(a, GetScratchAlias(*it), ptr(zax, pLayout->GetOffset(*it), pLayout->GetRegister(*it)->m_iSize));
+		}
+
+		a.mov(zax, native_ptr(zsp, NATIVE_SIZE));
+		a.mov(native_ptr(zcx, -NATIVE_SIZE), zax);
+		a.mov(zax, native_ptr(zsp));
+		a.mov(native_ptr(zcx, -2 * NATIVE_SIZE), zax);
+		a.lea(zsp, native_ptr(zcx, -2 * NATIVE_SIZE));
+	}
+
+	a.pop(zcx);
+	a.pop(zax);
+}
+
+void CHook::Write_SaveRegister(x86::Assembler& a, Register_t reg, x86::Mem mem)
+{
+	switch(reg)
+	{
+	// ========================================================================
+	// >> 8-bit General purpose registers
+	// ========================================================================
+	case AL: a.mov(mem, al); break;
+	case CL: a.mov(mem, cl); break;
+	case DL: a.mov(mem, dl); break;
+	case BL: a.mov(mem, bl); break;
+
+	case AH: a.mov(mem, ah); break;
+	case CH: a.mov(mem, ch); break;
+	case DH: a.mov(mem, dh); break;
+	case BH: a.mov(mem, bh); break;
+
+	// ========================================================================
+	// >> 16-bit General purpose registers
+	// ========================================================================
+	case AX: a.mov(mem, ax); break;
+	case CX: a.mov(mem, cx); break;
+	case DX: a.mov(mem, dx); break;
+	case BX: a.mov(mem, bx); break;
+	case SP: a.mov(mem, sp); break;
+	case BP: a.mov(mem, bp); break;
+	case SI: a.mov(mem, si); break;
+	case DI: a.mov(mem, di); break;
+
+	// ========================================================================
+	// >> 32-bit General purpose registers
+	// ========================================================================
+	case EAX: a.mov(mem, eax); break;
+	case ECX: a.mov(mem, ecx); break;
+	case EDX: a.mov(mem, edx); break;
+	case EBX: a.mov(mem, ebx); break;
+	case ESP: a.mov(mem, esp); break;
+	case EBP: a.mov(mem, ebp); break;
+	case ESI: a.mov(mem, esi); break;
+	case EDI: a.mov(mem, edi); break;
+
+#ifdef DYNAMICHOOKS_X64
+	// ========================================================================
+	// >> 64-bit General purpose registers
+	// ========================================================================
+	case RAX: a.mov(mem, rax); break;
+	case RCX: a.mov(mem, rcx); break;
+	case RDX: a.mov(mem, rdx); break;
+	case RBX: a.mov(mem, rbx); break;
+	case RSP: a.mov(mem, rsp); break;
+	case RBP: a.mov(mem, rbp); break;
+	case RSI: a.mov(mem, rsi); break;
+	case RDI: a.mov(mem, rdi); break;
+	case R8: a.mov(mem, r8); break;
+	case R9: a.mov(mem, r9); break;
+	case R10: a.mov(mem, r10); break;
+	case R11: a.mov(mem, r11); break;
+	case R12: a.mov(mem, r12); break;
+	case R13: a.mov(mem, r13); break;
+	case R14: a.mov(mem, r14); break;
+	case R15: a.mov(mem, r15); break;
+#endif
+
+	// ========================================================================
+	// >> 64-bit MM (MMX) registers
+	// ========================================================================
+	case MM0: a.movq(mem, mm0); break;
+	case MM1: a.movq(mem, mm1); break;
+	case MM2: a.movq(mem, mm2); break;
+	case MM3: a.movq(mem, mm3); break;
+	case MM4: a.movq(mem, mm4); break;
+	case MM5: a.movq(mem, mm5); break;
+	case MM6: a.movq(mem, mm6); break;
+	case MM7: a.movq(mem, mm7); break;
+
+	// ========================================================================
+	// >> 128-bit XMM registers
+	// ========================================================================
+	// movups doesn't require the frame to be 16 byte aligned and is as fast
+	// as movaps on aligned memory
+	case XMM0: a.movups(mem, xmm0); break;
+	case XMM1: a.movups(mem, xmm1); break;
+	case XMM2: a.movups(mem, xmm2); break;
+	case XMM3: a.movups(mem, xmm3); break;
+	case XMM4: a.movups(mem, xmm4); break;
+	case XMM5: a.movups(mem, xmm5); break;
+	case XMM6: a.movups(mem, xmm6); break;
+	case XMM7: a.movups(mem, xmm7); break;
+#ifdef DYNAMICHOOKS_X64
+	case XMM8: a.movups(mem, xmm8); break;
+	case XMM9: a.movups(mem, xmm9); break;
+	case XMM10: a.movups(mem, xmm10); break;
+	case XMM11: a.movups(mem, xmm11); break;
+	case XMM12: a.movups(mem, xmm12); break;
+	case XMM13: a.movups(mem, xmm13); break;
+	case XMM14: a.movups(mem, xmm14); break;
+	case XMM15: a.movups(mem, xmm15); break;
+#endif
+
+	// ========================================================================
+	// >> 16-bit Segment registers
+	// ========================================================================
+	case CS: a.mov(mem, cs); break;
+	case SS: a.mov(mem, ss); break;
+	case DS: a.mov(mem, ds); break;
+	case ES: a.mov(mem, es); break;
+	case FS: a.mov(mem, fs); break;
+	case GS: a.mov(mem, gs); break;
+
+	// ========================================================================
+	// >> 80-bit FPU registers
+	// ========================================================================
+	case ST0:
+	{
+		switch(GetDataTypeSize(this->m_pCallingConvention->m_returnType))
 		{
-			switch(GetDataTypeSize(this->m_pCallingConvention->m_returnType))
-			{
-				case SIZE_DWORD: a.fld(dword_ptr_abs((uint64_t) pRegisters->m_st0->m_pAddress)); break;
-				case SIZE_QWORD: a.fld(qword_ptr_abs((uint64_t) pRegisters->m_st0->m_pAddress)); break;
-				case SIZE_TWORD: a.fld(tword_ptr_abs((uint64_t) pRegisters->m_st0->m_pAddress)); break;
-			}
-			break;
+			case SIZE_DWORD: a.fstp(mem.cloneResized(SIZE_DWORD)); break;
+			case SIZE_QWORD: a.fstp(mem.cloneResized(SIZE_QWORD)); break;
+			case SIZE_TWORD: a.fstp(mem.cloneResized(SIZE_TWORD)); break;
 		}
-		//case ST1: a.mov(st1, tword_ptr_abs(pRegisters->m_st1->m_pAddress)); break;
-		//case ST2: a.mov(st2, tword_ptr_abs(pRegisters->m_st2->m_pAddress)); break;
-		//case ST3: a.mov(st3, tword_ptr_abs(pRegisters->m_st3->m_pAddress)); break;
-		//case ST4: a.mov(st4, tword_ptr_abs(pRegisters->m_st4->m_pAddress)); break;
-		//case ST5: a.mov(st5, tword_ptr_abs(pRegisters->m_st5->m_pAddress)); break;
-		//case ST6: a.mov(st6, tword_ptr_abs(pRegisters->m_st6->m_pAddress)); break;
-		//case ST7: a.mov(st7, tword_ptr_abs(pRegisters->m_st7->m_pAddress)); break;
-
-		default: puts("Unsupported register.");
+		break;
+	}
+	//case ST1: a.mov(mem, st1); break;
+	//case ST2: a.mov(mem, st2); break;
+	//case ST3: a.mov(mem, st3); break;
+	//case ST4: a.mov(mem, st4); break;
+	//case ST5: a.mov(mem, st5); break;
+	//case ST6: a.mov(mem, st6); break;
+	//case ST7: a.mov(mem, st7); break;
+
+	default: puts("Unsupported register.");
+	}
+}
+
+void CHook::Write_RestoreRegister(x86::Assembler& a, Register_t reg, x86::Mem mem)
+{
+	switch(reg)
+	{
+	// ========================================================================
+	// >> 8-bit General purpose registers
+	// ========================================================================
+	case AL: a.mov(al, mem); break;
+	case CL: a.mov(cl, mem); break;
+	case DL: a.mov(dl, mem); break;
+	case BL: a.mov(bl, mem); break;
+
+	case AH: a.mov(ah, mem); break;
+	case CH: a.mov(ch, mem); break;
+	case DH: a.mov(dh, mem); break;
+	case BH: a.mov(bh, mem); break;
+
+	// ========================================================================
+	// >> 16-bit General purpose registers
+	// ========================================================================
+	case AX: a.mov(ax, mem); break;
+	case CX: a.mov(cx, mem); break;
+	case DX: a.mov(dx, mem); break;
+	case BX: a.mov(bx, mem); break;
+	case SP: a.mov(sp, mem); break;
+	case BP: a.mov(bp, mem); break;
+	case SI: a.mov(si, mem); break;
+	case DI: a.mov(di, mem); break;
+
+	// ========================================================================
+	// >> 32-bit General purpose registers
+	// ========================================================================
+	case EAX: a.mov(eax, mem); break;
+	case ECX: a.mov(ecx, mem); break;
+	case EDX: a.mov(edx, mem); break;
+	case EBX: a.mov(ebx, mem); break;
+	case ESP: a.mov(esp, mem); break;
+	case EBP: a.mov(ebp, mem); break;
+	case ESI: a.mov(esi, mem); break;
+	case EDI: a.mov(edi, mem); break;
+
+#ifdef DYNAMICHOOKS_X64
+	// ========================================================================
+	// >> 64-bit General purpose registers
+	// ========================================================================
+	case RAX: a.mov(rax, mem); break;
+	case RCX: a.mov(rcx, mem); break;
+	case RDX: a.mov(rdx, mem); break;
+	case RBX: a.mov(rbx, mem); break;
+	case RSP: a.mov(rsp, mem); break;
+	case RBP: a.mov(rbp, mem); break;
+	case RSI: a.mov(rsi, mem); break;
+	case RDI: a.mov(rdi, mem); break;
+	case R8: a.mov(r8, mem); break;
+	case R9: a.mov(r9, mem); break;
+	case R10: a.mov(r10, mem); break;
+	case R11: a.mov(r11, mem); break;
+	case R12: a.mov(r12, mem); break;
+	case R13: a.mov(r13, mem); break;
+	case R14: a.mov(r14, mem); break;
+	case R15: a.mov(r15, mem); break;
+#endif
+
+	// ========================================================================
+	// >> 64-bit MM (MMX) registers
+	// ========================================================================
+	case MM0: a.movq(mm0, mem); break;
+	case MM1: a.movq(mm1, mem); break;
+	case MM2: a.movq(mm2, mem); break;
+	case MM3: a.movq(mm3, mem); break;
+	case MM4: a.movq(mm4, mem); break;
+	case MM5: a.movq(mm5, mem); break;
+	case MM6: a.movq(mm6, mem); break;
+	case MM7: a.movq(mm7, mem); break;
+
+	// ========================================================================
+	// >> 128-bit XMM registers
+	// ========================================================================
+	case XMM0: a.movups(xmm0, mem); break;
+	case XMM1: a.movups(xmm1, mem); break;
+	case XMM2: a.movups(xmm2, mem); break;
+	case XMM3: a.movups(xmm3, mem); break;
+	case XMM4: a.movups(xmm4, mem); break;
+	case XMM5: a.movups(xmm5, mem); break;
+	case XMM6: a.movups(xmm6, mem); break;
+	case XMM7: a.movups(xmm7, mem); break;
+#ifdef DYNAMICHOOKS_X64
+	case XMM8: a.movups(xmm8, mem); break;
+	case XMM9: a.movups(xmm9, mem); break;
+	case XMM10: a.movups(xmm10, mem); break;
+	case XMM11: a.movups(xmm11, mem); break;
+	case XMM12: a.movups(xmm12, mem); break;
+	case XMM13: a.movups(xmm13, mem); break;
+	case XMM14: a.movups(xmm14, mem); break;
+	case XMM15: a.movups(xmm15, mem); break;
+#endif
+
+	// ========================================================================
+	// >> 16-bit Segment registers
+	// ========================================================================
+	case CS: a.mov(cs, mem); break;
+	case SS: a.mov(ss, mem); break;
+	case DS: a.mov(ds, mem); break;
+	case ES: a.mov(es, mem); break;
+	case FS: a.mov(fs, mem); break;
+	case GS: a.mov(gs, mem); break;
+
+	// ========================================================================
+	// >> 80-bit FPU registers
+	// ========================================================================
+	case ST0:
+	{
+		switch(GetDataTypeSize(this->m_pCallingConvention->m_returnType))
+		{
+			case SIZE_DWORD: a.fld(mem.cloneResized(SIZE_DWORD)); break;
+			case SIZE_QWORD: a.fld(mem.cloneResized(SIZE_QWORD)); break;
+			case SIZE_TWORD: a.fld(mem.cloneResized(SIZE_TWORD)); break;
 		}
+		break;
 	}
-}
\ No newline at end of file
+	//case ST1: a.mov(st1, mem); break;
+	//case ST2: a.mov(st2, mem); break;
+	//case ST3: a.mov(st3, mem); break;
+	//case ST4: a.mov(st4, mem); break;
+	//case ST5: a.mov(st5, mem); break;
+	//case ST6: a.mov(st6, mem); break;
+	//case ST7: a.mov(st7, mem); break;
+
+	default: puts("Unsupported register.");
+	}
+}
@@ -36,9 +36,13 @@
 // ============================================================================
 #include <list>
 #include <map>
+#include <vector>
+#include <mutex>
+#include <atomic>
 
 #include "registers.h"
 #include "convention.h"
+#include "native.h"
 
 #include "x86.h"
 
@@ -56,6 +60,43 @@ enum HookType_t
 };
 
 
+// ============================================================================
+// >> RegisterMode_t
+// ============================================================================
+enum RegisterMode_t
+{
+	// All threads save their registers to the same frame. This is the
+	// fastest mode, but the hooked function must not be called by multiple
+	// threads at the same time.
+	REGISTERMODE_SHARED,
+
+	// Every thread saves its registers to its own frame, which is loaded
+	// through the FS/GS segment register.
+	REGISTERMODE_THREAD,
+
+	// Every invocation saves its registers to a frame on the native stack
+	// below the return address. This also supports recursive functions and
+	// handlers that call the hooked function again.
+	REGISTERMODE_STACK
+};
+
+
+// ============================================================================
+// >> SampleMode_t
+// ============================================================================
+enum SampleMode_t
+{
+	// The callbacks are called on every call.
+	SAMPLEMODE_NONE,
+
+	// The callbacks are called on every Nth call of each thread.
+	SAMPLEMODE_INTERVAL,
+
+	// The callbacks are called with a given probability.
+	SAMPLEMODE_RATE
+};
+
+
 // ============================================================================
 // >> TYPEDEFS
 // ============================================================================
@@ -66,6 +107,65 @@ typedef bool (*HookHandlerFn)(HookType_t, CHook*);
 #define __cdecl
 #endif
 
+class CGracePeriod;
+class CPatchTransaction;
+class CCodeArena;
+
+
+// ============================================================================
+// >> CCallbackArray
+// ============================================================================
+/*
+An immutable array of hook handlers. Adding or removing a handler creates a
+new array.
+*/
+class CCallbackArray
+{
+public:
+	int m_iCount;
+	HookHandlerFn* m_pCallbacks[1];
+};
+
+
+// ============================================================================
+// >> CRetiredCode
+// ============================================================================
+/*
+Code and callbacks that have been replaced, but might still be used by other
+threads until the grace period has elapsed.
+*/
+class CRetiredCode
+{
+public:
+	void* m_pBridge;
+	void* m_pPostCallback;
+	CCallbackArray* m_pCallbacks;
+	CGracePeriod* m_pGracePeriod;
+};
+
+
+// ============================================================================
+// >> HookStats_t
+// ============================================================================
+// Number of buckets of the latency histogram
+#define HOOK_STATS_BUCKETS 64
+
+/*
+Statistics of a hook (see CHook::SetStatsEnabled). Bucket i of the latency
+histogram counts calls of the original function that took 2^i to 2^(i+1)-1
+TSC ticks. Bucket 0 also counts calls that took less than one tick.
+*/
+struct HookStats_t
+{
+	// Calls that have been passed to the bridge
+	unsigned long long m_iCalls;
+
+	// Calls that have been overridden by a pre-hook handler
+	unsigned long long m_iOverrides;
+
+	unsigned long long m_LatencyHistogram[HOOK_STATS_BUCKETS];
+};
+
 
 // ============================================================================
 // >> CLASSES
@@ -83,8 +183,18 @@ private:
 
 	@param <pConvention>:
 	The calling convention of <pFunc>.
+
+	@param <eRegisterMode>:
+	Defines where the registers are saved.
+
+	@param <pCodeArena>:
+	The arena that stores the generated code.
+
+	@param <pTransaction>:
+	If not NULL, the jump to the hook is added to it instead of being
+	written immediately.
 	*/
-	CHook(void* pFunc, ICallingConvention* pConvention);
+	CHook(void* pFunc, ICallingConvention* pConvention, RegisterMode_t eRegisterMode, CCodeArena* pCodeArena, CPatchTransaction* pTransaction=NULL);
 	~CHook();
 
 public:
@@ -111,27 +221,122 @@ public:
 	@param pFunc The hook handler that should be checked.
 	*/
 	bool IsCallbackRegistered(HookType_t type, HookHandlerFn* pFunc);
+
+	/*
+	Returns false if the hook couldn't be created. The function hasn't been
+	patched then.
+	*/
+	bool IsValid();
+
+	/*
+	Enables or disables the hook. A disabled hook restores the original
+	bytes of the function, but keeps its generated code and callbacks, so it
+	can be enabled again with a single patch.
+
+	@param bEnabled True to redirect the function to the hook again.
+
+	Returns false if the function couldn't be patched. The state doesn't
+	change then.
+	*/
+	bool SetEnabled(bool bEnabled);
+
+	/*
+	Returns true if the function is redirected to the hook.
+	*/
+	bool IsEnabled();
+
+	/*
+	Only calls the callbacks on every Nth call of each thread. All other
+	calls jump directly to the original function.
+
+	@param iInterval The number of calls per sampled call. 1 disables
+	sampling.
+	*/
+	void SetSampleInterval(int iInterval);
+
+	/*
+	Calls the callbacks with the given probability. All other calls jump
+	directly to the original function.
+
+	@param fRate The probability of a call to be sampled (0 < fRate <= 1). 1
+	disables sampling.
+	*/
+	void SetSampleRate(double fRate);
+
+	/*
+	Enables or disables the built-in statistics. The bridge counts calls and
+	overrides and measures the time spent in the original function with
+	rdtsc. Every thread only writes to its own counters, so no callback or
+	atomic instruction is required. If sampling is enabled, only sampled
+	calls are measured.
+
+	@param bEnabled True to collect statistics.
+	*/
+	void SetStatsEnabled(bool bEnabled);
+
+	/*
+	Returns the sum of the statistics of all threads. Counters of threads
+	that are calling the function at the same time might be slightly behind.
+	*/
+	HookStats_t GetStats();
 	
 	
 	/*
-	Return the CRegisters pointer based on m_bUsePreRegister. It returns
-	m_pRegisterPre in a pre-hook and m_pRegisterPost in a post-hook.
+	Return the CRegisters pointer of the current handler. It returns
+	m_pRegisterPre in a pre-hook and m_pRegisterPost in a post-hook. If the
+	hook uses REGISTERMODE_THREAD, the registers of the calling thread are
+	returned. If it uses REGISTERMODE_STACK, the registers of the current
+	invocation are returned.
 	*/
-	CRegisters* GetRegisters();
+	CRegisters* GetRegisters()
+	{
+		// The bridge stores the registers of the shared mode, so they only
+		// need a single load
+		if (m_eRegisterMode == REGISTERMODE_SHARED)
+			return m_pSharedRegisters;
+
+		return GetThreadRegisters();
+	}
+
+	/*
+	Returns a pointer to the argument at the given index. If the calling
+	convention has an argument location table, the argument is resolved
+	from the saved registers without calling the convention.
+	*/
+	void* GetArgumentPtr(int iIndex, CRegisters* pRegisters)
+	{
+		if (!m_pArgumentLocations)
+			return m_pCallingConvention->GetArgumentPtr(iIndex, pRegisters);
+
+		ArgumentLocation_t& location = m_pArgumentLocations[iIndex];
+		char* pValue = (char *) pRegisters->m_pFrame + pRegisters->m_Offsets[location.m_eRegister];
+		if (location.m_eRegister == ESP)
+			return (void *) (size_t) (*(unsigned int *) pValue + location.m_iOffset);
+
+#ifdef DYNAMICHOOKS_X64
+		if (location.m_eRegister == RSP)
+			return (void *) (*(size_t *) pValue + location.m_iOffset);
+#endif
+
+		return pValue;
+	}
 
 	template<class T>
 	T GetArgument(int iIndex)
 	{
-		return *(T *) m_pCallingConvention->GetArgumentPtr(iIndex, GetRegisters());
+		return *(T *) GetArgumentPtr(iIndex, GetRegisters());
 	}
 
 	template<class T>
 	void SetArgument(int iIndex, T value)
 	{
 		CRegisters* pRegisters = GetRegisters();
-		void* pPtr = m_pCallingConvention->GetArgumentPtr(iIndex, pRegisters);
+		void* pPtr = GetArgumentPtr(iIndex, pRegisters);
 		*(T *) pPtr = value;
-		m_pCallingConvention->ArgumentPtrChanged(iIndex, pRegisters, pPtr);
+
+		// Arguments with a fixed location don't need to be written back
+		if (!m_pArgumentLocations)
+			m_pCallingConvention->ArgumentPtrChanged(iIndex, pRegisters, pPtr);
 	}
 
 	template<class T>
@@ -150,46 +355,122 @@ public:
 	}
 
 private:
+	int GetCallbackCount(HookType_t type);
+	void SetCallbacks(HookType_t type, CCallbackArray* pCallbacks);
+	void UpdateBridge(CCallbackArray* pOldCallbacks);
+	CRegisters* GetThreadRegisters();
+	void ReleaseRetiredCode(bool bForce);
+	void ReleaseCode();
+
+	bool CreateEntries();
 	bool CreateBridge();
 
 	void Write_ModifyReturnAddress(asmjit::x86::Assembler& a);
-	void Write_CallHandler(asmjit::x86::Assembler& a, HookType_t type, CRegisters* pRegisters);
-	void Write_SaveRegisters(asmjit::x86::Assembler& a, CRegisters* pRegisters);
-	void Write_RestoreRegisters(asmjit::x86::Assembler& a, CRegisters* pRegisters);
+	void Write_Sample(asmjit::x86::Assembler& a, asmjit::Label& label_skip);
+	void Write_IncrementStat(asmjit::x86::Assembler& a, int iOffset);
+	void Write_StartTimer(asmjit::x86::Assembler& a);
+	void Write_StopTimer(asmjit::x86::Assembler& a);
+	void Write_CallHandler(asmjit::x86::Assembler& a, HookType_t type);
+	void Write_SaveRegisters(asmjit::x86::Assembler& a, HookType_t type);
+	void Write_RestoreRegisters(asmjit::x86::Assembler& a, HookType_t type);
 
-	bool CreatePostCallback();
+	void Write_SaveThreadRegisters(asmjit::x86::Assembler& a, HookType_t type);
+	void Write_RestoreThreadRegisters(asmjit::x86::Assembler& a, HookType_t type);
+	void Write_LoadThreadState(asmjit::x86::Assembler& a);
+	void Write_LoadThreadFrame(asmjit::x86::Assembler& a, HookType_t type);
+	int GetStackReserve();
 
-	bool __cdecl HookHandler(HookType_t type);
+	void Write_SaveRegister(asmjit::x86::Assembler& a, Register_t reg, asmjit::x86::Mem mem);
+	void Write_RestoreRegister(asmjit::x86::Assembler& a, Register_t reg, asmjit::x86::Mem mem);
 
-	void* __cdecl GetReturnAddress(void* pESP);
-	void __cdecl SetReturnAddress(void* pRetAddr, void* pESP);
+	void* CreatePostCallback();
 
 public:
-	std::map<HookType_t, std::list<HookHandlerFn*> > m_hookHandler;
+	// Registered callbacks indexed by HookType_t. They must only be read in a
+	// read section (see CGracePeriod).
+	std::atomic<CCallbackArray*> m_pCallbacks[2];
 
 	// Address of the original function
 	void* m_pFunc;
 
 	ICallingConvention* m_pCallingConvention;
 
-	// Address of the bridge
-	void* m_pBridge;
+	// Argument location table of the calling convention or NULL if it
+	// doesn't have one
+	ArgumentLocation_t* m_pArgumentLocations;
+
+	// Address of the entry. The function jumps to it and it jumps to the
+	// current bridge.
+	void* m_pEntry;
+
+	// Address the function jumps to. In 64-bit mode this is a jump to the
+	// entry in the trampoline slot, because the entry might be out of reach
+	// of a relative jump. Otherwise it's the entry itself.
+	void* m_pRelay;
+
+	// Address of the bridge. It's created again whenever a callback is added
+	// or removed.
+	std::atomic<void*> m_pBridge;
 
 	// Address of the trampoline
 	void* m_pTrampoline;
 
+	// Bytes of the function that have been replaced by the jump
+	std::vector<unsigned char> m_OriginalBytes;
+
+	// False if the original bytes have been restored by SetEnabled()
+	bool m_bEnabled;
+
+	// False if the trampoline or the generated code couldn't be created
+	bool m_bValid;
+
 	// Register storage
 	CRegisters* m_pRegistersPre;
 	CRegisters* m_pRegistersPost;
 
-	// New return address
+	// New return address. It jumps to the current post-hook code.
 	void* m_pNewRetAddr;
 
-	std::map<void*, std::vector<void*> > m_RetAddr;
+	// Address of the post-hook code
+	std::atomic<void*> m_pPostCallback;
+
+	// Exits of the bridge and the post-hook code. They leave the read section
+	// and live as long as the hook, because the replaceable code might be
+	// released as soon as the read section has been left.
+	void* m_pExitToFunction;
+	void* m_pExitToCaller;
+	void* m_pExitFromPost;
+
+	// Replaced code and callbacks that can't be released yet
+	std::list<CRetiredCode> m_RetiredCode;
+
+	// Serializes changes of the callbacks, the sampling policy, the
+	// statistics and SetEnabled()
+	std::mutex m_Mutex;
+
+	// m_pRegistersPre or m_pRegistersPost, depending on the handlers that are
+	// called in REGISTERMODE_SHARED
+	CRegisters* m_pSharedRegisters;
+
+	RegisterMode_t m_eRegisterMode;
+
+	// Sampling policy of the bridge
+	SampleMode_t m_eSampleMode;
+	int m_iSampleInterval;
+	double m_fSampleRate;
+
+	// True if the bridge collects statistics
+	bool m_bStats;
+
+	// Index of this hook in the hook state table of every thread
+	int m_iThreadSlot;
 
-	bool m_bUsePreRegisters;
+	// Links of the hook list of CHookManager
+	CHook* m_pPrevHook;
+	CHook* m_pNextHook;
 
-	asmjit::JitRuntime m_asmjit_rt;
+	// Owner of the generated code
+	CCodeArena* m_pCodeArena;
 };
 
 #endif // _HOOK_H
\ No newline at end of file
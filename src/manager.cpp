@@ -32,35 +32,327 @@
 // >> INCLUDES
 // ============================================================================
 #include "manager.h"
+#include "thread.h"
+#include "utilities.h"
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+// Initial capacity of the hook index
+#define HOOK_INDEX_MIN_CAPACITY 64
+
+
+// ============================================================================
+// >> CHookIndexTable
+// ============================================================================
+CHookIndexTable::CHookIndexTable(int iCapacity)
+{
+	m_iCapacity = iCapacity;
+	m_pSlots = new HookIndexSlot_t[iCapacity];
+	for(int i=0; i < iCapacity; i++)
+	{
+		m_pSlots[i].m_pFunc = NULL;
+		m_pSlots[i].m_pHook = NULL;
+	}
+}
+
+CHookIndexTable::~CHookIndexTable()
+{
+	delete[] m_pSlots;
+}
+
+
+// ============================================================================
+// >> CHookIndex
+// ============================================================================
+CHookIndex::CHookIndex()
+{
+	m_pTable = new CHookIndexTable(HOOK_INDEX_MIN_CAPACITY);
+	m_iCount = 0;
+	m_iTombstones = 0;
+}
+
+CHookIndex::~CHookIndex()
+{
+	ReleaseRetiredTables(true);
+	delete m_pTable.load();
+}
+
+CHook* CHookIndex::Find(void* pFunc)
+{
+	CHook* pResult = NULL;
+
+	EnterReadSection();
+	CHookIndexTable* pTable = m_pTable.load(std::memory_order_acquire);
+	unsigned int iMask = pTable->m_iCapacity - 1;
+
+	// The writer keeps at least a quarter of the slots empty, so the probing
+	// always ends.
+	for(unsigned int i=Hash(pFunc) & iMask; ; i=(i + 1) & iMask)
+	{
+		HookIndexSlot_t* pSlot = &pTable->m_pSlots[i];
+		void* pKey = pSlot->m_pFunc.load(std::memory_order_acquire);
+		if (pKey == NULL)
+			break;
+
+		if (pKey != pFunc)
+			continue;
+
+		// The slot might have been reused in the meantime. Only accept the
+		// hook if the key didn't change while we were loading it.
+		CHook* pHook = pSlot->m_pHook.load(std::memory_order_acquire);
+		if (pSlot->m_pFunc.load(std::memory_order_acquire) == pFunc)
+		{
+			pResult = pHook;
+			break;
+		}
+	}
+	LeaveReadSection();
+
+	return pResult;
+}
+
+void CHookIndex::Insert(CHook* pHook)
+{
+	ReleaseRetiredTables(false);
+
+	CHookIndexTable* pTable = m_pTable.load();
+	if ((m_iCount + m_iTombstones + 1) * 4 > pTable->m_iCapacity * 3)
+	{
+		// Grow the table if more than half of it would be used by hooks.
+		// Otherwise rebuilding it is enough to get rid of the tombstones.
+		int iCapacity = HOOK_INDEX_MIN_CAPACITY;
+		while (iCapacity < (m_iCount + 1) * 2)
+			iCapacity *= 2;
+
+		CHookIndexTable* pNewTable = new CHookIndexTable(iCapacity);
+		for(int i=0; i < pTable->m_iCapacity; i++)
+		{
+			CHook* pOldHook = pTable->m_pSlots[i].m_pHook.load();
+			if (pOldHook)
+				InsertSlot(pNewTable, pOldHook);
+		}
+
+		Publish(pNewTable);
+		pTable = pNewTable;
+		m_iTombstones = 0;
+	}
+
+	unsigned int iMask = pTable->m_iCapacity - 1;
+	unsigned int i = Hash(pHook->m_pFunc) & iMask;
+	while (true)
+	{
+		void* pKey = pTable->m_pSlots[i].m_pFunc.load();
+		if (pKey == NULL || pKey == HOOK_INDEX_TOMBSTONE)
+		{
+			if (pKey == HOOK_INDEX_TOMBSTONE)
+				m_iTombstones--;
+
+			break;
+		}
+		i = (i + 1) & iMask;
+	}
+
+	// Publish the hook before the key, so readers never see the key with the
+	// hook of a removed function.
+	pTable->m_pSlots[i].m_pHook.store(pHook, std::memory_order_release);
+	pTable->m_pSlots[i].m_pFunc.store(pHook->m_pFunc, std::memory_order_release);
+	m_iCount++;
+}
+
+void CHookIndex::Remove(void* pFunc)
+{
+	ReleaseRetiredTables(false);
+
+	CHookIndexTable* pTable = m_pTable.load();
+	unsigned int iMask = pTable->m_iCapacity - 1;
+	for(unsigned int i=Hash(pFunc) & iMask; ; i=(i + 1) & iMask)
+	{
+		HookIndexSlot_t* pSlot = &pTable->m_pSlots[i];
+		void* pKey = pSlot->m_pFunc.load();
+		if (pKey == NULL)
+			return;
+
+		if (pKey == pFunc)
+		{
+			// The slot can't be emptied, because it might be part of the probe
+			// sequence of another function.
+			pSlot->m_pHook.store(NULL, std::memory_order_release);
+			pSlot->m_pFunc.store(HOOK_INDEX_TOMBSTONE, std::memory_order_release);
+			m_iCount--;
+			m_iTombstones++;
+			return;
+		}
+	}
+}
+
+void CHookIndex::Clear()
+{
+	ReleaseRetiredTables(false);
+
+	Publish(new CHookIndexTable(HOOK_INDEX_MIN_CAPACITY));
+	m_iCount = 0;
+	m_iTombstones = 0;
+}
+
+void CHookIndex::Publish(CHookIndexTable* pTable)
+{
+	// Readers might still use the old table
+	CHookIndexTable* pOldTable = m_pTable.exchange(pTable, std::memory_order_acq_rel);
+	m_RetiredTables.push_back(std::make_pair(pOldTable, new CGracePeriod));
+}
+
+void CHookIndex::ReleaseRetiredTables(bool bForce)
+{
+	std::list<std::pair<CHookIndexTable*, CGracePeriod*> >::iterator it = m_RetiredTables.begin();
+	while (it != m_RetiredTables.end())
+	{
+		if (!bForce && !it->second->HasElapsed())
+		{
+			it++;
+			continue;
+		}
+
+		delete it->first;
+		delete it->second;
+		it = m_RetiredTables.erase(it);
+	}
+}
+
+unsigned int CHookIndex::Hash(void* pFunc)
+{
+	// Function addresses are often aligned, so the upper bits have to be
+	// mixed into the lower ones (MurmurHash3 finalizer).
+	unsigned int iHash = (unsigned int) (size_t) pFunc;
+	iHash ^= iHash >> 16;
+	iHash *= 0x85ebca6b;
+	iHash ^= iHash >> 13;
+	iHash *= 0xc2b2ae35;
+	iHash ^= iHash >> 16;
+	return iHash;
+}
+
+void CHookIndex::InsertSlot(CHookIndexTable* pTable, CHook* pHook)
+{
+	// Only used for tables that haven't been published yet
+	unsigned int iMask = pTable->m_iCapacity - 1;
+	unsigned int i = Hash(pHook->m_pFunc) & iMask;
+	while (pTable->m_pSlots[i].m_pFunc.load(std::memory_order_relaxed) != NULL)
+		i = (i + 1) & iMask;
+
+	pTable->m_pSlots[i].m_pHook.store(pHook, std::memory_order_relaxed);
+	pTable->m_pSlots[i].m_pFunc.store(pHook->m_pFunc, std::memory_order_relaxed);
+}
 
 
 // ============================================================================
 // >> CHookManager
 // ============================================================================
-CHook* CHookManager::HookFunction(void* pFunc, ICallingConvention* pConvention)
+CHookManager::CHookManager()
+{
+	m_pFirstHook = NULL;
+}
+
+CHook* CHookManager::HookFunction(void* pFunc, ICallingConvention* pConvention, RegisterMode_t eRegisterMode)
 {
 	if (!pFunc)
 		return NULL;
 
-	CHook* pHook = FindHook(pFunc);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ReleaseRetiredHooks();
+
+	CHook* pHook = m_Index.Find(pFunc);
 	if (pHook)
 	{
 		delete pConvention;
 		return pHook;
 	}
 	
-	pHook = new CHook(pFunc, pConvention);
-	m_Hooks.push_back(pHook);
+	pHook = new CHook(pFunc, pConvention, eRegisterMode, &m_CodeArena);
+	if (!pHook->IsValid())
+	{
+		delete pHook;
+		return NULL;
+	}
+
+	AddHook(pHook);
 	return pHook;
 }
 
+int CHookManager::HookFunctions(std::vector<HookRequest_t>& vecRequests)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ReleaseRetiredHooks();
+	CPatchTransaction transaction;
+
+	// Hooks that have been created by this call
+	std::vector<CHook*> vecNewHooks;
+
+	int iHooked = 0;
+	for(std::vector<HookRequest_t>::iterator it=vecRequests.begin(); it != vecRequests.end(); it++)
+	{
+		it->m_pHook = NULL;
+		if (!it->m_pFunc)
+		{
+			delete it->m_pConvention;
+			continue;
+		}
+
+		// The function might have been hooked before or by an earlier request
+		CHook* pHook = m_Index.Find(it->m_pFunc);
+		if (pHook)
+		{
+			delete it->m_pConvention;
+		}
+		else
+		{
+			pHook = new CHook(it->m_pFunc, it->m_pConvention, it->m_eRegisterMode, &m_CodeArena, &transaction);
+			if (!pHook->IsValid())
+			{
+				delete pHook;
+				continue;
+			}
+
+			AddHook(pHook);
+			vecNewHooks.push_back(pHook);
+		}
+
+		it->m_pHook = pHook;
+		iHooked++;
+	}
+
+	// Write all jumps
+	if (transaction.Commit())
+		return iHooked;
+
+	// Some jumps couldn't be written. Retiring the new hooks restores the
+	// functions that have been patched.
+	for(std::vector<CHook*>::iterator it=vecNewHooks.begin(); it != vecNewHooks.end(); it++)
+	{
+		RemoveHook(*it);
+		RetireHook(*it);
+	}
+
+	for(std::vector<HookRequest_t>::iterator it=vecRequests.begin(); it != vecRequests.end(); it++)
+		it->m_pHook = NULL;
+
+	return 0;
+}
+
 void CHookManager::UnhookFunction(void* pFunc)
 {
-	CHook* pHook = FindHook(pFunc);
+	if (!pFunc)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ReleaseRetiredHooks();
+
+	CHook* pHook = m_Index.Find(pFunc);
 	if (pHook)
 	{
-		m_Hooks.remove(pHook);
-		delete pHook;
+		RemoveHook(pHook);
+		RetireHook(pHook);
 	}
 }
 
@@ -69,21 +361,78 @@ CHook* CHookManager::FindHook(void* pFunc)
 	if (!pFunc)
 		return NULL;
 
-	for(std::list<CHook *>::iterator it=m_Hooks.begin(); it != m_Hooks.end(); it++)
+	return m_Index.Find(pFunc);
+}
+
+void CHookManager::UnhookAllFunctions()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	ReleaseRetiredHooks();
+	m_Index.Clear();
+
+	CHook* pHook = m_pFirstHook;
+	while (pHook)
 	{
-		CHook* pHook = *it;
-		if (pHook->m_pFunc == pFunc)
-			return pHook;
+		CHook* pNext = pHook->m_pNextHook;
+		RetireHook(pHook);
+		pHook = pNext;
 	}
-	return NULL;
+
+	m_pFirstHook = NULL;
 }
 
-void CHookManager::UnhookAllFunctions()
+void CHookManager::AddHook(CHook* pHook)
 {
-	for(std::list<CHook *>::iterator it=m_Hooks.begin(); it != m_Hooks.end(); it++)
-		delete *it;
+	pHook->m_pPrevHook = NULL;
+	pHook->m_pNextHook = m_pFirstHook;
+	if (m_pFirstHook)
+		m_pFirstHook->m_pPrevHook = pHook;
+
+	m_pFirstHook = pHook;
+	m_Index.Insert(pHook);
+}
+
+void CHookManager::RetireHook(CHook* pHook)
+{
+	// If the original bytes can't be restored, the function still jumps to
+	// the hook, so it's never deleted
+	if (!pHook->SetEnabled(false))
+		return;
+
+	// New calls run the original function from now on. Calls that are still
+	// running might use the trampoline, the generated code and the thread
+	// states until the grace period has elapsed.
+	m_RetiredHooks.push_back(std::make_pair(pHook, new CGracePeriod));
+}
+
+void CHookManager::ReleaseRetiredHooks()
+{
+	std::list<std::pair<CHook*, CGracePeriod*> >::iterator it = m_RetiredHooks.begin();
+	while (it != m_RetiredHooks.end())
+	{
+		if (!it->second->HasElapsed())
+		{
+			it++;
+			continue;
+		}
+
+		delete it->first;
+		delete it->second;
+		it = m_RetiredHooks.erase(it);
+	}
+}
+
+void CHookManager::RemoveHook(CHook* pHook)
+{
+	m_Index.Remove(pHook->m_pFunc);
+
+	if (pHook->m_pPrevHook)
+		pHook->m_pPrevHook->m_pNextHook = pHook->m_pNextHook;
+	else
+		m_pFirstHook = pHook->m_pNextHook;
 
-	m_Hooks.clear();
+	if (pHook->m_pNextHook)
+		pHook->m_pNextHook->m_pPrevHook = pHook->m_pPrevHook;
 }
 
 
@@ -35,8 +35,113 @@
 // >> INCLUDES
 // ============================================================================
 #include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
 #include "hook.h"
 #include "convention.h"
+#include "arena.h"
+
+
+// ============================================================================
+// >> CHookIndex
+// ============================================================================
+/*
+An entry of the hook index. m_pFunc is either NULL (never used), a function
+address or HOOK_INDEX_TOMBSTONE (removed).
+*/
+struct HookIndexSlot_t
+{
+	std::atomic<void*> m_pFunc;
+	std::atomic<CHook*> m_pHook;
+};
+
+#define HOOK_INDEX_TOMBSTONE ((void *) -1)
+
+/*
+A table of the hook index. The capacity is always a power of two.
+*/
+class CHookIndexTable
+{
+public:
+	CHookIndexTable(int iCapacity);
+	~CHookIndexTable();
+
+public:
+	int m_iCapacity;
+	HookIndexSlot_t* m_pSlots;
+};
+
+
+/*
+An open addressing hash table that maps function addresses to hooks.
+
+Lookups don't use locks and may run concurrently to one writer. Writers must
+be serialized by the caller. If the table grows, the old one is released
+after a grace period (see CGracePeriod).
+*/
+class CHookIndex
+{
+public:
+	CHookIndex();
+	~CHookIndex();
+
+	/*
+	Returns the hook of the given function or NULL.
+	*/
+	CHook* Find(void* pFunc);
+
+	/*
+	Adds the hook of a function that is not in the index yet.
+	*/
+	void Insert(CHook* pHook);
+
+	/*
+	Removes the hook of the given function.
+	*/
+	void Remove(void* pFunc);
+
+	/*
+	Removes all hooks.
+	*/
+	void Clear();
+
+private:
+	void Publish(CHookIndexTable* pTable);
+	void ReleaseRetiredTables(bool bForce);
+
+	static unsigned int Hash(void* pFunc);
+	static void InsertSlot(CHookIndexTable* pTable, CHook* pHook);
+
+private:
+	// The current table
+	std::atomic<CHookIndexTable*> m_pTable;
+
+	// Number of hooks and removed entries in the current table
+	int m_iCount;
+	int m_iTombstones;
+
+	// Replaced tables that can't be released yet
+	std::list<std::pair<CHookIndexTable*, CGracePeriod*> > m_RetiredTables;
+};
+
+
+// ============================================================================
+// >> HookRequest_t
+// ============================================================================
+/*
+A function that should be hooked by CHookManager::HookFunctions.
+*/
+struct HookRequest_t
+{
+	void* m_pFunc;
+	ICallingConvention* m_pConvention;
+	RegisterMode_t m_eRegisterMode;
+
+	// Result: The hook of the function or NULL if it couldn't be hooked
+	CHook* m_pHook;
+};
 
 
 // ============================================================================
@@ -45,30 +150,67 @@
 class CHookManager
 {
 public:
+	CHookManager();
+
 	/*
 	Hooks the given function and returns a new CHook instance. If the
 	function was already hooked, the existing CHook instance will be
-	returned.
+	returned. Returns NULL if the function couldn't be hooked.
+
+	Use REGISTERMODE_THREAD if the function is called by multiple threads
+	at the same time.
 	*/
-    CHook* HookFunction(void* pFunc, ICallingConvention* pConvention);
+    CHook* HookFunction(void* pFunc, ICallingConvention* pConvention, RegisterMode_t eRegisterMode=REGISTERMODE_SHARED);
 	
 	/*
-	Removes all callbacks and restores the original function.
+	Hooks all functions of the given requests and stores the hooks in them.
+	The jumps are written at once, so the protection of every page is only
+	changed once. Returns the number of hooked functions.
+
+	If a jump can't be written, all hooks that have been created by this
+	call are removed again, every m_pHook is NULL and 0 is returned.
+	*/
+	int HookFunctions(std::vector<HookRequest_t>& vecRequests);
+
+	/*
+	Restores the original function. The hook is deleted as soon as all calls
+	that are still running have returned (see CGracePeriod).
 	*/
     void UnhookFunction(void* pFunc);
 
 	/*
-	Returns either NULL or the found CHook instance.
+	Returns either NULL or the found CHook instance. This can be called by
+	multiple threads at the same time, but the returned hook is only valid
+	until the function is unhooked.
 	*/
 	CHook* FindHook(void* pFunc);
 
 	/*
-	Removes all callbacks and restores all functions.
+	Restores all functions. The hooks are deleted like in UnhookFunction().
 	*/
 	void UnhookAllFunctions();
 
+private:
+	void AddHook(CHook* pHook);
+	void RemoveHook(CHook* pHook);
+	void RetireHook(CHook* pHook);
+	void ReleaseRetiredHooks();
+
 public:
-	std::list<CHook *> m_Hooks;
+	// First hook of the list of all hooks (linked by CHook::m_pNextHook)
+	CHook* m_pFirstHook;
+
+	// Generated code of all hooks
+	CCodeArena m_CodeArena;
+
+private:
+	CHookIndex m_Index;
+
+	// Unhooked hooks that can't be deleted yet
+	std::list<std::pair<CHook*, CGracePeriod*> > m_RetiredHooks;
+
+	// Serializes hooking and unhooking
+	std::mutex m_Mutex;
 };
 
 
@@ -0,0 +1,101 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from
+* the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software in a
+* product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _NATIVE_H
+#define _NATIVE_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "x86.h"
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+#if defined __x86_64__ || defined _M_X64
+	#define DYNAMICHOOKS_X64
+#endif
+
+// Size of a pointer and of a stack slot
+#define NATIVE_SIZE ((int) sizeof(void *))
+
+
+// ============================================================================
+// >> REGISTERS
+// ============================================================================
+/*
+General purpose registers with the size of a pointer. The code generators use
+them for addresses and stack slots, so the same code works in 32-bit and
+64-bit builds.
+*/
+#ifdef DYNAMICHOOKS_X64
+	static const asmjit::x86::Gp zax = asmjit::x86::rax;
+	static const asmjit::x86::Gp zcx = asmjit::x86::rcx;
+	static const asmjit::x86::Gp zdx = asmjit::x86::rdx;
+	static const asmjit::x86::Gp zbx = asmjit::x86::rbx;
+	static const asmjit::x86::Gp zsp = asmjit::x86::rsp;
+	static const asmjit::x86::Gp zbp = asmjit::x86::rbp;
+
+	// First two integer arguments of the native calling convention
+	#ifdef _WIN32
+		static const asmjit::x86::Gp zarg0 = asmjit::x86::rcx;
+		static const asmjit::x86::Gp zarg1 = asmjit::x86::rdx;
+	#else
+		static const asmjit::x86::Gp zarg0 = asmjit::x86::rdi;
+		static const asmjit::x86::Gp zarg1 = asmjit::x86::rsi;
+	#endif
+#else
+	static const asmjit::x86::Gp zax = asmjit::x86::eax;
+	static const asmjit::x86::Gp zcx = asmjit::x86::ecx;
+	static const asmjit::x86::Gp zdx = asmjit::x86::edx;
+	static const asmjit::x86::Gp zbx = asmjit::x86::ebx;
+	static const asmjit::x86::Gp zsp = asmjit::x86::esp;
+	static const asmjit::x86::Gp zbp = asmjit::x86::ebp;
+#endif
+
+
+// ============================================================================
+// >> FUNCTIONS
+// ============================================================================
+/*
+Returns a pointer-sized memory operand.
+*/
+inline asmjit::x86::Mem native_ptr(const asmjit::x86::Gp& base, int32_t iOffset=0)
+{
+	return asmjit::x86::ptr(base, iOffset, NATIVE_SIZE);
+}
+
+inline asmjit::x86::Mem native_ptr(const asmjit::x86::Gp& base, const asmjit::x86::Gp& index, uint32_t iShift, int32_t iOffset=0)
+{
+	return asmjit::x86::ptr(base, index, iShift, iOffset, NATIVE_SIZE);
+}
+
+#endif // _NATIVE_H
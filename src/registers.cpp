@@ -28,354 +28,402 @@
 * Idea and trampoline code taken from DynDetours (thanks your-name-here).
 */
 
+#ifdef _WIN32
+	#include <malloc.h>
+#endif
+
 #include "registers.h"
 
-CRegisters::CRegisters(std::list<Register_t> registers)
-{	
+// ============================================================================
+// >> FUNCTIONS
+// ============================================================================
+int GetRegisterSize(Register_t reg)
+{
+	if (reg <= BH)
+		return SIZE_BYTE;
+
+	if (reg <= DI)
+		return SIZE_WORD;
+
+	if (reg <= EDI)
+		return SIZE_DWORD;
+
+	if (reg <= MM7)
+		return SIZE_QWORD;
+
+	if (reg <= XMM15)
+		return SIZE_XMMWORD;
+
+	if (reg <= GS)
+		return SIZE_WORD;
+
+	return SIZE_TWORD;
+}
+
+/*
+Returns the alignment of a register in the frame. FPU registers are padded
+to 16 bytes, so they don't break the alignment of the following registers.
+*/
+static int GetRegisterAlignment(Register_t reg)
+{
+	int iSize = GetRegisterSize(reg);
+	if (iSize == SIZE_TWORD)
+		return SIZE_XMMWORD;
+
+	return iSize;
+}
+
+static void* AllocFrame(int iSize)
+{
+#ifdef _WIN32
+	return _aligned_malloc(iSize, FRAME_ALIGNMENT);
+#else
+	void* pFrame = NULL;
+	if (posix_memalign(&pFrame, FRAME_ALIGNMENT, iSize) != 0)
+		return NULL;
+
+	return pFrame;
+#endif
+}
+
+static void FreeFrame(void* pFrame)
+{
+#ifdef _WIN32
+	_aligned_free(pFrame);
+#else
+	free(pFrame);
+#endif
+}
+
+
+// ============================================================================
+// >> CRegisters
+// ============================================================================
+CRegisters::CRegisters(std::list<Register_t> registers, void* pFrame, int iScratchSize)
+{
+	// Calculate the layout. The registers are placed in the order of their
+	// alignment, so no padding is required between them.
+	for(int i=0; i < REGISTER_COUNT; i++)
+		m_Offsets[i] = -1;
+
+	m_iFrameSize = 0;
+	for(int iAlignment=SIZE_XMMWORD; iAlignment >= SIZE_BYTE; iAlignment /= 2)
+	{
+		for(std::list<Register_t>::iterator it=registers.begin(); it != registers.end(); it++)
+		{
+			if (m_Offsets[*it] != -1 || GetRegisterAlignment(*it) != iAlignment)
+				continue;
+
+			m_Offsets[*it] = m_iFrameSize;
+			m_iFrameSize += iAlignment;
+		}
+	}
+
+	// The scratch area follows the registers
+	m_iScratchOffset = m_iFrameSize;
+	m_iFrameSize += iScratchSize;
+
+	m_iFrameSize = (m_iFrameSize + FRAME_ALIGNMENT - 1) & ~(FRAME_ALIGNMENT - 1);
+
+	// Either use the given frame or allocate our own
+	m_pOwnedFrame = pFrame ? NULL : AllocFrame(m_iFrameSize);
+	m_pFrame = pFrame ? pFrame : m_pOwnedFrame;
+
 	// ========================================================================
 	// >> 8-bit General purpose registers
 	// ========================================================================
-	m_al = CreateRegister(registers, AL, 1);
-	m_cl = CreateRegister(registers, CL, 1);
-	m_dl = CreateRegister(registers, DL, 1);
-	m_bl = CreateRegister(registers, BL, 1);
+	m_al = CreateRegister(AL);
+	m_cl = CreateRegister(CL);
+	m_dl = CreateRegister(DL);
+	m_bl = CreateRegister(BL);
 
 	// 64-bit mode only
 	/*
-	m_spl = CreateRegister(registers, SPL, 1);
-	m_bpl = CreateRegister(registers, BPL, 1);
-	m_sil = CreateRegister(registers, SIL, 1);
-	m_dil = CreateRegister(registers, DIL, 1);
-	m_r8b = CreateRegister(registers, R8B, 1);
-	m_r9b = CreateRegister(registers, R9B, 1);
-	m_r10b = CreateRegister(registers, R10B, 1);
-	m_r11b = CreateRegister(registers, R11B, 1);
-	m_r12b = CreateRegister(registers, R12B, 1);
-	m_r13b = CreateRegister(registers, R13B, 1);
-	m_r14b = CreateRegister(registers, R14B, 1);
-	m_r15b = CreateRegister(registers, R15B, 1);
+	m_spl = CreateRegister(SPL);
+	m_bpl = CreateRegister(BPL);
+	m_sil = CreateRegister(SIL);
+	m_dil = CreateRegister(DIL);
+	m_r8b = CreateRegister(R8B);
+	m_r9b = CreateRegister(R9B);
+	m_r10b = CreateRegister(R10B);
+	m_r11b = CreateRegister(R11B);
+	m_r12b = CreateRegister(R12B);
+	m_r13b = CreateRegister(R13B);
+	m_r14b = CreateRegister(R14B);
+	m_r15b = CreateRegister(R15B);
 	*/
 
-	m_ah = CreateRegister(registers, AH, 1);
-	m_ch = CreateRegister(registers, CH, 1);
-	m_dh = CreateRegister(registers, DH, 1);
-	m_bh = CreateRegister(registers, BH, 1);
+	m_ah = CreateRegister(AH);
+	m_ch = CreateRegister(CH);
+	m_dh = CreateRegister(DH);
+	m_bh = CreateRegister(BH);
 	
 	// ========================================================================
 	// >> 16-bit General purpose registers
 	// ========================================================================
-	m_ax = CreateRegister(registers, AX, 2);
-	m_cx = CreateRegister(registers, CX, 2);
-	m_dx = CreateRegister(registers, DX, 2);
-	m_bx = CreateRegister(registers, BX, 2);
-	m_sp = CreateRegister(registers, SP, 2);
-	m_bp = CreateRegister(registers, BP, 2);
-	m_si = CreateRegister(registers, SI, 2);
-	m_di = CreateRegister(registers, DI, 2);
+	m_ax = CreateRegister(AX);
+	m_cx = CreateRegister(CX);
+	m_dx = CreateRegister(DX);
+	m_bx = CreateRegister(BX);
+	m_sp = CreateRegister(SP);
+	m_bp = CreateRegister(BP);
+	m_si = CreateRegister(SI);
+	m_di = CreateRegister(DI);
 
 	// 64-bit mode only
 	/*
-	m_r8w = CreateRegister(registers, R8W, 2);
-	m_r9w = CreateRegister(registers, R9W, 2);
-	m_r10w = CreateRegister(registers, R10W, 2);
-	m_r11w = CreateRegister(registers, R11W, 2);
-	m_r12w = CreateRegister(registers, R12W, 2);
-	m_r13w = CreateRegister(registers, R13W, 2);
-	m_r14w = CreateRegister(registers, R14W, 2);
-	m_r15w = CreateRegister(registers, R14W, 2);
+	m_r8w = CreateRegister(R8W);
+	m_r9w = CreateRegister(R9W);
+	m_r10w = CreateRegister(R10W);
+	m_r11w = CreateRegister(R11W);
+	m_r12w = CreateRegister(R12W);
+	m_r13w = CreateRegister(R13W);
+	m_r14w = CreateRegister(R14W);
+	m_r15w = CreateRegister(R14W);
 	*/
 
 	// ========================================================================
 	// >> 32-bit General purpose registers
 	// ========================================================================
-	m_eax = CreateRegister(registers, EAX, 4);
-	m_ecx = CreateRegister(registers, ECX, 4);
-	m_edx = CreateRegister(registers, EDX, 4);
-	m_ebx = CreateRegister(registers, EBX, 4);
-	m_esp = CreateRegister(registers, ESP, 4);
-	m_ebp = CreateRegister(registers, EBP, 4);
-	m_esi = CreateRegister(registers, ESI, 4);
-	m_edi = CreateRegister(registers, EDI, 4);
+	m_eax = CreateRegister(EAX);
+	m_ecx = CreateRegister(ECX);
+	m_edx = CreateRegister(EDX);
+	m_ebx = CreateRegister(EBX);
+	m_esp = CreateRegister(ESP);
+	m_ebp = CreateRegister(EBP);
+	m_esi = CreateRegister(ESI);
+	m_edi = CreateRegister(EDI);
 
 	// 64-bit mode only
 	/*
-	m_r8d = CreateRegister(registers, R8D, 4);
-	m_r9d = CreateRegister(registers, R9D, 4);
-	m_r10d = CreateRegister(registers, R10D, 4);
-	m_r11d = CreateRegister(registers, R11D, 4);
-	m_r12d = CreateRegister(registers, R12D, 4);
-	m_r13d = CreateRegister(registers, R13D, 4);
-	m_r14d = CreateRegister(registers, R14D, 4);
-	m_r15d = CreateRegister(registers, R15D, 4);
+	m_r8d = CreateRegister(R8D);
+	m_r9d = CreateRegister(R9D);
+	m_r10d = CreateRegister(R10D);
+	m_r11d = CreateRegister(R11D);
+	m_r12d = CreateRegister(R12D);
+	m_r13d = CreateRegister(R13D);
+	m_r14d = CreateRegister(R14D);
+	m_r15d = CreateRegister(R15D);
 	*/
 
 	// ========================================================================
 	// >> 64-bit General purpose registers
 	// ========================================================================
-	// 64-bit mode only
-	/*
-	m_rax = CreateRegister(registers, RAX, 8);
-	m_rcx = CreateRegister(registers, RCX, 8);
-	m_rdx = CreateRegister(registers, RDX, 8);
-	m_rbx = CreateRegister(registers, RBX, 8);
-	m_rsp = CreateRegister(registers, RSP, 8);
-	m_rbp = CreateRegister(registers, RBP, 8);
-	m_rsi = CreateRegister(registers, RSI, 8);
-	m_rdi = CreateRegister(registers, RDI, 8);
-	*/
-	
-	// 64-bit mode only
-	/*
-	m_r8 = CreateRegister(registers, R8, 8);
-	m_r9 = CreateRegister(registers, R9, 8);
-	m_r10 = CreateRegister(registers, R10, 8);
-	m_r11 = CreateRegister(registers, R11, 8);
-	m_r12 = CreateRegister(registers, R12, 8);
-	m_r13 = CreateRegister(registers, R13, 8);
-	m_r14 = CreateRegister(registers, R14, 8);
-	m_r15 = CreateRegister(registers, R15, 8);
-	*/
+	m_rax = CreateRegister(RAX);
+	m_rcx = CreateRegister(RCX);
+	m_rdx = CreateRegister(RDX);
+	m_rbx = CreateRegister(RBX);
+	m_rsp = CreateRegister(RSP);
+	m_rbp = CreateRegister(RBP);
+	m_rsi = CreateRegister(RSI);
+	m_rdi = CreateRegister(RDI);
+
+	m_r8 = CreateRegister(R8);
+	m_r9 = CreateRegister(R9);
+	m_r10 = CreateRegister(R10);
+	m_r11 = CreateRegister(R11);
+	m_r12 = CreateRegister(R12);
+	m_r13 = CreateRegister(R13);
+	m_r14 = CreateRegister(R14);
+	m_r15 = CreateRegister(R15);
 
 	// ========================================================================
 	// >> 64-bit MM (MMX) registers
 	// ========================================================================
-	m_mm0 = CreateRegister(registers, MM0, 8);
-	m_mm1 = CreateRegister(registers, MM1, 8);
-	m_mm2 = CreateRegister(registers, MM2, 8);
-	m_mm3 = CreateRegister(registers, MM3, 8);
-	m_mm4 = CreateRegister(registers, MM4, 8);
-	m_mm5 = CreateRegister(registers, MM5, 8);
-	m_mm6 = CreateRegister(registers, MM6, 8);
-	m_mm7 = CreateRegister(registers, MM7, 8);
+	m_mm0 = CreateRegister(MM0);
+	m_mm1 = CreateRegister(MM1);
+	m_mm2 = CreateRegister(MM2);
+	m_mm3 = CreateRegister(MM3);
+	m_mm4 = CreateRegister(MM4);
+	m_mm5 = CreateRegister(MM5);
+	m_mm6 = CreateRegister(MM6);
+	m_mm7 = CreateRegister(MM7);
 
 	// ========================================================================
 	// >> 128-bit XMM registers
 	// ========================================================================
-	m_xmm0 = CreateRegister(registers, XMM0, 16);
-	m_xmm1 = CreateRegister(registers, XMM1, 16);
-	m_xmm2 = CreateRegister(registers, XMM2, 16);
-	m_xmm3 = CreateRegister(registers, XMM3, 16);
-	m_xmm4 = CreateRegister(registers, XMM4, 16);
-	m_xmm5 = CreateRegister(registers, XMM5, 16);
-	m_xmm6 = CreateRegister(registers, XMM6, 16);
-	m_xmm7 = CreateRegister(registers, XMM7, 16);
+	m_xmm0 = CreateRegister(XMM0);
+	m_xmm1 = CreateRegister(XMM1);
+	m_xmm2 = CreateRegister(XMM2);
+	m_xmm3 = CreateRegister(XMM3);
+	m_xmm4 = CreateRegister(XMM4);
+	m_xmm5 = CreateRegister(XMM5);
+	m_xmm6 = CreateRegister(XMM6);
+	m_xmm7 = CreateRegister(XMM7);
 
-	// 64-bit mode only
-	/*
-	m_xmm8 = CreateRegister(registers, XMM8, 16);
-	m_xmm9 = CreateRegister(registers, XMM9, 16);
-	m_xmm10 = CreateRegister(registers, XMM10, 16);
-	m_xmm11 = CreateRegister(registers, XMM11, 16);
-	m_xmm12 = CreateRegister(registers, XMM12, 16);
-	m_xmm13 = CreateRegister(registers, XMM13, 16);
-	m_xmm14 = CreateRegister(registers, XMM14, 16);
-	m_xmm15 = CreateRegister(registers, XMM15, 16);
-	*/
+	m_xmm8 = CreateRegister(XMM8);
+	m_xmm9 = CreateRegister(XMM9);
+	m_xmm10 = CreateRegister(XMM10);
+	m_xmm11 = CreateRegister(XMM11);
+	m_xmm12 = CreateRegister(XMM12);
+	m_xmm13 = CreateRegister(XMM13);
+	m_xmm14 = CreateRegister(XMM14);
+	m_xmm15 = CreateRegister(XMM15);
 
 	// ========================================================================
 	// >> 16-bit Segment registers
 	// ========================================================================
-	m_cs = CreateRegister(registers, CS, 2);
-	m_ss = CreateRegister(registers, SS, 2);
-	m_ds = CreateRegister(registers, DS, 2);
-	m_es = CreateRegister(registers, ES, 2);
-	m_fs = CreateRegister(registers, FS, 2);
-	m_gs = CreateRegister(registers, GS, 2);
+	m_cs = CreateRegister(CS);
+	m_ss = CreateRegister(SS);
+	m_ds = CreateRegister(DS);
+	m_es = CreateRegister(ES);
+	m_fs = CreateRegister(FS);
+	m_gs = CreateRegister(GS);
 	
 	// ========================================================================
 	// >> 80-bit FPU registers
 	// ========================================================================
-	m_st0 = CreateRegister(registers, ST0, 10);
-	m_st1 = CreateRegister(registers, ST1, 10);
-	m_st2 = CreateRegister(registers, ST2, 10);
-	m_st3 = CreateRegister(registers, ST3, 10);
-	m_st4 = CreateRegister(registers, ST4, 10);
-	m_st5 = CreateRegister(registers, ST5, 10);
-	m_st6 = CreateRegister(registers, ST6, 10);
-	m_st7 = CreateRegister(registers, ST7, 10);
+	m_st0 = CreateRegister(ST0);
+	m_st1 = CreateRegister(ST1);
+	m_st2 = CreateRegister(ST2);
+	m_st3 = CreateRegister(ST3);
+	m_st4 = CreateRegister(ST4);
+	m_st5 = CreateRegister(ST5);
+	m_st6 = CreateRegister(ST6);
+	m_st7 = CreateRegister(ST7);
 }
 
 CRegisters::~CRegisters()
 {
+	if (m_pOwnedFrame)
+		FreeFrame(m_pOwnedFrame);
+}
+
+void CRegisters::SetFrame(void* pFrame)
+{
+	m_pFrame = pFrame;
+	for(int i=0; i < REGISTER_COUNT; i++)
+	{
+		if (m_Offsets[i] != -1)
+			m_RegisterViews[i].m_pAddress = (void *) ((size_t) pFrame + m_Offsets[i]);
+	}
+}
+
+CRegister* CRegisters::GetRegister(Register_t reg)
+{
+	switch(reg)
+	{
 	// ========================================================================
 	// >> 8-bit General purpose registers
 	// ========================================================================
-	DeleteRegister(m_al);
-	DeleteRegister(m_cl);
-	DeleteRegister(m_dl);
-	DeleteRegister(m_bl);
-
-	// 64-bit mode only
-	/*
-	DeleteRegister(m_spl);
-	DeleteRegister(m_bpl);
-	DeleteRegister(m_sil);
-	DeleteRegister(m_dil);
-	DeleteRegister(m_r8b);
-	DeleteRegister(m_r9b);
-	DeleteRegister(m_r10b);
-	DeleteRegister(m_r11b);
-	DeleteRegister(m_r12b);
-	DeleteRegister(m_r13b);
-	DeleteRegister(m_r14b);
-	DeleteRegister(m_r15b);
-	*/
+	case AL: return m_al;
+	case CL: return m_cl;
+	case DL: return m_dl;
+	case BL: return m_bl;
+	case AH: return m_ah;
+	case CH: return m_ch;
+	case DH: return m_dh;
+	case BH: return m_bh;
 
-	DeleteRegister(m_ah);
-	DeleteRegister(m_ch);
-	DeleteRegister(m_dh);
-	DeleteRegister(m_bh);
-	
 	// ========================================================================
 	// >> 16-bit General purpose registers
 	// ========================================================================
-	DeleteRegister(m_ax);
-	DeleteRegister(m_cx);
-	DeleteRegister(m_dx);
-	DeleteRegister(m_bx);
-	DeleteRegister(m_sp);
-	DeleteRegister(m_bp);
-	DeleteRegister(m_si);
-	DeleteRegister(m_di);
-
-	// 64-bit mode only
-	/*
-	DeleteRegister(m_r8w);
-	DeleteRegister(m_r9w);
-	DeleteRegister(m_r10w);
-	DeleteRegister(m_r11w);
-	DeleteRegister(m_r12w);
-	DeleteRegister(m_r13w);
-	DeleteRegister(m_r14w);
-	DeleteRegister(m_r15w);
-	*/
+	case AX: return m_ax;
+	case CX: return m_cx;
+	case DX: return m_dx;
+	case BX: return m_bx;
+	case SP: return m_sp;
+	case BP: return m_bp;
+	case SI: return m_si;
+	case DI: return m_di;
 
 	// ========================================================================
 	// >> 32-bit General purpose registers
 	// ========================================================================
-	DeleteRegister(m_eax);
-	DeleteRegister(m_ecx);
-	DeleteRegister(m_edx);
-	DeleteRegister(m_ebx);
-	DeleteRegister(m_esp);
-	DeleteRegister(m_ebp);
-	DeleteRegister(m_esi);
-	DeleteRegister(m_edi);
-
-	// 64-bit mode only
-	/*
-	DeleteRegister(m_r8d);
-	DeleteRegister(m_r9d);
-	DeleteRegister(m_r10d);
-	DeleteRegister(m_r11d);
-	DeleteRegister(m_r12d);
-	DeleteRegister(m_r13d);
-	DeleteRegister(m_r14d);
-	DeleteRegister(m_r15d);
-	*/
+	case EAX: return m_eax;
+	case ECX: return m_ecx;
+	case EDX: return m_edx;
+	case EBX: return m_ebx;
+	case ESP: return m_esp;
+	case EBP: return m_ebp;
+	case ESI: return m_esi;
+	case EDI: return m_edi;
 
 	// ========================================================================
 	// >> 64-bit General purpose registers
 	// ========================================================================
-	// 64-bit mode only
-	/*
-	DeleteRegister(m_rax);
-	DeleteRegister(m_rcx);
-	DeleteRegister(m_rdx);
-	DeleteRegister(m_rbx);
-	DeleteRegister(m_rsp);
-	DeleteRegister(m_rbp);
-	DeleteRegister(m_rsi);
-	DeleteRegister(m_rdi);
-	*/
-	
-	// 64-bit mode only
-	/*
-	DeleteRegister(m_r8);
-	DeleteRegister(m_r9);
-	DeleteRegister(m_r10);
-	DeleteRegister(m_r11);
-	DeleteRegister(m_r12);
-	DeleteRegister(m_r13);
-	DeleteRegister(m_r14);
-	DeleteRegister(m_r15);
-	*/
+	case RAX: return m_rax;
+	case RCX: return m_rcx;
+	case RDX: return m_rdx;
+	case RBX: return m_rbx;
+	case RSP: return m_rsp;
+	case RBP: return m_rbp;
+	case RSI: return m_rsi;
+	case RDI: return m_rdi;
+
+	case R8: return m_r8;
+	case R9: return m_r9;
+	case R10: return m_r10;
+	case R11: return m_r11;
+	case R12: return m_r12;
+	case R13: return m_r13;
+	case R14: return m_r14;
+	case R15: return m_r15;
 
 	// ========================================================================
 	// >> 64-bit MM (MMX) registers
 	// ========================================================================
-	DeleteRegister(m_mm0);
-	DeleteRegister(m_mm1);
-	DeleteRegister(m_mm2);
-	DeleteRegister(m_mm3);
-	DeleteRegister(m_mm4);
-	DeleteRegister(m_mm5);
-	DeleteRegister(m_mm6);
-	DeleteRegister(m_mm7);
+	case MM0: return m_mm0;
+	case MM1: return m_mm1;
+	case MM2: return m_mm2;
+	case MM3: return m_mm3;
+	case MM4: return m_mm4;
+	case MM5: return m_mm5;
+	case MM6: return m_mm6;
+	case MM7: return m_mm7;
 
 	// ========================================================================
 	// >> 128-bit XMM registers
 	// ========================================================================
-	DeleteRegister(m_xmm0);
-	DeleteRegister(m_xmm1);
-	DeleteRegister(m_xmm2);
-	DeleteRegister(m_xmm3);
-	DeleteRegister(m_xmm4);
-	DeleteRegister(m_xmm5);
-	DeleteRegister(m_xmm6);
-	DeleteRegister(m_xmm7);
-
-	// 64-bit mode only
-	/*
-	DeleteRegister(m_xmm8);
-	DeleteRegister(m_xmm9);
-	DeleteRegister(m_xmm10);
-	DeleteRegister(m_xmm11);
-	DeleteRegister(m_xmm12);
-	DeleteRegister(m_xmm13);
-	DeleteRegister(m_xmm14);
-	DeleteRegister(m_xmm15);
-	*/
+	case XMM0: return m_xmm0;
+	case XMM1: return m_xmm1;
+	case XMM2: return m_xmm2;
+	case XMM3: return m_xmm3;
+	case XMM4: return m_xmm4;
+	case XMM5: return m_xmm5;
+	case XMM6: return m_xmm6;
+	case XMM7: return m_xmm7;
+	case XMM8: return m_xmm8;
+	case XMM9: return m_xmm9;
+	case XMM10: return m_xmm10;
+	case XMM11: return m_xmm11;
+	case XMM12: return m_xmm12;
+	case XMM13: return m_xmm13;
+	case XMM14: return m_xmm14;
+	case XMM15: return m_xmm15;
 
 	// ========================================================================
-	// >> 2-bit Segment registers
+	// >> 16-bit Segment registers
 	// ========================================================================
-	DeleteRegister(m_cs);
-	DeleteRegister(m_ss);
-	DeleteRegister(m_ds);
-	DeleteRegister(m_es);
-	DeleteRegister(m_fs);
-	DeleteRegister(m_gs);
-	
+	case CS: return m_cs;
+	case SS: return m_ss;
+	case DS: return m_ds;
+	case ES: return m_es;
+	case FS: return m_fs;
+	case GS: return m_gs;
+
 	// ========================================================================
 	// >> 80-bit FPU registers
 	// ========================================================================
-	DeleteRegister(m_st0);
-	DeleteRegister(m_st1);
-	DeleteRegister(m_st2);
-	DeleteRegister(m_st3);
-	DeleteRegister(m_st4);
-	DeleteRegister(m_st5);
-	DeleteRegister(m_st6);
-	DeleteRegister(m_st7);
-}
-
-CRegister* CRegisters::CreateRegister(std::list<Register_t>& registers, Register_t reg, int iSize)
-{
-	for(std::list<Register_t>::iterator it=registers.begin(); it != registers.end(); it++)
-	{
-		if ((*it) == reg)
-		{
-			return new CRegister(iSize);
-		}
+	case ST0: return m_st0;
+	case ST1: return m_st1;
+	case ST2: return m_st2;
+	case ST3: return m_st3;
+	case ST4: return m_st4;
+	case ST5: return m_st5;
+	case ST6: return m_st6;
+	case ST7: return m_st7;
 	}
 	return NULL;
 }
 
-void CRegisters::DeleteRegister(CRegister* pRegister)
+CRegister* CRegisters::CreateRegister(Register_t reg)
 {
-	if (pRegister)
-	{
-		delete pRegister;
-	}
-}
\ No newline at end of file
+	if (m_Offsets[reg] == -1)
+		return NULL;
+
+	CRegister* pRegister = &m_RegisterViews[reg];
+	pRegister->m_iSize = GetRegisterSize(reg);
+	pRegister->m_pAddress = (void *) ((size_t) m_pFrame + m_Offsets[reg]);
+	return pRegister;
+}
@@ -96,6 +96,27 @@ enum Register_t
 	ESI,
 	EDI,
 
+	// ========================================================================
+	// >> 64-bit General purpose registers (64-bit mode only)
+	// ========================================================================
+	RAX,
+	RCX,
+	RDX,
+	RBX,
+	RSP,
+	RBP,
+	RSI,
+	RDI,
+
+	R8,
+	R9,
+	R10,
+	R11,
+	R12,
+	R13,
+	R14,
+	R15,
+
 	// ========================================================================
 	// >> 64-bit MM (MMX) registers
 	// ========================================================================
@@ -120,6 +141,16 @@ enum Register_t
 	XMM6,
 	XMM7,
 
+	// 64-bit mode only
+	XMM8,
+	XMM9,
+	XMM10,
+	XMM11,
+	XMM12,
+	XMM13,
+	XMM14,
+	XMM15,
+
 	// ========================================================================
 	// >> 16-bit Segment registers
 	// ========================================================================
@@ -143,6 +174,22 @@ enum Register_t
 	ST7,
 };
 
+// Number of Register_t values
+#define REGISTER_COUNT (ST7 + 1)
+
+// Alignment and size granularity of a register frame. This is the size of a
+// cache line.
+#define FRAME_ALIGNMENT 64
+
+
+// ============================================================================
+// >> FUNCTIONS
+// ============================================================================
+/*
+Returns the number of bytes that are required to save the given register.
+*/
+int GetRegisterSize(Register_t reg);
+
 
 // ============================================================================
 // >> CRegister
@@ -150,15 +197,20 @@ enum Register_t
 class CRegister
 {
 public:
-	CRegister(int iSize)
+	CRegister()
 	{
-		m_iSize = iSize;
-		m_pAddress = malloc(iSize);
+		m_iSize = 0;
+		m_pAddress = NULL;
 	}
 
-	~CRegister()
+	/*
+	Creates a register that stores its value at the given address. The
+	storage is owned by CRegisters.
+	*/
+	CRegister(int iSize, void* pAddress)
 	{
-		free(m_pAddress);
+		m_iSize = iSize;
+		m_pAddress = pAddress;
 	}
 
 	template<class T>
@@ -170,7 +222,7 @@ public:
 	template<class T>
 	T GetPointerValue(int iOffset=0)
 	{
-		return *(T *) (GetValue<unsigned long>() + iOffset);
+		return *(T *) (GetValue<size_t>() + iOffset);
 	}
 
 	template<class T>
@@ -182,7 +234,7 @@ public:
 	template<class T>
 	void SetPointerValue(T value, int iOffset=0)
 	{
-		*(T *) (GetValue<unsigned long>() + iOffset) = value;
+		*(T *) (GetValue<size_t>() + iOffset) = value;
 	}
 
 public:
@@ -194,17 +246,80 @@ public:
 // ============================================================================
 // >> CRegisters
 // ============================================================================
+/*
+Saved registers are stored in a single frame. Only the given registers are
+part of it and every register is naturally aligned, so XMM registers can be
+accessed with aligned instructions. The frame is aligned to 64 bytes.
+*/
 class CRegisters
 {
 public:
-	CRegisters(std::list<Register_t> registers);
+	/*
+	@param <registers>:
+	The registers that should be saved.
+
+	@param <pFrame>:
+	Storage for the registers. It must be FRAME_ALIGNMENT aligned and at
+	least m_iFrameSize bytes big. If NULL, the frame will be allocated.
+
+	@param <iScratchSize>:
+	Number of bytes that are reserved after the registers. See GetScratch().
+	*/
+	CRegisters(std::list<Register_t> registers, void* pFrame=NULL, int iScratchSize=0);
 	~CRegisters();
 
+	/*
+	Moves all registers to another frame with the same layout. The frame that
+	has been allocated by the constructor is still freed by the destructor.
+	*/
+	void SetFrame(void* pFrame);
+
+	/*
+	Returns the CRegister object of the given register or NULL if the
+	register isn't saved.
+	*/
+	CRegister* GetRegister(Register_t reg);
+
+	/*
+	Returns the offset of the given register relative to the start of the
+	frame.
+	*/
+	int GetOffset(Register_t reg)
+	{
+		return m_Offsets[reg];
+	}
+
+	/*
+	Returns the scratch area of the frame. Calling conventions assemble
+	values in it that are split across multiple registers. It moves with the
+	frame, so every thread (or call in REGISTERMODE_STACK) has its own one.
+	*/
+	void* GetScratch()
+	{
+		return (void *) ((size_t) m_pFrame + m_iScratchOffset);
+	}
+
 private:
-	CRegister* CreateRegister(std::list<Register_t>& registers, Register_t reg, int iSize);
-	void DeleteRegister(CRegister* pRegister);
+	CRegister* CreateRegister(Register_t reg);
 
 public:
+	// All registers are stored in this block, so a copy of the frame can be
+	// addressed relative to its start.
+	void* m_pFrame;
+	int m_iFrameSize;
+
+	// Offset of the scratch area relative to the start of the frame
+	int m_iScratchOffset;
+
+	// The frame that has been allocated by the constructor
+	void* m_pOwnedFrame;
+
+	// Offset of every register in the frame or -1 if it isn't saved
+	int m_Offsets[REGISTER_COUNT];
+
+	// Storage of the CRegister objects below
+	CRegister m_RegisterViews[REGISTER_COUNT];
+
 	// ========================================================================
 	// >> 8-bit General purpose registers
 	// ========================================================================
@@ -241,6 +356,27 @@ public:
 	CRegister* m_esi;
 	CRegister* m_edi;
 
+	// ========================================================================
+	// >> 64-bit General purpose registers
+	// ========================================================================
+	CRegister* m_rax;
+	CRegister* m_rcx;
+	CRegister* m_rdx;
+	CRegister* m_rbx;
+	CRegister* m_rsp;
+	CRegister* m_rbp;
+	CRegister* m_rsi;
+	CRegister* m_rdi;
+
+	CRegister* m_r8;
+	CRegister* m_r9;
+	CRegister* m_r10;
+	CRegister* m_r11;
+	CRegister* m_r12;
+	CRegister* m_r13;
+	CRegister* m_r14;
+	CRegister* m_r15;
+
 	// ========================================================================
 	// >> 64-bit MM (MMX) registers
 	// ========================================================================
@@ -265,6 +401,15 @@ public:
 	CRegister* m_xmm6;
 	CRegister* m_xmm7;
 
+	CRegister* m_xmm8;
+	CRegister* m_xmm9;
+	CRegister* m_xmm10;
+	CRegister* m_xmm11;
+	CRegister* m_xmm12;
+	CRegister* m_xmm13;
+	CRegister* m_xmm14;
+	CRegister* m_xmm15;
+
 	// ========================================================================
 	// >> 16-bit Segment registers
 	// ========================================================================
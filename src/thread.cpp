@@ -0,0 +1,577 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from
+* the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software in a
+* product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#ifdef _WIN32
+	#include <windows.h>
+#elif defined __linux__
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <linux/membarrier.h>
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#include "thread.h"
+
+using namespace asmjit;
+using namespace asmjit::x86;
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+#if defined _WIN32 && defined DYNAMICHOOKS_X64
+	// Offset of TEB.TlsSlots and TEB.TlsExpansionSlots
+	#define TEB_TLS_SLOTS				0x1480
+	#define TEB_TLS_EXPANSION_SLOTS		0x1780
+	#define TEB_TLS_SLOT_COUNT			64
+#elif defined _WIN32
+	// Offset of TEB.TlsSlots and TEB.TlsExpansionSlots
+	#define TEB_TLS_SLOTS				0xE10
+	#define TEB_TLS_EXPANSION_SLOTS		0xF94
+	#define TEB_TLS_SLOT_COUNT			64
+#endif
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+#ifdef __linux__
+	// The initial-exec model guarantees a fixed offset to the thread pointer,
+	// so the bridges can access it with a single GS-relative load.
+	static __thread CThreadContext* s_pThreadContext __attribute__((tls_model("initial-exec"))) = NULL;
+#elif defined _WIN32
+	static DWORD s_dwThreadContextIndex = TlsAlloc();
+#endif
+
+// Guards the list of contexts and the slot allocation
+static std::mutex s_Mutex;
+static std::list<CThreadContext*> s_ThreadContexts;
+
+static std::vector<int> s_FreeSlots;
+static int s_iNextSlot = 0;
+
+// Statistics of threads that have exited, indexed by slot
+static std::vector<HookStats_t> s_ExitedStats;
+
+
+// ============================================================================
+// >> HookStats_t
+// ============================================================================
+static void AddHookStats(HookStats_t* pDest, const HookStats_t* pSource)
+{
+	pDest->m_iCalls += pSource->m_iCalls;
+	pDest->m_iOverrides += pSource->m_iOverrides;
+	for(int i=0; i < HOOK_STATS_BUCKETS; i++)
+		pDest->m_LatencyHistogram[i] += pSource->m_LatencyHistogram[i];
+}
+
+
+// ============================================================================
+// >> CThreadHookState
+// ============================================================================
+CThreadHookState::CThreadHookState(CHook* pHook)
+{
+	ICallingConvention* pConvention = pHook->m_pCallingConvention;
+	m_pRegistersPre = new CRegisters(pConvention->GetRegisters(), NULL, pConvention->GetScratchSize());
+	m_pRegistersPost = new CRegisters(pConvention->GetRegisters(), NULL, pConvention->GetScratchSize());
+	m_bUsePreRegisters = false;
+	m_pStackFrame = NULL;
+
+	// The first call is always sampled
+	m_iSampleCountdown = 0;
+	m_iRandomState = ((unsigned int) (size_t) this >> 4) | 1;
+
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+CThreadHookState::~CThreadHookState()
+{
+	delete m_pRegistersPre;
+	delete m_pRegistersPost;
+}
+
+
+// ============================================================================
+// >> CThreadContext
+// ============================================================================
+CThreadContext::CThreadContext()
+{
+	m_ppHookStates = NULL;
+	m_iHookStateCount = 0;
+
+	m_ReturnStack[0].m_pAddress = NULL;
+	m_ReturnStack[0].m_pStackPointer = (void *) -1;
+	m_ReturnStack[0].m_iTimestamp = 0;
+	m_pReturnStackTop = &m_ReturnStack[1];
+	m_pReturnStackEnd = &m_ReturnStack[RETURN_STACK_SIZE];
+	m_iReturnStackOverflows = 0;
+
+	m_iReadDepth = 0;
+	m_iQuiescentCount = 0;
+}
+
+CThreadContext::~CThreadContext()
+{
+	for(int i=0; i < m_iHookStateCount; i++)
+		delete m_ppHookStates[i];
+
+	free(m_ppHookStates);
+}
+
+CThreadHookState* CThreadContext::GetHookState(CHook* pHook)
+{
+	int iSlot = pHook->m_iThreadSlot;
+	if (iSlot < m_iHookStateCount && m_ppHookStates[iSlot])
+		return m_ppHookStates[iSlot];
+
+	// FreeThreadSlot() might walk the table from another thread
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	if (iSlot >= m_iHookStateCount)
+	{
+		int iNewCount = iSlot + 16;
+		m_ppHookStates = (CThreadHookState **) realloc(m_ppHookStates, iNewCount * sizeof(CThreadHookState *));
+		memset(m_ppHookStates + m_iHookStateCount, 0, (iNewCount - m_iHookStateCount) * sizeof(CThreadHookState *));
+		m_iHookStateCount = iNewCount;
+	}
+
+	m_ppHookStates[iSlot] = new CThreadHookState(pHook);
+	return m_ppHookStates[iSlot];
+}
+
+void CThreadContext::DeleteHookState(int iSlot)
+{
+	if (iSlot >= m_iHookStateCount)
+		return;
+
+	delete m_ppHookStates[iSlot];
+	m_ppHookStates[iSlot] = NULL;
+}
+
+
+// ============================================================================
+// >> CGracePeriod
+// ============================================================================
+/*
+Makes sure that all threads have executed a full memory barrier. Afterwards,
+all threads that have entered a read section before the barrier are visible
+and all other threads will see what has been published before.
+*/
+static void ProcessWideBarrier()
+{
+#ifdef __linux__
+	static bool s_bExpedited = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+	if (s_bExpedited && syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) == 0)
+		return;
+
+	// Older kernels: Revoking access to a page that has been touched sends an
+	// IPI to every CPU that runs a thread of this process.
+	static std::mutex s_PageMutex;
+	static char* s_pPage = (char *) mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	std::lock_guard<std::mutex> lock(s_PageMutex);
+	mprotect(s_pPage, sysconf(_SC_PAGESIZE), PROT_READ | PROT_WRITE);
+	*(volatile char *) s_pPage = 0;
+	mprotect(s_pPage, sysconf(_SC_PAGESIZE), PROT_NONE);
+#elif defined _WIN32
+	FlushProcessWriteBuffers();
+#endif
+}
+
+void SyncAllCores()
+{
+#if defined __linux__ && defined MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE
+	static bool s_bSyncCore = syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0) == 0;
+	if (s_bSyncCore && syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0) == 0)
+		return;
+#endif
+
+	// The other mechanisms interrupt all CPUs that run a thread of this
+	// process. Returning from the interrupt serializes the instruction stream.
+	ProcessWideBarrier();
+}
+
+CGracePeriod::CGracePeriod()
+{
+	ProcessWideBarrier();
+
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	for(std::list<CThreadContext *>::iterator it=s_ThreadContexts.begin(); it != s_ThreadContexts.end(); it++)
+	{
+		if ((*it)->m_iReadDepth == 0)
+			continue;
+
+		m_Contexts.push_back(*it);
+		m_QuiescentCounts.push_back((unsigned int) (*it)->m_iQuiescentCount);
+	}
+}
+
+bool CGracePeriod::HasElapsed()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	for(unsigned int i=0; i < m_Contexts.size(); i++)
+	{
+		// Contexts are removed when their thread exits
+		if (std::find(s_ThreadContexts.begin(), s_ThreadContexts.end(), m_Contexts[i]) == s_ThreadContexts.end())
+			continue;
+
+		if (m_Contexts[i]->m_iQuiescentCount == m_QuiescentCounts[i])
+			return false;
+	}
+	return true;
+}
+
+
+// ============================================================================
+// >> CThreadContextOwner
+// ============================================================================
+/*
+Deletes the context of a thread when the thread exits.
+*/
+class CThreadContextOwner
+{
+public:
+	CThreadContextOwner()
+	{
+		m_pContext = NULL;
+	}
+
+	~CThreadContextOwner()
+	{
+		if (!m_pContext)
+			return;
+
+		{
+			std::lock_guard<std::mutex> lock(s_Mutex);
+			s_ThreadContexts.remove(m_pContext);
+
+			// Keep the statistics of this thread
+			for(int i=0; i < m_pContext->m_iHookStateCount; i++)
+			{
+				CThreadHookState* pState = m_pContext->m_ppHookStates[i];
+				if (!pState)
+					continue;
+
+				if (i >= (int) s_ExitedStats.size())
+				{
+					HookStats_t empty;
+					memset(&empty, 0, sizeof(empty));
+					s_ExitedStats.resize(i + 1, empty);
+				}
+				AddHookStats(&s_ExitedStats[i], &pState->m_Stats);
+			}
+		}
+
+#ifdef __linux__
+		s_pThreadContext = NULL;
+#elif defined _WIN32
+		TlsSetValue(s_dwThreadContextIndex, NULL);
+#endif
+		delete m_pContext;
+	}
+
+public:
+	CThreadContext* m_pContext;
+};
+
+
+// ============================================================================
+// >> FUNCTIONS
+// ============================================================================
+CThreadContext* GetThreadContext()
+{
+#ifdef __linux__
+	CThreadContext* pContext = s_pThreadContext;
+#elif defined _WIN32
+	CThreadContext* pContext = (CThreadContext *) TlsGetValue(s_dwThreadContextIndex);
+#endif
+	if (pContext)
+		return pContext;
+
+	pContext = new CThreadContext;
+	{
+		std::lock_guard<std::mutex> lock(s_Mutex);
+		s_ThreadContexts.push_back(pContext);
+	}
+
+	static thread_local CThreadContextOwner s_Owner;
+	s_Owner.m_pContext = pContext;
+
+#ifdef __linux__
+	s_pThreadContext = pContext;
+#elif defined _WIN32
+	TlsSetValue(s_dwThreadContextIndex, pContext);
+#endif
+	return pContext;
+}
+
+CThreadHookState* __cdecl GetThreadHookState(CHook* pHook)
+{
+	return GetThreadContext()->GetHookState(pHook);
+}
+
+int AllocThreadSlot()
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	if (s_FreeSlots.empty())
+		return s_iNextSlot++;
+
+	int iSlot = s_FreeSlots.back();
+	s_FreeSlots.pop_back();
+	return iSlot;
+}
+
+void FreeThreadSlot(int iSlot)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	for(std::list<CThreadContext *>::iterator it=s_ThreadContexts.begin(); it != s_ThreadContexts.end(); it++)
+		(*it)->DeleteHookState(iSlot);
+
+	if (iSlot < (int) s_ExitedStats.size())
+		memset(&s_ExitedStats[iSlot], 0, sizeof(HookStats_t));
+
+	s_FreeSlots.push_back(iSlot);
+}
+
+void CollectHookStats(int iSlot, HookStats_t* pStats)
+{
+	std::lock_guard<std::mutex> lock(s_Mutex);
+	for(std::list<CThreadContext *>::iterator it=s_ThreadContexts.begin(); it != s_ThreadContexts.end(); it++)
+	{
+		CThreadContext* pContext = *it;
+		if (iSlot < pContext->m_iHookStateCount && pContext->m_ppHookStates[iSlot])
+			AddHookStats(pStats, &pContext->m_ppHookStates[iSlot]->m_Stats);
+	}
+
+	if (iSlot < (int) s_ExitedStats.size())
+		AddHookStats(pStats, &s_ExitedStats[iSlot]);
+}
+
+void EnterReadSection()
+{
+	CThreadContext* pContext = GetThreadContext();
+	pContext->m_iReadDepth++;
+
+	// The barrier of CGracePeriod takes care of the CPU
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+}
+
+void LeaveReadSection()
+{
+	std::atomic_signal_fence(std::memory_order_seq_cst);
+
+	CThreadContext* pContext = GetThreadContext();
+	if (--pContext->m_iReadDepth == 0)
+		pContext->m_iQuiescentCount++;
+}
+
+void __cdecl ReturnAddressNotFound()
+{
+	puts("Unable to find return address. You are going to crash now!");
+	abort();
+}
+
+void Write_LoadThreadContext(x86::Assembler& a, const x86::Gp& reg)
+{
+#ifdef __linux__
+	// %gs:0 (%fs:0 in 64-bit mode) holds the thread pointer. The context
+	// pointer is stored at a fixed offset from it.
+	unsigned long ulThreadPointer;
+#ifdef DYNAMICHOOKS_X64
+	asm("movq %%fs:0, %0" : "=r" (ulThreadPointer));
+	x86::SReg segment = fs;
+#else
+	asm("movl %%gs:0, %0" : "=r" (ulThreadPointer));
+	x86::SReg segment = gs;
+#endif
+
+	x86::Mem context = ptr_abs((uint64_t) (int64_t) (long) ((unsigned long) &s_pThreadContext - ulThreadPointer), NATIVE_SIZE);
+	context.setSegment(segment);
+	a.mov(reg, context);
+#elif defined _WIN32
+	// TlsGetValue() reads directly from the thread environment block
+#ifdef DYNAMICHOOKS_X64
+	x86::SReg segment = gs;
+#else
+	x86::SReg segment = fs;
+#endif
+	if (s_dwThreadContextIndex < TEB_TLS_SLOT_COUNT)
+	{
+		x86::Mem context = ptr_abs(TEB_TLS_SLOTS + s_dwThreadContextIndex * NATIVE_SIZE, NATIVE_SIZE);
+		context.setSegment(segment);
+		a.mov(reg, context);
+	}
+	else
+	{
+		Label label_done = a.newLabel();
+		x86::Mem slots = ptr_abs(TEB_TLS_EXPANSION_SLOTS, NATIVE_SIZE);
+		slots.setSegment(segment);
+		a.mov(reg, slots);
+		a.test(reg, reg);
+		a.jz(label_done);
+		a.mov(reg, native_ptr(reg, (s_dwThreadContextIndex - TEB_TLS_SLOT_COUNT) * NATIVE_SIZE));
+		a.bind(label_done);
+	}
+#endif
+}
+
+void Write_GetThreadContext(x86::Assembler& a)
+{
+	Label label_done = a.newLabel();
+
+	Write_LoadThreadContext(a, zax);
+	a.test(zax, zax);
+	a.jnz(label_done);
+
+	// Create the context
+	Write_CallFunction(a, (void *) &GetThreadContext);
+
+	a.bind(label_done);
+}
+
+void Write_CallFunction(x86::Assembler& a, void* pFunc, const Operand& arg0, const Operand& arg1)
+{
+	int iArgCount = arg1.isNone() ? (arg0.isNone() ? 0 : 1) : 2;
+
+#ifdef DYNAMICHOOKS_X64
+	// Preserve all registers that can hold arguments. Both ABIs use at most
+	// xmm0-7 for arguments. Functions declared with ms_abi also expect xmm6-15
+	// to be preserved, but a System V function might modify them.
+	static const x86::Gp preserved[] = {rcx, rdx, rsi, rdi, r8, r9, r10, r11};
+#ifdef _WIN32
+	const int iXmmCount = 8;
+#else
+	const int iXmmCount = 16;
+#endif
+	for(int i=0; i < 8; i++)
+		a.push(preserved[i]);
+
+	a.push(rbp);
+	a.mov(rbp, rsp);
+	a.and_(rsp, -16);
+	a.sub(rsp, iXmmCount * 16);
+	for(int i=0; i < iXmmCount; i++)
+		a.movaps(ptr(rsp, i * 16), xmm(i));
+
+	if (iArgCount > 0)
+		a.emit(Inst::kIdMov, zarg0, arg0);
+
+	if (iArgCount > 1)
+		a.emit(Inst::kIdMov, zarg1, arg1);
+
+#ifdef _WIN32
+	// Shadow space
+	a.sub(rsp, 32);
+	a.call(pFunc);
+	a.add(rsp, 32);
+#else
+	a.call(pFunc);
+#endif
+
+	for(int i=0; i < iXmmCount; i++)
+		a.movaps(xmm(i), ptr(rsp, i * 16));
+
+	a.mov(rsp, rbp);
+	a.pop(rbp);
+	for(int i=7; i >= 0; i--)
+		a.pop(preserved[i]);
+#else
+	// Preserve the scratch registers and align the stack to 16 bytes for
+	// Linux. vectorcall passes arguments via xmm0-5 and the called function
+	// might use xmm0-7.
+	a.push(ecx);
+	a.push(edx);
+	a.push(ebp);
+	a.mov(ebp, esp);
+	a.and_(esp, -16);
+	a.sub(esp, 8 * 16);
+	for(int i=0; i < 8; i++)
+		a.movaps(ptr(esp, i * 16), xmm(i));
+
+	if (iArgCount > 0)
+		a.sub(esp, 16 - iArgCount * 4);
+
+	if (iArgCount > 1)
+		a.emit(Inst::kIdPush, arg1);
+
+	if (iArgCount > 0)
+		a.emit(Inst::kIdPush, arg0);
+
+	a.call(pFunc);
+
+	// The arguments occupy 16 bytes below the saved xmm registers
+	int iXmmOffset = iArgCount > 0 ? 16 : 0;
+	for(int i=0; i < 8; i++)
+		a.movaps(xmm(i), ptr(esp, iXmmOffset + i * 16));
+
+	a.mov(esp, ebp);
+	a.pop(ebp);
+	a.pop(edx);
+	a.pop(ecx);
+#endif
+}
+
+void Write_EnterReadSection(x86::Assembler& a)
+{
+	a.push(zax);
+	Write_GetThreadContext(a);
+	a.inc(dword_ptr(zax, offsetof(CThreadContext, m_iReadDepth)));
+	a.pop(zax);
+}
+
+void Write_LeaveReadSection(x86::Assembler& a)
+{
+	a.push(zax);
+	Write_LoadThreadContext(a, zax);
+	Write_LeaveReadSection(a, zax);
+	a.pop(zax);
+}
+
+void Write_LeaveReadSection(x86::Assembler& a, const x86::Gp& context)
+{
+	Label label_done = a.newLabel();
+
+	a.dec(dword_ptr(context, offsetof(CThreadContext, m_iReadDepth)));
+	a.jnz(label_done);
+	a.inc(dword_ptr(context, offsetof(CThreadContext, m_iQuiescentCount)));
+	a.bind(label_done);
+}
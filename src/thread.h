@@ -0,0 +1,299 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from
+* the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software in a
+* product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _THREAD_H
+#define _THREAD_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include <vector>
+
+#include "hook.h"
+#include "registers.h"
+#include "native.h"
+
+#include "x86.h"
+
+
+// ============================================================================
+// >> DEFINITIONS
+// ============================================================================
+// Maximum number of nested hooked calls per thread
+#define RETURN_STACK_SIZE 1024
+
+
+// ============================================================================
+// >> ReturnAddress_t
+// ============================================================================
+/*
+An entry of the shadow return address stack.
+*/
+struct ReturnAddress_t
+{
+	// The original return address
+	void* m_pAddress;
+
+	// The stack pointer at the time the hooked function was called. This
+	// identifies the entry when the function returns.
+	void* m_pStackPointer;
+
+	// TSC when the original function was called or 0 if the hook doesn't
+	// collect statistics
+	unsigned long long m_iTimestamp;
+};
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+The state of a single hook that is private to one thread.
+*/
+class CThreadHookState
+{
+public:
+	CThreadHookState(CHook* pHook);
+	~CThreadHookState();
+
+public:
+	// Register storage of this thread
+	CRegisters* m_pRegistersPre;
+	CRegisters* m_pRegistersPost;
+
+	bool m_bUsePreRegisters;
+
+	// Frame of the current invocation in REGISTERMODE_STACK
+	void* m_pStackFrame;
+
+	// Number of calls until the next sampled call (see CHook::SetSampleInterval)
+	int m_iSampleCountdown;
+
+	// State of the random number generator for SAMPLEMODE_RATE
+	unsigned int m_iRandomState;
+
+	// Statistics of this thread (see CHook::SetStatsEnabled)
+	HookStats_t m_Stats;
+};
+
+
+/*
+Holds everything the bridges need to store per thread. A pointer to the
+context of the current thread can be loaded by generated code through the
+FS/GS segment register (see Write_LoadThreadContext).
+
+The shadow return address stack is shared by all hooks and only accessed by
+generated code:
+	- A bridge discards all entries that don't belong to a caller (their stack
+	  pointer is not above the current one). These belong to calls that have
+	  been left without returning, e.g. by longjmp() or an exception.
+	- If the stack is full, the return address is not redirected. The
+	  original function will still be called, but post-hooks are skipped for
+	  that call and m_iReturnStackOverflows is incremented.
+	- The post-hook code discards stale entries the same way and pops the
+	  entry that matches its stack pointer.
+	- Every entry counts as a read section until it's popped or discarded,
+	  so the code a call returns to isn't released while it's running.
+
+m_iReadDepth and m_iQuiescentCount are used to find out when replaced code,
+callback arrays and unhooked hooks are no longer used (see CGracePeriod).
+*/
+class CThreadContext
+{
+public:
+	CThreadContext();
+	~CThreadContext();
+
+	/*
+	Returns the state of the given hook. It will be created if it doesn't
+	exist yet.
+	*/
+	CThreadHookState* GetHookState(CHook* pHook);
+
+	/*
+	Deletes the state that is stored in the given slot.
+	*/
+	void DeleteHookState(int iSlot);
+
+public:
+	// Hook states indexed by CHook::m_iThreadSlot
+	CThreadHookState** m_ppHookStates;
+	int m_iHookStateCount;
+
+	// Next free entry and end of the shadow return address stack
+	ReturnAddress_t* m_pReturnStackTop;
+	ReturnAddress_t* m_pReturnStackEnd;
+	int m_iReturnStackOverflows;
+
+	// Number of read sections this thread is currently in. Whenever it drops
+	// to zero, m_iQuiescentCount is incremented.
+	volatile int m_iReadDepth;
+	volatile unsigned int m_iQuiescentCount;
+
+	// The first entry is a sentinel that belongs to every caller
+	ReturnAddress_t m_ReturnStack[RETURN_STACK_SIZE];
+};
+
+
+/*
+Finds out when memory that has been unpublished can be released.
+
+Generated code and callback arrays are only accessed in read sections. The
+entry stubs of a hook enter one before they load the current bridge or
+post-hook code. The code jumps to an exit stub of the hook, which leaves it
+and then jumps back to the hooked function or its caller. Read sections
+don't use locks or atomic instructions. Instead, a grace period starts with
+a process-wide memory barrier and then waits until every thread that was
+inside of a read section has left all of them at least once.
+
+Calls whose return address has been redirected stay in a read section until
+they have returned to the post-hook code. Their trampoline, new return
+address and post-hook code are only released after they have returned. If a
+hooked function is left with longjmp() or an exception, the read section is
+left as soon as the thread calls a hooked function again and the stale entry
+is discarded.
+
+A thread that leaves a hook handler with longjmp() or an exception never
+leaves its read section. Unpublished memory is then kept until the thread
+exits.
+*/
+class CGracePeriod
+{
+public:
+	/*
+	Starts the grace period. Everything that has been unpublished before
+	can be released as soon as HasElapsed() returns true.
+	*/
+	CGracePeriod();
+
+	/*
+	Returns true if no thread can use the unpublished memory anymore.
+	*/
+	bool HasElapsed();
+
+private:
+	// Threads that were inside of a read section and their quiescent count
+	std::vector<CThreadContext*> m_Contexts;
+	std::vector<unsigned int> m_QuiescentCounts;
+};
+
+
+// ============================================================================
+// >> FUNCTIONS
+// ============================================================================
+/*
+Returns the context of the current thread. It will be created if it doesn't
+exist yet.
+*/
+CThreadContext* GetThreadContext();
+
+/*
+Returns the state of the given hook for the current thread. This is also
+called by the bridges if the fast path can't find the state.
+*/
+CThreadHookState* __cdecl GetThreadHookState(CHook* pHook);
+
+/*
+Reserves a slot in the hook state table of every thread.
+*/
+int AllocThreadSlot();
+
+/*
+Releases the given slot and deletes the hook states of all threads that are
+stored in it.
+*/
+void FreeThreadSlot(int iSlot);
+
+/*
+Adds the statistics of all threads that are stored in the given slot,
+including the ones of threads that have already exited.
+*/
+void CollectHookStats(int iSlot, HookStats_t* pStats);
+
+/*
+Enters a read section in C++ code.
+*/
+void EnterReadSection();
+
+/*
+Leaves a read section in C++ code.
+*/
+void LeaveReadSection();
+
+/*
+Makes sure that all threads will see modified code the next time they
+execute it. This also implies a process-wide memory barrier.
+*/
+void SyncAllCores();
+
+/*
+Called by the post-hook code if the return address is missing from the
+shadow stack. This function doesn't return.
+*/
+void __cdecl ReturnAddressNotFound();
+
+/*
+Writes code that loads the context of the current thread into the given
+register. The register will be NULL if the thread doesn't have a context yet.
+*/
+void Write_LoadThreadContext(asmjit::x86::Assembler& a, const asmjit::x86::Gp& reg);
+
+/*
+Writes code that loads the context of the current thread into eax and creates
+it if necessary. No other register is modified.
+*/
+void Write_GetThreadContext(asmjit::x86::Assembler& a);
+
+/*
+Writes a call of a C function that takes up to two pointer arguments. The
+arguments can be registers or immediates. The stack is aligned and all
+registers that can hold arguments of the hooked function are preserved, so
+this can be used before they have been saved. The result is returned in eax.
+*/
+void Write_CallFunction(asmjit::x86::Assembler& a, void* pFunc,
+	const asmjit::Operand& arg0=asmjit::Operand(), const asmjit::Operand& arg1=asmjit::Operand());
+
+/*
+Writes code that enters a read section. Only the flags are modified.
+*/
+void Write_EnterReadSection(asmjit::x86::Assembler& a);
+
+/*
+Writes code that leaves a read section. Only the flags are modified.
+*/
+void Write_LeaveReadSection(asmjit::x86::Assembler& a);
+
+/*
+Like Write_LeaveReadSection, but the given register already holds the context
+of the current thread.
+*/
+void Write_LeaveReadSection(asmjit::x86::Assembler& a, const asmjit::x86::Gp& context);
+
+#endif // _THREAD_H
\ No newline at end of file
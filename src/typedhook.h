@@ -0,0 +1,405 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from
+* the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software in a
+* product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _TYPED_HOOK_H
+#define _TYPED_HOOK_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include <string.h>
+#include <vector>
+#include <type_traits>
+
+#include "manager.h"
+#include "conventions/x86MsCdecl.h"
+#include "conventions/x86MsThiscall.h"
+#include "conventions/x86MsStdcall.h"
+#include "conventions/x86MsFastcall.h"
+#include "conventions/x86GccRegparm.h"
+#include "conventions/x86GccFastcall.h"
+
+
+// ============================================================================
+// >> DataTypeOf
+// ============================================================================
+/*
+Maps a C++ type to its DataType_t value. Unsupported types don't compile.
+*/
+template<class T> struct DataTypeOf;
+
+template<> struct DataTypeOf<void>					{ static const DataType_t value = DATA_TYPE_VOID; };
+template<> struct DataTypeOf<bool>					{ static const DataType_t value = DATA_TYPE_BOOL; };
+template<> struct DataTypeOf<char>					{ static const DataType_t value = DATA_TYPE_CHAR; };
+template<> struct DataTypeOf<signed char>			{ static const DataType_t value = DATA_TYPE_CHAR; };
+template<> struct DataTypeOf<unsigned char>			{ static const DataType_t value = DATA_TYPE_UCHAR; };
+template<> struct DataTypeOf<short>					{ static const DataType_t value = DATA_TYPE_SHORT; };
+template<> struct DataTypeOf<unsigned short>		{ static const DataType_t value = DATA_TYPE_USHORT; };
+template<> struct DataTypeOf<int>					{ static const DataType_t value = DATA_TYPE_INT; };
+template<> struct DataTypeOf<unsigned int>			{ static const DataType_t value = DATA_TYPE_UINT; };
+template<> struct DataTypeOf<long>					{ static const DataType_t value = DATA_TYPE_LONG; };
+template<> struct DataTypeOf<unsigned long>			{ static const DataType_t value = DATA_TYPE_ULONG; };
+template<> struct DataTypeOf<long long>				{ static const DataType_t value = DATA_TYPE_LONG_LONG; };
+template<> struct DataTypeOf<unsigned long long>	{ static const DataType_t value = DATA_TYPE_ULONG_LONG; };
+template<> struct DataTypeOf<float>					{ static const DataType_t value = DATA_TYPE_FLOAT; };
+template<> struct DataTypeOf<double>				{ static const DataType_t value = DATA_TYPE_DOUBLE; };
+template<> struct DataTypeOf<char *>				{ static const DataType_t value = DATA_TYPE_STRING; };
+template<> struct DataTypeOf<const char *>			{ static const DataType_t value = DATA_TYPE_STRING; };
+template<class T> struct DataTypeOf<T *>			{ static const DataType_t value = DATA_TYPE_POINTER; };
+
+
+// ============================================================================
+// >> ConventionTraits
+// ============================================================================
+/*
+Describes how a calling convention passes arguments. Only integral and
+pointer arguments are passed in registers, floating point arguments are
+always pushed onto the stack:
+	- ARGUMENT_REGISTERS: number of argument registers. GetRegister() returns
+	  them in the order they are used.
+	- MAX_SPLIT_REGISTERS: number of registers a single argument can be
+	  split across. Larger arguments are pushed onto the stack.
+	- RESERVE_ON_OVERFLOW: if true, an integral argument that doesn't fit
+	  uses up the remaining registers (GCC). Otherwise, later arguments can
+	  still use them (MSVC).
+	- CALLEE_CLEANUP: true if the callee removes the stack arguments
+
+x86MsVectorcall, x64SystemV and x64MsFastcall also pass arguments in vector
+registers or use 8-byte stack slots, so they are not supported.
+*/
+template<class Convention> struct ConventionTraits
+{
+	static_assert(sizeof(Convention) == 0, "CTypedHook doesn't support this calling convention");
+};
+
+template<> struct ConventionTraits<x86MsCdecl>
+{
+	enum { ARGUMENT_REGISTERS = 0, MAX_SPLIT_REGISTERS = 0, RESERVE_ON_OVERFLOW = 0, CALLEE_CLEANUP = 0 };
+	static constexpr Register_t GetRegister(int i) { return ESP; }
+};
+
+template<> struct ConventionTraits<x86MsStdcall>
+{
+	enum { ARGUMENT_REGISTERS = 0, MAX_SPLIT_REGISTERS = 0, RESERVE_ON_OVERFLOW = 0, CALLEE_CLEANUP = 1 };
+	static constexpr Register_t GetRegister(int i) { return ESP; }
+};
+
+template<> struct ConventionTraits<x86MsThiscall>
+{
+	// The this pointer is always the first argument
+	enum { ARGUMENT_REGISTERS = 1, MAX_SPLIT_REGISTERS = 1, RESERVE_ON_OVERFLOW = 0, CALLEE_CLEANUP = 1 };
+	static constexpr Register_t GetRegister(int i) { return ECX; }
+};
+
+template<> struct ConventionTraits<x86MsFastcall>
+{
+	enum { ARGUMENT_REGISTERS = 2, MAX_SPLIT_REGISTERS = 1, RESERVE_ON_OVERFLOW = 0, CALLEE_CLEANUP = 1 };
+	static constexpr Register_t GetRegister(int i) { return i == 0 ? ECX : EDX; }
+};
+
+template<int N> struct ConventionTraits<x86GccRegparm<N> >
+{
+	enum { ARGUMENT_REGISTERS = N, MAX_SPLIT_REGISTERS = 3, RESERVE_ON_OVERFLOW = 1, CALLEE_CLEANUP = 0 };
+	static constexpr Register_t GetRegister(int i) { return i == 0 ? EAX : (i == 1 ? EDX : ECX); }
+};
+
+template<> struct ConventionTraits<x86GccFastcall>
+{
+	enum { ARGUMENT_REGISTERS = 2, MAX_SPLIT_REGISTERS = 1, RESERVE_ON_OVERFLOW = 1, CALLEE_CLEANUP = 1 };
+	static constexpr Register_t GetRegister(int i) { return i == 0 ? ECX : EDX; }
+};
+
+
+// ============================================================================
+// >> HELPERS
+// ============================================================================
+/*
+Returns the type of the argument at the given index.
+*/
+template<int I, class... Args> struct ArgumentType;
+
+template<class T, class... Rest> struct ArgumentType<0, T, Rest...>
+{
+	typedef T type;
+};
+
+template<int I, class T, class... Rest> struct ArgumentType<I, T, Rest...>
+{
+	typedef typename ArgumentType<I - 1, Rest...>::type type;
+};
+
+/*
+Returns the number of bytes the given type occupies on the stack.
+*/
+template<class T> struct StackSize
+{
+	enum { value = (sizeof(T) + 3) & ~3 };
+};
+
+/*
+Classifies the argument at index I. USED_REGISTERS is the number of
+registers that are used by the first I + 1 arguments.
+*/
+template<class Traits, int I, class... Args> struct ArgumentClass
+{
+	typedef typename ArgumentType<I, Args...>::type T;
+
+	enum
+	{
+		PREVIOUS_REGISTERS = ArgumentClass<Traits, I - 1, Args...>::USED_REGISTERS,
+		WORDS = StackSize<T>::value / 4,
+		INTEGRAL = !std::is_floating_point<T>::value,
+
+		IN_REGISTERS = INTEGRAL && WORDS <= Traits::MAX_SPLIT_REGISTERS &&
+			PREVIOUS_REGISTERS + WORDS <= Traits::ARGUMENT_REGISTERS,
+
+		// Index of the first register or -1 if the argument is on the stack
+		FIRST_REGISTER = IN_REGISTERS ? PREVIOUS_REGISTERS : -1,
+
+		USED_REGISTERS = IN_REGISTERS ? PREVIOUS_REGISTERS + WORDS :
+			(!INTEGRAL || !Traits::RESERVE_ON_OVERFLOW ? PREVIOUS_REGISTERS :
+			(PREVIOUS_REGISTERS + WORDS < Traits::ARGUMENT_REGISTERS ? PREVIOUS_REGISTERS + WORDS : Traits::ARGUMENT_REGISTERS))
+	};
+};
+
+template<class Traits, class... Args> struct ArgumentClass<Traits, -1, Args...>
+{
+	enum { USED_REGISTERS = 0 };
+};
+
+/*
+Returns the number of stack bytes that are occupied by the first I arguments.
+*/
+template<class Traits, int I, class... Args> struct StackOffset
+{
+	enum
+	{
+		value = StackOffset<Traits, I - 1, Args...>::value +
+			(ArgumentClass<Traits, I - 1, Args...>::IN_REGISTERS ? 0 : StackSize<typename ArgumentType<I - 1, Args...>::type>::value)
+	};
+};
+
+template<class Traits, class... Args> struct StackOffset<Traits, 0, Args...>
+{
+	enum { value = 0 };
+};
+
+/*
+Reads and writes return values. Floating point values are saved in st0,
+values up to 32 bits in eax and 64-bit values in eax and edx.
+*/
+template<class T, bool bFloat = std::is_floating_point<T>::value, bool bLarge = (sizeof(T) > 4)>
+struct ReturnValueAccessor
+{
+	static T* GetPtr(CRegisters* pRegisters) { return (T *) pRegisters->m_eax->m_pAddress; }
+	static T Get(CRegisters* pRegisters) { return *GetPtr(pRegisters); }
+	static void Set(CRegisters* pRegisters, T value) { *GetPtr(pRegisters) = value; }
+};
+
+template<class T, bool bLarge> struct ReturnValueAccessor<T, true, bLarge>
+{
+	static T* GetPtr(CRegisters* pRegisters) { return (T *) pRegisters->m_st0->m_pAddress; }
+	static T Get(CRegisters* pRegisters) { return *GetPtr(pRegisters); }
+	static void Set(CRegisters* pRegisters, T value) { *GetPtr(pRegisters) = value; }
+};
+
+template<class T> struct ReturnValueAccessor<T, false, true>
+{
+	static T Get(CRegisters* pRegisters)
+	{
+		// First half in eax, second half in edx
+		T value;
+		memcpy(&value, pRegisters->m_eax->m_pAddress, 4);
+		memcpy((char *) &value + 4, pRegisters->m_edx->m_pAddress, 4);
+		return value;
+	}
+
+	static void Set(CRegisters* pRegisters, T value)
+	{
+		memcpy(pRegisters->m_eax->m_pAddress, &value, 4);
+		memcpy(pRegisters->m_edx->m_pAddress, (char *) &value + 4, 4);
+	}
+};
+
+
+// ============================================================================
+// >> CTypedHook
+// ============================================================================
+/*
+A hook with a signature that is known at compile time. The argument types,
+stack offsets and the pop size are derived from the signature, so the
+accessors directly read from and write to the saved registers without
+calling into the calling convention.
+
+Example:
+	CTypedHook<x86GccCdecl, int(int, float)> hook = CTypedHook<x86GccCdecl, int(int, float)>::HookFunction((void *) &MyFunc);
+	hook.AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+
+	bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+	{
+		CTypedHook<x86GccCdecl, int(int, float)> hook(pHook);
+		float y = hook.GetArgument<1>();
+		...
+	}
+*/
+template<class Convention, class Signature> class CTypedHook;
+
+template<class Convention, class R, class... Args>
+class CTypedHook<Convention, R(Args...)>
+{
+public:
+	enum
+	{
+		ARGUMENT_COUNT = sizeof...(Args),
+		STACK_SIZE = StackOffset<ConventionTraits<Convention>, sizeof...(Args), Args...>::value,
+		POP_SIZE = ConventionTraits<Convention>::CALLEE_CLEANUP ? STACK_SIZE : 0
+	};
+
+	/*
+	Wraps an existing hook, e.g. the one that has been passed to a handler.
+	*/
+	CTypedHook(CHook* pHook)
+	{
+		m_pHook = pHook;
+	}
+
+	/*
+	Hooks the given function or returns the existing hook.
+
+	@param <pFunc>:
+	The address of the function to hook.
+
+	@param <eRegisterMode>:
+	Defines where the registers are saved.
+	*/
+	static CTypedHook HookFunction(void* pFunc, RegisterMode_t eRegisterMode=REGISTERMODE_SHARED)
+	{
+		// The last element avoids an empty array
+		DataType_t argTypes[] = {DataTypeOf<Args>::value..., DATA_TYPE_VOID};
+		std::vector<DataType_t> vecArgTypes(argTypes, argTypes + ARGUMENT_COUNT);
+
+		return CTypedHook(GetHookManager()->HookFunction(
+			pFunc,
+			new Convention(vecArgTypes, DataTypeOf<R>::value),
+			eRegisterMode
+		));
+	}
+
+	CHook* GetHook()
+	{
+		return m_pHook;
+	}
+
+	void AddCallback(HookType_t eHookType, HookHandlerFn* pCallback)
+	{
+		m_pHook->AddCallback(eHookType, pCallback);
+	}
+
+	void RemoveCallback(HookType_t eHookType, HookHandlerFn* pCallback)
+	{
+		m_pHook->RemoveCallback(eHookType, pCallback);
+	}
+
+	/*
+	Returns a pointer to the argument at the given index. Arguments that are
+	split across multiple registers don't have an address.
+	*/
+	template<int I>
+	typename ArgumentType<I, Args...>::type* GetArgumentPtr()
+	{
+		typedef typename ArgumentType<I, Args...>::type T;
+		typedef ArgumentClass<ConventionTraits<Convention>, I, Args...> Class;
+		static_assert(!Class::IN_REGISTERS || Class::WORDS == 1, "The argument is split across multiple registers");
+
+		return (T *) GetArgumentAddress<I>(m_pHook->GetRegisters());
+	}
+
+	template<int I>
+	typename ArgumentType<I, Args...>::type GetArgument()
+	{
+		typedef typename ArgumentType<I, Args...>::type T;
+		typedef ArgumentClass<ConventionTraits<Convention>, I, Args...> Class;
+		CRegisters* pRegisters = m_pHook->GetRegisters();
+
+		// Assemble split arguments from their registers
+		T value;
+		for(int i=0; i < (Class::IN_REGISTERS ? Class::WORDS : 1); i++)
+			memcpy((char *) &value + i * 4, GetArgumentAddress<I>(pRegisters, i), Class::IN_REGISTERS ? 4 : sizeof(T));
+
+		return value;
+	}
+
+	template<int I>
+	void SetArgument(typename ArgumentType<I, Args...>::type value)
+	{
+		typedef typename ArgumentType<I, Args...>::type T;
+		typedef ArgumentClass<ConventionTraits<Convention>, I, Args...> Class;
+		CRegisters* pRegisters = m_pHook->GetRegisters();
+
+		for(int i=0; i < (Class::IN_REGISTERS ? Class::WORDS : 1); i++)
+			memcpy(GetArgumentAddress<I>(pRegisters, i), (char *) &value + i * 4, Class::IN_REGISTERS ? 4 : sizeof(T));
+	}
+
+	template<class T=R>
+	T GetReturnValue()
+	{
+		return ReturnValueAccessor<T>::Get(m_pHook->GetRegisters());
+	}
+
+	template<class T=R>
+	void SetReturnValue(T value)
+	{
+		ReturnValueAccessor<T>::Set(m_pHook->GetRegisters(), value);
+	}
+
+private:
+	/*
+	Returns the address of the argument at the given index or of the given
+	word if it's split across multiple registers.
+	*/
+	template<int I>
+	void* GetArgumentAddress(CRegisters* pRegisters, int iWord=0)
+	{
+		typedef ConventionTraits<Convention> Traits;
+		typedef ArgumentClass<Traits, I, Args...> Class;
+
+		if (Class::IN_REGISTERS)
+			return (char *) pRegisters->m_pFrame + pRegisters->m_Offsets[Traits::GetRegister(Class::FIRST_REGISTER + iWord)];
+
+		// Skip the return address
+		return (void *) (size_t) (*(unsigned int *) ((char *) pRegisters->m_pFrame + pRegisters->m_Offsets[ESP]) + 4 +
+			StackOffset<Traits, I, Args...>::value);
+	}
+
+private:
+	CHook* m_pHook;
+};
+
+#endif // _TYPED_HOOK_H
@@ -31,40 +31,527 @@
 // ============================================================================
 // >> INCLUDES
 // ============================================================================
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+
 #ifdef _WIN32
 	#include <windows.h>
 #endif
 
 #ifdef __linux__
+	#include <signal.h>
+	#include <ucontext.h>
 	#include <sys/mman.h>
 	#include <unistd.h>
-	#define PAGE_SIZE 4096
-	#define ALIGN(ar) ((long)ar & ~(PAGE_SIZE-1))
 	#define PAGE_EXECUTE_READWRITE PROT_READ|PROT_WRITE|PROT_EXEC
 #endif
 
 #include "asm.h"
+#include "utilities.h"
+#include "thread.h"
 
 
 // ============================================================================
-// >> ParseParams
+// >> DEFINITIONS
 // ============================================================================
-void SetMemPatchable(void* pAddr, size_t size)
+#define OP_INT3 0xCC
+
+// Maximum number of patches that are written with breakpoints at once
+#define LIVE_PATCH_MAX 256
+
+
+// ============================================================================
+// >> Page protections
+// ============================================================================
+/*
+A range of pages with the same protection.
+*/
+struct MemoryRegion_t
+{
+	size_t m_iStart;
+	size_t m_iEnd;
+	unsigned int m_iProtection;
+};
+
+static size_t GetPageSize()
 {
 #if defined __linux__
-	mprotect((void *) ALIGN(pAddr), sysconf(_SC_PAGESIZE), PAGE_EXECUTE_READWRITE);
+	return sysconf(_SC_PAGESIZE);
+#elif defined _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+#endif
+}
+
+static bool IsWritable(unsigned int iProtection)
+{
+#if defined __linux__
+	return (iProtection & PROT_WRITE) != 0;
+#elif defined _WIN32
+	return iProtection == PAGE_READWRITE || iProtection == PAGE_EXECUTE_READWRITE;
+#endif
+}
+
+#ifdef __linux__
+// Cached parse of /proc/self/maps sorted by address. It's read again by every
+// transaction (see InvalidateRegions) and if it doesn't cover a patched page.
+static std::vector<MemoryRegion_t> s_Regions;
+static std::mutex s_RegionsMutex;
+
+static void LoadRegions()
+{
+	s_Regions.clear();
+
+	FILE* pFile = fopen("/proc/self/maps", "r");
+	if (!pFile)
+		return;
+
+	char szLine[512];
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		unsigned long iStart, iEnd;
+		char szPermissions[5];
+		if (sscanf(szLine, "%lx-%lx %4s", &iStart, &iEnd, szPermissions) != 3)
+			continue;
+
+		MemoryRegion_t region;
+		region.m_iStart = iStart;
+		region.m_iEnd = iEnd;
+		region.m_iProtection = PROT_NONE;
+		if (szPermissions[0] == 'r')
+			region.m_iProtection |= PROT_READ;
+		if (szPermissions[1] == 'w')
+			region.m_iProtection |= PROT_WRITE;
+		if (szPermissions[2] == 'x')
+			region.m_iProtection |= PROT_EXEC;
+
+		s_Regions.push_back(region);
+	}
+	fclose(pFile);
+}
+
+/*
+Makes sure that the protections are read again. Other code might have
+changed them since the last transaction.
+*/
+static void InvalidateRegions()
+{
+	std::lock_guard<std::mutex> lock(s_RegionsMutex);
+	s_Regions.clear();
+}
+
+/*
+Stores the cached regions that overlap the given range in <vecResult>.
+Returns false if a part of the range is not covered.
+*/
+static bool FindCachedRegions(size_t iStart, size_t iEnd, std::vector<MemoryRegion_t>& vecResult)
+{
+	vecResult.clear();
+
+	size_t iAddress = iStart;
+	std::vector<MemoryRegion_t>::iterator it = s_Regions.begin();
+	while (iAddress < iEnd)
+	{
+		while (it != s_Regions.end() && it->m_iEnd <= iAddress)
+			it++;
+
+		if (it == s_Regions.end() || it->m_iStart > iAddress)
+			return false;
+
+		vecResult.push_back(*it);
+		iAddress = it->m_iEnd;
+	}
+	return true;
+}
+#endif
+
+/*
+Returns the current protections of all pages in the given range. The
+regions are clipped to the range and neighbors with the same protection are
+merged. Returns false if a page is not mapped.
+*/
+static bool GetRegions(size_t iStart, size_t iEnd, std::vector<MemoryRegion_t>& vecResult)
+{
+	std::vector<MemoryRegion_t> vecRegions;
+
+#if defined __linux__
+	std::lock_guard<std::mutex> lock(s_RegionsMutex);
+	if (!FindCachedRegions(iStart, iEnd, vecRegions))
+	{
+		// The cache is outdated (e.g. a library has been loaded)
+		LoadRegions();
+		if (!FindCachedRegions(iStart, iEnd, vecRegions))
+			return false;
+	}
+#elif defined _WIN32
+	size_t iAddress = iStart;
+	while (iAddress < iEnd)
+	{
+		MEMORY_BASIC_INFORMATION info;
+		if (!VirtualQuery((void *) iAddress, &info, sizeof(info)) || info.State != MEM_COMMIT)
+			return false;
+
+		MemoryRegion_t region;
+		region.m_iStart = (size_t) info.BaseAddress;
+		region.m_iEnd = (size_t) info.BaseAddress + info.RegionSize;
+		region.m_iProtection = info.Protect;
+		vecRegions.push_back(region);
+		iAddress = region.m_iEnd;
+	}
+#endif
+
+	vecResult.clear();
+	for(std::vector<MemoryRegion_t>::iterator it=vecRegions.begin(); it != vecRegions.end(); it++)
+	{
+		MemoryRegion_t region = *it;
+		region.m_iStart = std::max(region.m_iStart, iStart);
+		region.m_iEnd = std::min(region.m_iEnd, iEnd);
+
+		if (!vecResult.empty() && vecResult.back().m_iProtection == region.m_iProtection)
+			vecResult.back().m_iEnd = region.m_iEnd;
+		else
+			vecResult.push_back(region);
+	}
+	return true;
+}
+
+static bool SetProtection(size_t iStart, size_t iEnd, unsigned int iProtection)
+{
+#if defined __linux__
+	return mprotect((void *) iStart, iEnd - iStart, iProtection) == 0;
 #elif defined _WIN32
 	DWORD old_prot;
-	VirtualProtect(pAddr, size, PAGE_EXECUTE_READWRITE, &old_prot);
+	return VirtualProtect((void *) iStart, iEnd - iStart, iProtection, &old_prot) != 0;
 #endif
 }
 
 
+// ============================================================================
+// >> Live patching
+// ============================================================================
+/*
+A code patch that is written with the breakpoint sequence.
+*/
+struct LivePatch_t
+{
+	unsigned char* m_pAddr;
+	void* m_pRedirect;
+};
+
+// Patches that are currently written. They are read by the trap handler.
+static LivePatch_t s_LivePatches[LIVE_PATCH_MAX];
+static volatile int s_iLivePatchCount = 0;
+static std::mutex s_LivePatchMutex;
+
+/*
+Handles a thread that has hit the breakpoint at <pAddr>. Returns the address
+it has to continue at or NULL if the breakpoint doesn't belong to a patch.
+*/
+static void* HandleBreakpoint(unsigned char* pAddr)
+{
+	int iCount = s_iLivePatchCount;
+	for(int i=0; i < iCount; i++)
+	{
+		if (s_LivePatches[i].m_pAddr == pAddr)
+			return s_LivePatches[i].m_pRedirect;
+	}
+
+	// The patch has been finished in the meantime, so execute the new code
+	if (*(volatile unsigned char *) pAddr != OP_INT3)
+		return pAddr;
+
+	return NULL;
+}
+
+#if defined __linux__
+#if defined __i386__
+	#define REG_INSTRUCTION_POINTER REG_EIP
+#else
+	#define REG_INSTRUCTION_POINTER REG_RIP
+#endif
+
+static struct sigaction s_OldTrapAction;
+
+static void TrapHandler(int iSignal, siginfo_t* pInfo, void* pContext)
+{
+	// int3 reports the address after the breakpoint
+	greg_t& ip = ((ucontext_t *) pContext)->uc_mcontext.gregs[REG_INSTRUCTION_POINTER];
+	if (pInfo->si_code == SI_KERNEL)
+	{
+		void* pTarget = HandleBreakpoint((unsigned char *) ip - 1);
+		if (pTarget)
+		{
+			ip = (greg_t) pTarget;
+			return;
+		}
+	}
+
+	// Not ours
+	if (s_OldTrapAction.sa_flags & SA_SIGINFO)
+	{
+		s_OldTrapAction.sa_sigaction(iSignal, pInfo, pContext);
+	}
+	else if (s_OldTrapAction.sa_handler != SIG_DFL && s_OldTrapAction.sa_handler != SIG_IGN)
+	{
+		s_OldTrapAction.sa_handler(iSignal);
+	}
+	else if (s_OldTrapAction.sa_handler == SIG_DFL)
+	{
+		signal(SIGTRAP, SIG_DFL);
+		raise(SIGTRAP);
+	}
+}
+#elif defined _WIN32
+static LONG CALLBACK TrapHandler(PEXCEPTION_POINTERS pInfo)
+{
+	if (pInfo->ExceptionRecord->ExceptionCode != EXCEPTION_BREAKPOINT)
+		return EXCEPTION_CONTINUE_SEARCH;
+
+	// The instruction pointer has already been moved back to the breakpoint
+#ifdef _WIN64
+	DWORD64& ip = pInfo->ContextRecord->Rip;
+#else
+	DWORD& ip = pInfo->ContextRecord->Eip;
+#endif
+	void* pTarget = HandleBreakpoint((unsigned char *) ip);
+	if (!pTarget)
+		return EXCEPTION_CONTINUE_SEARCH;
+
+	ip = (size_t) pTarget;
+	return EXCEPTION_CONTINUE_EXECUTION;
+}
+#endif
+
+static void InstallTrapHandler()
+{
+	static bool s_bInstalled = false;
+	if (s_bInstalled)
+		return;
+
+#if defined __linux__
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = TrapHandler;
+	action.sa_flags = SA_SIGINFO | SA_RESTART | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGTRAP, &action, &s_OldTrapAction);
+#elif defined _WIN32
+	AddVectoredExceptionHandler(1, TrapHandler);
+#endif
+	s_bInstalled = true;
+}
+
+/*
+Writes the patch with one atomic store if it fits into an aligned 8-Byte
+block. Returns false otherwise.
+*/
+static bool WriteAtomic(unsigned char* pAddr, const unsigned char* pData, int iSize)
+{
+	size_t iOffset = (size_t) pAddr & 7;
+	if (iOffset + iSize > 8)
+		return false;
+
+	volatile long long* pBlock = (volatile long long *) (pAddr - iOffset);
+	long long iOld = *pBlock;
+	while (true)
+	{
+		long long iNew = iOld;
+		memcpy((unsigned char *) &iNew + iOffset, pData, iSize);
+
+#if defined __linux__
+		long long iPrevious = __sync_val_compare_and_swap(pBlock, iOld, iNew);
+#elif defined _WIN32
+		long long iPrevious = InterlockedCompareExchange64(pBlock, iNew, iOld);
+#endif
+		if (iPrevious == iOld)
+			return true;
+
+		iOld = iPrevious;
+	}
+}
+
+
+// ============================================================================
+// >> ParseParams
+// ============================================================================
+void SetMemPatchable(void* pAddr, size_t size)
+{
+	// Cover every page of the range
+	size_t iPageSize = GetPageSize();
+	size_t iStart = (size_t) pAddr & ~(iPageSize - 1);
+	size_t iEnd = (((size_t) pAddr + size - 1) | (iPageSize - 1)) + 1;
+	SetProtection(iStart, iEnd, PAGE_EXECUTE_READWRITE);
+}
+
+
 // ============================================================================
 // >> WriteJMP
 // ============================================================================
-void WriteJMP(unsigned char* src, void* dest)
+bool WriteJMP(unsigned char* src, void* dest)
+{
+	CPatchTransaction transaction;
+	transaction.AddJMP(src, dest);
+	return transaction.Commit();
+}
+
+
+// ============================================================================
+// >> CPatchTransaction
+// ============================================================================
+void CPatchTransaction::AddJMP(void* pSrc, void* pDest)
+{
+	// Same encoding as inject_jmp(), but relative to the final address
+	unsigned char jmp[OP_JMP_SIZE];
+	int iOffset = (int) ((unsigned char *) pDest - ((unsigned char *) pSrc + OP_JMP_SIZE));
+	jmp[0] = OP_JMP;
+	memcpy(&jmp[1], &iOffset, sizeof(iOffset));
+	AddWrite(pSrc, jmp, OP_JMP_SIZE, pDest);
+}
+
+void CPatchTransaction::AddWrite(void* pAddr, const void* pData, int iSize, void* pRedirect)
+{
+	CPatch patch;
+	patch.m_pAddr = (unsigned char *) pAddr;
+	patch.m_Data.assign((unsigned char *) pData, (unsigned char *) pData + iSize);
+	patch.m_pRedirect = pRedirect;
+	m_Patches.push_back(patch);
+}
+
+bool CPatchTransaction::Commit()
+{
+	size_t iPageSize = GetPageSize();
+
+	// Collect the pages of all patches and merge adjacent ones, so every
+	// range of pages only needs one protection change.
+	std::vector<std::pair<size_t, size_t> > vecRanges;
+	for(std::vector<CPatch>::iterator it=m_Patches.begin(); it != m_Patches.end(); it++)
+	{
+		size_t iStart = (size_t) it->m_pAddr & ~(iPageSize - 1);
+		size_t iEnd = (((size_t) it->m_pAddr + it->m_Data.size() - 1) | (iPageSize - 1)) + 1;
+		vecRanges.push_back(std::make_pair(iStart, iEnd));
+	}
+	std::sort(vecRanges.begin(), vecRanges.end());
+
+	std::vector<std::pair<size_t, size_t> > vecMerged;
+	for(std::vector<std::pair<size_t, size_t> >::iterator it=vecRanges.begin(); it != vecRanges.end(); it++)
+	{
+		if (!vecMerged.empty() && it->first <= vecMerged.back().second)
+			vecMerged.back().second = std::max(vecMerged.back().second, it->second);
+		else
+			vecMerged.push_back(*it);
+	}
+
+	// Snapshot the protections and make the ranges writable. Ranges that are
+	// already writable are left alone.
+#ifdef __linux__
+	InvalidateRegions();
+#endif
+	bool bSuccess = true;
+	std::vector<bool> vecWritable(vecMerged.size());
+	std::vector<std::vector<MemoryRegion_t> > vecRestore(vecMerged.size());
+	for(size_t i=0; i < vecMerged.size(); i++)
+	{
+		std::vector<MemoryRegion_t> vecRegions;
+		if (!GetRegions(vecMerged[i].first, vecMerged[i].second, vecRegions))
+		{
+			bSuccess = false;
+			continue;
+		}
+
+		bool bWritable = true;
+		for(std::vector<MemoryRegion_t>::iterator it=vecRegions.begin(); it != vecRegions.end(); it++)
+		{
+			if (!IsWritable(it->m_iProtection))
+				bWritable = false;
+		}
+
+		if (!bWritable)
+		{
+			if (!SetProtection(vecMerged[i].first, vecMerged[i].second, PAGE_EXECUTE_READWRITE))
+			{
+				bSuccess = false;
+				continue;
+			}
+			vecRestore[i] = vecRegions;
+		}
+		vecWritable[i] = true;
+	}
+
+	// Write all patches whose pages are writable
+	std::vector<CPatch*> vecPatches;
+	for(std::vector<CPatch>::iterator it=m_Patches.begin(); it != m_Patches.end(); it++)
+	{
+		std::vector<std::pair<size_t, size_t> >::iterator range = std::upper_bound(
+			vecMerged.begin(), vecMerged.end(), std::make_pair((size_t) it->m_pAddr, (size_t) -1)) - 1;
+
+		if (vecWritable[range - vecMerged.begin()])
+			vecPatches.push_back(&*it);
+	}
+	WritePatches(vecPatches);
+
+	// Restore the original protections with one call per region
+	for(size_t i=0; i < vecMerged.size(); i++)
+	{
+		for(std::vector<MemoryRegion_t>::iterator it=vecRestore[i].begin(); it != vecRestore[i].end(); it++)
+			SetProtection(it->m_iStart, it->m_iEnd, it->m_iProtection);
+
+#ifdef _WIN32
+		if (vecWritable[i])
+			FlushInstructionCache(GetCurrentProcess(), (void *) vecMerged[i].first, vecMerged[i].second - vecMerged[i].first);
+#endif
+	}
+
+	m_Patches.clear();
+	return bSuccess;
+}
+
+void CPatchTransaction::WritePatches(std::vector<CPatch*>& vecPatches)
 {
-	SetMemPatchable(src, 20);
-	inject_jmp((void *)src, dest);
-}
\ No newline at end of file
+	// Data and patches that can be written atomically
+	std::vector<CPatch*> vecBreakpointPatches;
+	for(std::vector<CPatch*>::iterator it=vecPatches.begin(); it != vecPatches.end(); it++)
+	{
+		CPatch* pPatch = *it;
+		if (!pPatch->m_pRedirect)
+			memcpy(pPatch->m_pAddr, &pPatch->m_Data[0], pPatch->m_Data.size());
+		else if (!WriteAtomic(pPatch->m_pAddr, &pPatch->m_Data[0], (int) pPatch->m_Data.size()))
+			vecBreakpointPatches.push_back(pPatch);
+	}
+
+	// The others are written with the breakpoint sequence
+	for(size_t iFirst=0; iFirst < vecBreakpointPatches.size(); iFirst += LIVE_PATCH_MAX)
+	{
+		size_t iCount = std::min(vecBreakpointPatches.size() - iFirst, (size_t) LIVE_PATCH_MAX);
+		std::vector<CPatch*> vecBatch(vecBreakpointPatches.begin() + iFirst, vecBreakpointPatches.begin() + iFirst + iCount);
+
+		std::lock_guard<std::mutex> lock(s_LivePatchMutex);
+		InstallTrapHandler();
+
+		// Publish the redirects before the breakpoints
+		for(size_t i=0; i < iCount; i++)
+		{
+			s_LivePatches[i].m_pAddr = vecBatch[i]->m_pAddr;
+			s_LivePatches[i].m_pRedirect = vecBatch[i]->m_pRedirect;
+		}
+		s_iLivePatchCount = (int) iCount;
+
+		for(size_t i=0; i < iCount; i++)
+			*(volatile unsigned char *) vecBatch[i]->m_pAddr = OP_INT3;
+		SyncAllCores();
+
+		for(size_t i=0; i < iCount; i++)
+			memcpy(vecBatch[i]->m_pAddr + 1, &vecBatch[i]->m_Data[1], vecBatch[i]->m_Data.size() - 1);
+		SyncAllCores();
+
+		for(size_t i=0; i < iCount; i++)
+			*(volatile unsigned char *) vecBatch[i]->m_pAddr = vecBatch[i]->m_Data[0];
+		SyncAllCores();
+
+		// Threads that hit a breakpoint, but haven't been handled yet, will
+		// execute the new code
+		s_iLivePatchCount = 0;
+	}
+}
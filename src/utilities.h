@@ -31,10 +31,71 @@
 #ifndef _UTILITIES_H
 #define _UTILITIES_H
 
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include <stddef.h>
+#include <vector>
+
+
 // ============================================================================
 // >> FUNCTIONS
 // ============================================================================
 void SetMemPatchable(void* pAddr, size_t size);
-void WriteJMP(unsigned char* src, void* dest);
+bool WriteJMP(unsigned char* src, void* dest);
+
+
+// ============================================================================
+// >> CPatchTransaction
+// ============================================================================
+/*
+Collects code patches and writes them at once. The protection of every page
+is only changed once, no matter how many patches it contains.
+
+Code patches can be applied while other threads execute the code:
+	- If the patch fits into an aligned 8-Byte block, the whole block is
+	  replaced with one atomic store.
+	- Otherwise, the first byte is replaced with an int3 breakpoint, then the
+	  rest of the patch and finally the first byte are written. All cores are
+	  synchronized after every step. Threads that hit the breakpoint in the
+	  meantime continue at the redirect address of the patch.
+*/
+class CPatchTransaction
+{
+public:
+	/*
+	Adds a relative jump from <pSrc> to <pDest>. It's applied as a code
+	patch that redirects to <pDest>.
+	*/
+	void AddJMP(void* pSrc, void* pDest);
+
+	/*
+	Adds a patch that writes <iSize> bytes of <pData> to <pAddr>. If
+	<pRedirect> is not NULL, it's a code patch and threads that execute
+	<pAddr> while it's written continue at <pRedirect>. It has to behave like
+	the new instructions.
+	*/
+	void AddWrite(void* pAddr, const void* pData, int iSize, void* pRedirect=NULL);
+
+	/*
+	Makes the pages writable, writes all patches and restores the
+	protections. Returns false if a page couldn't be made writable. Its
+	patches are skipped.
+	*/
+	bool Commit();
+
+private:
+	class CPatch
+	{
+	public:
+		unsigned char* m_pAddr;
+		std::vector<unsigned char> m_Data;
+		void* m_pRedirect;
+	};
+
+	void WritePatches(std::vector<CPatch*>& vecPatches);
+
+	std::vector<CPatch> m_Patches;
+};
 
 #endif // _UTILITIES_H
\ No newline at end of file
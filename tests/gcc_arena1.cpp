@@ -0,0 +1,125 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <string.h>
+#include <set>
+
+#include "arena.h"
+
+using namespace asmjit;
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+#define CODE_COUNT 1000
+
+
+// ============================================================================
+// >> CCodeArena test
+// ============================================================================
+typedef int (*GetValueFn)();
+
+/*
+Adds a function that returns the given value. The NOPs create code of all
+size classes and a few large blocks.
+*/
+GetValueFn AddCode(CCodeArena* pArena, int iValue, int iPadding)
+{
+	CodeHolder code;
+	pArena->InitCode(&code);
+	x86::Assembler a(&code);
+
+	for(int i=0; i < iPadding; i++)
+		a.nop();
+
+	a.mov(x86::eax, iValue);
+	a.ret();
+	return (GetValueFn) pArena->Add(&code);
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CCodeArena arena;
+	GetValueFn pFunctions[CODE_COUNT];
+	std::set<void*> setAddresses;
+
+	for(int i=0; i < CODE_COUNT; i++)
+	{
+		pFunctions[i] = AddCode(&arena, i, (i * 37) % 3000);
+		assert(pFunctions[i] != NULL);
+
+		// Every block starts at its own cache line
+		assert(((size_t) pFunctions[i] & (CODE_ARENA_ALIGNMENT - 1)) == 0);
+		assert(setAddresses.insert((void *) pFunctions[i]).second);
+	}
+
+	for(int i=0; i < CODE_COUNT; i++)
+		assert(pFunctions[i]() == i);
+
+	// Released blocks are reused without touching the others
+	for(int i=0; i < CODE_COUNT; i += 2)
+		arena.Release((void *) pFunctions[i]);
+
+	for(int i=0; i < CODE_COUNT; i += 2)
+		pFunctions[i] = AddCode(&arena, -i, (i * 37) % 3000);
+
+	for(int i=0; i < CODE_COUNT; i++)
+		assert(pFunctions[i]() == (i % 2 ? i : -i));
+
+	// Trampolines get aligned slots in dedicated slabs
+	unsigned char* pTrampolines[CODE_COUNT];
+	unsigned char* pWritable;
+	for(int i=0; i < CODE_COUNT; i++)
+	{
+		pTrampolines[i] = arena.AllocTrampoline((void *) &AddCode, 5 + i % 40, &pWritable);
+		assert(pTrampolines[i] != NULL);
+		assert(((size_t) pTrampolines[i] & (TRAMPOLINE_SLOT_SIZE - 1)) == 0);
+		assert(setAddresses.insert(pTrampolines[i]).second);
+
+		// Writes through the writable view show up at the executable one
+		memset(pWritable, i & 0xFF, 5 + i % 40);
+		assert(pTrampolines[i][0] == (i & 0xFF));
+	}
+
+	// A freed trampoline is reused
+	arena.FreeTrampoline(pTrampolines[0]);
+	assert(arena.AllocTrampoline((void *) &AddCode, 5, &pWritable) == pTrampolines[0]);
+
+	return 0;
+}
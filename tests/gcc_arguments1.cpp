@@ -0,0 +1,175 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+#ifdef DYNAMICHOOKS_X64
+	// The this pointer is passed like the first argument
+	typedef x64SystemV NativeThiscall;
+#else
+	#include "conventions/x86GccThiscall.h"
+	typedef x86GccThiscall NativeThiscall;
+#endif
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iPreMyFuncCallCount = 0;
+int g_iArgumentPtrChangedCount = 0;
+
+
+// ============================================================================
+// >> Argument location table test
+// ============================================================================
+/*
+A calling convention without an argument location table. CHook has to use its
+virtual functions.
+*/
+class DynamicCdecl: public NativeCdecl
+{
+public:
+	DynamicCdecl(std::vector<DataType_t> vecArgTypes, DataType_t returnType):
+		NativeCdecl(vecArgTypes, returnType)
+	{
+		m_ArgumentLocations.clear();
+	}
+
+	virtual void ArgumentPtrChanged(int iIndex, CRegisters* pRegisters, void* pArgumentPtr)
+	{
+		g_iArgumentPtrChangedCount++;
+	}
+};
+
+class MyClass
+{
+public:
+	int MyFunc(int x, long long y, int z)
+	{
+		return x + (int) y + z + m_iValue;
+	}
+
+public:
+	int m_iValue;
+};
+
+int MyFunc(int x, long long y, int z)
+{
+	return x + (int) y + z;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+
+	// The table and the calling convention must agree
+	CRegisters* pRegisters = pHook->GetRegisters();
+	for(unsigned int i=0; i < pHook->m_pCallingConvention->m_vecArgTypes.size(); i++)
+		assert(pHook->GetArgumentPtr(i, pRegisters) == pHook->m_pCallingConvention->GetArgumentPtr(i, pRegisters));
+
+	int iFirst = pHook->m_pCallingConvention->m_vecArgTypes.size() - 3;
+	assert(pHook->GetArgument<int>(iFirst) == 1);
+	assert(pHook->GetArgument<long long>(iFirst + 1) == 0x100000002LL);
+	assert(pHook->GetArgument<int>(iFirst + 2) == 3);
+
+	pHook->SetArgument<int>(iFirst, 10);
+	pHook->SetArgument<long long>(iFirst + 1, 20);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_LONG_LONG);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// cdecl
+	CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, new NativeCdecl(vecArgTypes, DATA_TYPE_INT));
+	assert(pHook->m_pArgumentLocations != NULL);
+#ifdef DYNAMICHOOKS_X64
+	assert(pHook->m_pArgumentLocations[0].m_eRegister == RDI);
+	assert(pHook->m_pArgumentLocations[1].m_eRegister == RSI);
+	assert(pHook->m_pArgumentLocations[1].m_iSize == 8);
+	assert(pHook->m_pArgumentLocations[2].m_eRegister == RDX);
+#else
+	assert(pHook->m_pArgumentLocations[0].m_eRegister == ESP);
+	assert(pHook->m_pArgumentLocations[0].m_iOffset == 4);
+	assert(pHook->m_pArgumentLocations[1].m_iOffset == 8);
+	assert(pHook->m_pArgumentLocations[1].m_iSize == 8);
+	assert(pHook->m_pArgumentLocations[2].m_iOffset == 16);
+#endif
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	assert(MyFunc(1, 0x100000002LL, 3) == 33);
+	assert(g_iPreMyFuncCallCount == 1);
+	assert(g_iArgumentPtrChangedCount == 0);
+	pHookMngr->UnhookFunction((void *) &MyFunc);
+
+	// thiscall
+	std::vector<DataType_t> vecMethodArgTypes;
+	vecMethodArgTypes.push_back(DATA_TYPE_POINTER);
+	vecMethodArgTypes.insert(vecMethodArgTypes.end(), vecArgTypes.begin(), vecArgTypes.end());
+
+	int (MyClass::*pMethod)(int, long long, int) = &MyClass::MyFunc;
+	pHook = pHookMngr->HookFunction((void *&) pMethod, new NativeThiscall(vecMethodArgTypes, DATA_TYPE_INT));
+	assert(pHook->m_pArgumentLocations != NULL);
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+
+	MyClass obj;
+	obj.m_iValue = 100;
+	assert(obj.MyFunc(1, 0x100000002LL, 3) == 133);
+	assert(g_iPreMyFuncCallCount == 2);
+	pHookMngr->UnhookFunction((void *&) pMethod);
+
+	// Calling conventions without a table use the virtual functions
+	pHook = pHookMngr->HookFunction((void *) &MyFunc, new DynamicCdecl(vecArgTypes, DATA_TYPE_INT));
+	assert(pHook->m_pArgumentLocations == NULL);
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+
+	assert(MyFunc(1, 0x100000002LL, 3) == 33);
+	assert(g_iPreMyFuncCallCount == 3);
+	assert(g_iArgumentPtrChangedCount == 2);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
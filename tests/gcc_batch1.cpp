@@ -0,0 +1,127 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iPreMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> Functions to hook
+// ============================================================================
+template<int N>
+int MyFunc(int x)
+{
+	return x + N;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	pHook->SetArgument<int>(0, pHook->GetArgument<int>(0) * 10);
+	return false;
+}
+
+
+// ============================================================================
+// >> CHookManager::HookFunctions test
+// ============================================================================
+HookRequest_t Request(void* pFunc)
+{
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	HookRequest_t request;
+	request.m_pFunc = pFunc;
+	request.m_pConvention = new NativeCdecl(vecArgTypes, DATA_TYPE_INT);
+	request.m_eRegisterMode = REGISTERMODE_SHARED;
+	request.m_pHook = NULL;
+	return request;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Hook one function on its own and the others in a batch
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	CHook* pHook1 = pHookMngr->HookFunction((void *) &MyFunc<1>, new NativeCdecl(vecArgTypes, DATA_TYPE_INT));
+
+	std::vector<HookRequest_t> vecRequests;
+	vecRequests.push_back(Request((void *) &MyFunc<1>));
+	vecRequests.push_back(Request((void *) &MyFunc<2>));
+	vecRequests.push_back(Request((void *) &MyFunc<3>));
+	vecRequests.push_back(Request((void *) &MyFunc<2>));
+	vecRequests.push_back(Request(NULL));
+
+	// NULL can't be hooked and already hooked functions return the same hook
+	assert(pHookMngr->HookFunctions(vecRequests) == 4);
+	assert(vecRequests[0].m_pHook == pHook1);
+	assert(vecRequests[1].m_pHook != NULL);
+	assert(vecRequests[2].m_pHook != NULL);
+	assert(vecRequests[3].m_pHook == vecRequests[1].m_pHook);
+	assert(vecRequests[4].m_pHook == NULL);
+
+	for(int i=0; i < 4; i++)
+	{
+		assert(pHookMngr->FindHook(vecRequests[i].m_pFunc) == vecRequests[i].m_pHook);
+		vecRequests[i].m_pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	}
+
+	// All jumps have been written
+	assert(MyFunc<1>(1) == 11);
+	assert(MyFunc<2>(1) == 12);
+	assert(MyFunc<3>(1) == 13);
+	assert(g_iPreMyFuncCallCount == 3);
+
+	// Unhooking restores the protected functions
+	pHookMngr->UnhookAllFunctions();
+	assert(MyFunc<1>(1) == 2);
+	assert(MyFunc<2>(1) == 3);
+	assert(MyFunc<3>(1) == 4);
+	assert(g_iPreMyFuncCallCount == 3);
+
+	return 0;
+}
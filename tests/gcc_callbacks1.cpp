@@ -0,0 +1,142 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iFirstPreCallCount = 0;
+int g_iSecondPreCallCount = 0;
+int g_iPostCallCount = 0;
+
+
+// ============================================================================
+// >> Callback dispatch test
+// ============================================================================
+int MyFunc(int x)
+{
+	g_iMyFuncCallCount++;
+	return x;
+}
+
+bool FirstPreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iFirstPreCallCount++;
+	return false;
+}
+
+bool SecondPreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iSecondPreCallCount++;
+
+	// Skip the original function
+	pHook->SetReturnValue<int>(pHook->GetArgument<int>(0) * 2);
+	return true;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostCallCount++;
+	pHook->SetReturnValue<int>(pHook->GetReturnValue<int>() + 1);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT)
+	);
+
+	// No callbacks yet
+	assert(MyFunc(1) == 1);
+	assert(g_iMyFuncCallCount == 1);
+
+	// Both handlers are called. The result of the first one must not hide
+	// the override of the second one.
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &FirstPreMyFunc);
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &SecondPreMyFunc);
+
+	assert(MyFunc(2) == 4);
+	assert(g_iMyFuncCallCount == 1);
+	assert(g_iFirstPreCallCount == 1);
+	assert(g_iSecondPreCallCount == 1);
+
+	// Adding a handler twice must not call it twice
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &FirstPreMyFunc);
+	assert(MyFunc(3) == 6);
+	assert(g_iFirstPreCallCount == 2);
+
+	// The original function is called again after removing the override
+	pHook->RemoveCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &SecondPreMyFunc);
+
+	assert(MyFunc(4) == 4);
+	assert(g_iMyFuncCallCount == 2);
+	assert(g_iFirstPreCallCount == 3);
+	assert(g_iSecondPreCallCount == 2);
+
+	// Only post-hooks
+	pHook->RemoveCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &FirstPreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	assert(MyFunc(5) == 6);
+	assert(g_iMyFuncCallCount == 3);
+	assert(g_iFirstPreCallCount == 3);
+	assert(g_iPostCallCount == 1);
+
+	// No callbacks at all
+	pHook->RemoveCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	assert(MyFunc(6) == 6);
+	assert(g_iMyFuncCallCount == 4);
+	assert(g_iPostCallCount == 1);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
@@ -0,0 +1,159 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <atomic>
+#include <thread>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+// Enough functions to grow the hook index a few times
+#define FUNCTION_COUNT 300
+
+void* g_pFunctions[FUNCTION_COUNT];
+std::atomic<bool> g_bStop(false);
+
+
+// ============================================================================
+// >> Functions to hook
+// ============================================================================
+template<int N>
+int MyFunc(int x)
+{
+	return x + N;
+}
+
+template<int N>
+struct FunctionList
+{
+	static void Fill()
+	{
+		g_pFunctions[N - 1] = (void *) &MyFunc<N>;
+		FunctionList<N - 1>::Fill();
+	}
+};
+
+template<>
+struct FunctionList<0>
+{
+	static void Fill() {}
+};
+
+
+// ============================================================================
+// >> CHookManager test
+// ============================================================================
+CHook* Hook(CHookManager* pHookMngr, void* pFunc)
+{
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	return pHookMngr->HookFunction(pFunc, new NativeCdecl(vecArgTypes, DATA_TYPE_INT));
+}
+
+void FindThread(CHookManager* pHookMngr)
+{
+	// The odd functions stay hooked while the main thread changes the index
+	while (!g_bStop)
+	{
+		for(int i=1; i < FUNCTION_COUNT; i += 2)
+		{
+			CHook* pHook = pHookMngr->FindHook(g_pFunctions[i]);
+			assert(pHook != NULL);
+			assert(pHook->m_pFunc == g_pFunctions[i]);
+		}
+	}
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+	FunctionList<FUNCTION_COUNT>::Fill();
+
+	// Hook all functions
+	for(int i=0; i < FUNCTION_COUNT; i++)
+	{
+		CHook* pHook = Hook(pHookMngr, g_pFunctions[i]);
+		assert(pHook != NULL);
+		assert(pHookMngr->FindHook(g_pFunctions[i]) == pHook);
+
+		// Hooking it again returns the same hook
+		assert(Hook(pHookMngr, g_pFunctions[i]) == pHook);
+	}
+
+	// The list contains every hook exactly once
+	int iCount = 0;
+	for(CHook* pHook=pHookMngr->m_pFirstHook; pHook; pHook=pHook->m_pNextHook)
+	{
+		assert(pHookMngr->FindHook(pHook->m_pFunc) == pHook);
+		iCount++;
+	}
+	assert(iCount == FUNCTION_COUNT);
+
+	// Unhook and hook the even functions while other threads look up hooks
+	std::thread first(FindThread, pHookMngr);
+	std::thread second(FindThread, pHookMngr);
+	for(int iRound=0; iRound < 20; iRound++)
+	{
+		for(int i=0; i < FUNCTION_COUNT; i += 2)
+		{
+			pHookMngr->UnhookFunction(g_pFunctions[i]);
+			assert(pHookMngr->FindHook(g_pFunctions[i]) == NULL);
+		}
+
+		for(int i=0; i < FUNCTION_COUNT; i += 2)
+			assert(Hook(pHookMngr, g_pFunctions[i]) != NULL);
+	}
+	g_bStop = true;
+	first.join();
+	second.join();
+
+	// The functions still work
+	assert(MyFunc<1>(1) == 2);
+	assert(MyFunc<FUNCTION_COUNT>(0) == FUNCTION_COUNT);
+
+	pHookMngr->UnhookAllFunctions();
+	assert(pHookMngr->m_pFirstHook == NULL);
+	for(int i=0; i < FUNCTION_COUNT; i++)
+		assert(pHookMngr->FindHook(g_pFunctions[i]) == NULL);
+
+	return 0;
+}
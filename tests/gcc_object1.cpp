@@ -0,0 +1,140 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x86GccCdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> object test
+// ============================================================================
+struct Vector
+{
+	float x, y, z;
+};
+
+/*
+The hidden return pointer is pushed last and removed by the callee. v is
+copied onto the stack between a and b.
+*/
+__attribute__((noinline))
+Vector MyFunc(int a, Vector v, int b)
+{
+	g_iMyFuncCallCount++;
+	assert(a == 2);
+	assert(v.x == 10.0f && v.y == 2.0f && v.z == 3.0f);
+	assert(b == 4);
+
+	Vector result = {v.x * a, v.y * a, v.z * b};
+	return result;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	assert(pHook->GetArgument<int>(0) == 2);
+
+	// Objects are modified in place
+	Vector* pVector = (Vector *) pHook->GetArgumentPtr(1, pHook->GetRegisters());
+	assert(pVector->x == 1.0f && pVector->y == 2.0f && pVector->z == 3.0f);
+	pVector->x = 10.0f;
+
+	// The offset of b depends on the size of v
+	assert(pHook->GetArgument<int>(2) == 4);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	assert(pHook->GetArgument<int>(2) == 4);
+
+	Vector result = pHook->GetReturnValue<Vector>();
+	assert(result.x == 20.0f && result.y == 4.0f && result.z == 12.0f);
+
+	result.z = 1337.0f;
+	pHook->SetReturnValue<Vector>(result);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(MakeObjectType(sizeof(Vector), __alignof__(Vector)));
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	x86GccCdecl* pConvention = new x86GccCdecl(vecArgTypes, MakeObjectType(sizeof(Vector), __alignof__(Vector)));
+	assert(pConvention->m_ArgumentLocations[0].m_iOffset == 8);
+	assert(pConvention->m_ArgumentLocations[1].m_iOffset == 12);
+	assert(pConvention->m_ArgumentLocations[2].m_iOffset == 24);
+	assert(pConvention->GetPopSize() == 4);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Call the function twice to make sure the stack is cleaned up correctly
+	Vector v = {1.0f, 2.0f, 3.0f};
+	for(int i=0; i < 2; i++)
+	{
+		Vector result = MyFunc(2, v, 4);
+		assert(result.x == 20.0f && result.y == 4.0f && result.z == 1337.0f);
+	}
+
+	assert(g_iMyFuncCallCount == 2);
+	assert(g_iPreMyFuncCallCount == 2);
+	assert(g_iPostMyFuncCallCount == 2);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
@@ -0,0 +1,111 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+
+#include "utilities.h"
+
+
+// ============================================================================
+// >> Helpers
+// ============================================================================
+/*
+Returns the permissions of the mapping that contains the given address.
+*/
+std::string GetPermissions(void* pAddr)
+{
+	std::string permissions;
+	FILE* pFile = fopen("/proc/self/maps", "r");
+	char szLine[512];
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		unsigned long iStart, iEnd;
+		char szPermissions[5];
+		sscanf(szLine, "%lx-%lx %4s", &iStart, &iEnd, szPermissions);
+		if ((unsigned long) pAddr >= iStart && (unsigned long) pAddr < iEnd)
+			permissions = std::string(szPermissions, 3);
+	}
+	fclose(pFile);
+	return permissions;
+}
+
+
+// ============================================================================
+// >> CPatchTransaction test
+// ============================================================================
+int main()
+{
+	// Four pages with different protections
+	unsigned char* pPages = (unsigned char *) mmap(NULL, 4 * 4096, PROT_READ|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	assert(pPages != MAP_FAILED);
+	mprotect(pPages + 4096, 4096, PROT_READ);
+	mprotect(pPages + 3 * 4096, 4096, PROT_READ|PROT_WRITE);
+
+	// A jump that straddles the first two pages and a write to the others
+	CPatchTransaction transaction;
+	transaction.AddJMP(pPages + 4096 - 2, pPages);
+	transaction.AddWrite(pPages + 2 * 4096 + 5, "abc", 3);
+	transaction.AddWrite(pPages + 3 * 4096, "def", 3);
+	assert(transaction.Commit());
+
+	int iOffset;
+	memcpy(&iOffset, pPages + 4096 - 1, sizeof(iOffset));
+	assert(pPages[4096 - 2] == 0xE9);
+	assert(iOffset == -(4096 - 2 + 5));
+	assert(memcmp(pPages + 2 * 4096 + 5, "abc", 3) == 0);
+	assert(memcmp(pPages + 3 * 4096, "def", 3) == 0);
+
+	// The original protections are restored
+	assert(GetPermissions(pPages) == "r-x");
+	assert(GetPermissions(pPages + 4096) == "r--");
+	assert(GetPermissions(pPages + 2 * 4096) == "r-x");
+	assert(GetPermissions(pPages + 3 * 4096) == "rw-");
+
+	// Mappings that have been created after the protections were cached
+	unsigned char* pNewPage = (unsigned char *) mmap(NULL, 4096, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	transaction.AddWrite(pNewPage + 10, "x", 1);
+	assert(transaction.Commit());
+	assert(pNewPage[10] == 'x');
+	assert(GetPermissions(pNewPage) == "r--");
+
+	// Unmapped pages are skipped
+	munmap(pNewPage, 4096);
+	transaction.AddWrite(pNewPage, "x", 1);
+	assert(!transaction.Commit());
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <sys/mman.h>
+
+#include "utilities.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+std::atomic<bool> g_bStop(false);
+unsigned char* g_pFunc = NULL;
+
+// mov eax, <value>; ret
+unsigned char g_ReturnOne[] = {0xB8, 1, 0, 0, 0, 0xC3};
+unsigned char g_ReturnTwo[] = {0xB8, 2, 0, 0, 0, 0xC3};
+
+typedef int (*GetValueFn)();
+
+
+// ============================================================================
+// >> Live patching test
+// ============================================================================
+void CallThread()
+{
+	while (!g_bStop)
+	{
+		int iValue = ((GetValueFn) g_pFunc)();
+		assert(iValue == 1 || iValue == 2);
+	}
+}
+
+/*
+Switches the function between two versions while other threads call it. The
+function starts at the given offset of an 8-Byte block.
+*/
+void Test(unsigned char* pCode, int iOffset)
+{
+	mprotect(pCode, 4096, PROT_READ|PROT_WRITE|PROT_EXEC);
+	g_pFunc = pCode + 64 + iOffset;
+	unsigned char* pReturnTwo = pCode + 256;
+	unsigned char* pReturnOne = pCode + 512;
+	memcpy(g_pFunc, g_ReturnOne, sizeof(g_ReturnOne));
+	memcpy(pReturnTwo, g_ReturnTwo, sizeof(g_ReturnTwo));
+	memcpy(pReturnOne, g_ReturnOne, sizeof(g_ReturnOne));
+	mprotect(pCode, 4096, PROT_READ|PROT_EXEC);
+
+	g_bStop = false;
+	std::thread first(CallThread);
+	std::thread second(CallThread);
+
+	CPatchTransaction transaction;
+	for(int i=0; i < 1000; i++)
+	{
+		// Like hooking: Jump to the new code
+		transaction.AddJMP(g_pFunc, pReturnTwo);
+		assert(transaction.Commit());
+		assert(((GetValueFn) g_pFunc)() == 2);
+
+		// Like unhooking: Restore the original bytes and redirect to a copy
+		transaction.AddWrite(g_pFunc, g_ReturnOne, 5, pReturnOne);
+		assert(transaction.Commit());
+		assert(((GetValueFn) g_pFunc)() == 1);
+	}
+
+	g_bStop = true;
+	first.join();
+	second.join();
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	unsigned char* pCode = (unsigned char *) mmap(NULL, 4096, PROT_READ|PROT_EXEC, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	assert(pCode != MAP_FAILED);
+
+	// The jump fits into an aligned 8-Byte block
+	Test(pCode, 0);
+
+	// The jump crosses an 8-Byte boundary, so breakpoints are used
+	Test(pCode, 5);
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <stdlib.h>
+
+#include "registers.h"
+
+
+// ============================================================================
+// >> Register frame test
+// ============================================================================
+int main()
+{
+	std::list<Register_t> registers;
+	registers.push_back(AL);
+	registers.push_back(ESP);
+	registers.push_back(ST0);
+	registers.push_back(MM0);
+	registers.push_back(XMM1);
+	registers.push_back(EAX);
+
+	CRegisters regs(registers);
+
+	// One cache line is enough for these registers
+	assert(regs.m_iFrameSize == FRAME_ALIGNMENT);
+	assert((unsigned long) regs.m_pFrame % FRAME_ALIGNMENT == 0);
+
+	// Every register is naturally aligned
+	assert(regs.GetOffset(XMM1) % 16 == 0);
+	assert(regs.GetOffset(ST0) % 16 == 0);
+	assert(regs.GetOffset(MM0) % 8 == 0);
+	assert(regs.GetOffset(ESP) % 4 == 0);
+	assert(regs.GetOffset(EAX) % 4 == 0);
+
+	// Registers that aren't saved don't have storage
+	assert(regs.m_ecx == NULL);
+	assert(regs.GetOffset(ECX) == -1);
+	assert(regs.m_xmm1->m_iSize == 16);
+
+	// Registers don't overlap
+	regs.m_eax->SetValue<int>(1);
+	regs.m_esp->SetValue<int>(2);
+	regs.m_al->SetValue<char>(3);
+	assert(regs.m_eax->GetValue<int>() == 1);
+	assert(regs.m_esp->GetValue<int>() == 2);
+
+	// The views follow a new frame
+	void* pFrame = calloc(1, regs.m_iFrameSize);
+	regs.SetFrame(pFrame);
+	assert(regs.m_eax->GetValue<int>() == 0);
+
+	regs.m_eax->SetValue<int>(5);
+	assert(*(int *) ((unsigned long) pFrame + regs.GetOffset(EAX)) == 5);
+
+	// A second object can be created over the same frame
+	CRegisters other(registers, pFrame);
+	assert(other.m_eax->GetValue<int>() == 5);
+
+	free(pFrame);
+	return 0;
+}
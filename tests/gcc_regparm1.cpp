@@ -0,0 +1,136 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x86GccRegparm.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> regparm test
+// ============================================================================
+// x -> eax, y -> edx:ecx, f and z -> stack
+__attribute__((noinline, regparm(3)))
+long long MyFunc(int x, long long y, float f, int z)
+{
+	g_iMyFuncCallCount++;
+	assert(x == 3);
+	assert(y == 0x100000005LL);
+	assert(f == 2.5f);
+	assert(z == 10);
+
+	return x + y + z;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	int x = pHook->GetArgument<int>(0);
+	assert(x == 3);
+
+	long long y = pHook->GetArgument<long long>(1);
+	assert(y == 0x200000004LL);
+
+	float f = pHook->GetArgument<float>(2);
+	assert(f == 2.5f);
+
+	int z = pHook->GetArgument<int>(3);
+	assert(z == 10);
+
+	// Both halves need to be written back to edx and ecx
+	pHook->SetArgument<long long>(1, 0x100000005LL);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+
+	// Register arguments are gone at this point, stack arguments aren't
+	float f = pHook->GetArgument<float>(2);
+	assert(f == 2.5f);
+
+	int z = pHook->GetArgument<int>(3);
+	assert(z == 10);
+
+	long long return_value = pHook->GetReturnValue<long long>();
+	assert(return_value == 0x100000012LL);
+
+	pHook->SetReturnValue<long long>(0x1300000037LL);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_LONG_LONG);
+	vecArgTypes.push_back(DATA_TYPE_FLOAT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new x86GccRegparm<3>(vecArgTypes, DATA_TYPE_LONG_LONG)
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Call the function
+	long long return_value = MyFunc(3, 0x200000004LL, 2.5f, 10);
+
+	assert(g_iMyFuncCallCount == 1);
+	assert(g_iPreMyFuncCallCount == 1);
+	assert(g_iPostMyFuncCallCount == 1);
+	assert(return_value == 0x1300000037LL);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
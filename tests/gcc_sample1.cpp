@@ -0,0 +1,127 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> CHook::SetSampleInterval/SetSampleRate test
+// ============================================================================
+int MyFunc(int x, int y)
+{
+	return x + y;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	pHook->SetReturnValue<int>(pHook->GetReturnValue<int>() * 10);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT)
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Only every 4th call is passed to the callbacks
+	pHook->SetSampleInterval(4);
+	int iSampled = 0;
+	for(int i=0; i < 100; i++)
+	{
+		int iResult = MyFunc(1, 2);
+		assert(iResult == 3 || iResult == 30);
+		if (iResult == 30)
+			iSampled++;
+	}
+	assert(iSampled == 25);
+	assert(g_iPreMyFuncCallCount == 25);
+	assert(g_iPostMyFuncCallCount == 25);
+
+	// Roughly every 10th call is passed to the callbacks
+	g_iPreMyFuncCallCount = 0;
+	g_iPostMyFuncCallCount = 0;
+	pHook->SetSampleRate(0.1);
+	for(int i=0; i < 10000; i++)
+		MyFunc(1, 2);
+
+	assert(g_iPreMyFuncCallCount >= 700 && g_iPreMyFuncCallCount <= 1300);
+	assert(g_iPostMyFuncCallCount == g_iPreMyFuncCallCount);
+
+	// Every call is passed to the callbacks again
+	g_iPreMyFuncCallCount = 0;
+	pHook->SetSampleInterval(1);
+	for(int i=1; i <= 100; i++)
+	{
+		assert(MyFunc(1, 2) == 30);
+		assert(g_iPreMyFuncCallCount == i);
+	}
+
+	pHookMngr->UnhookAllFunctions();
+	assert(MyFunc(1, 2) == 3);
+
+	return 0;
+}
@@ -0,0 +1,125 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <vector>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iPreSumCallCount = 0;
+int g_iPostSumCallCount = 0;
+
+// Arguments of the running calls. Argument registers don't survive the call
+// in 64-bit mode, so the pre-hook remembers them.
+std::vector<int> g_Arguments;
+
+
+// ============================================================================
+// >> REGISTERMODE_STACK test
+// ============================================================================
+int Sum(int n)
+{
+	if (n <= 0)
+		return 0;
+
+	return n + Sum(n - 1);
+}
+
+bool PreSum(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreSumCallCount++;
+	int n = pHook->GetArgument<int>(0);
+	assert(n >= 0 && n <= 5);
+	g_Arguments.push_back(n);
+
+	if (n == 3)
+	{
+		// Call the function again from inside of the handler
+		int return_value = Sum(2);
+		assert(return_value == 3);
+
+		// The nested calls must not have touched our registers
+		assert(pHook->GetArgument<int>(0) == 3);
+	}
+	return false;
+}
+
+bool PostSum(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostSumCallCount++;
+	int n = g_Arguments.back();
+	g_Arguments.pop_back();
+
+	int return_value = pHook->GetReturnValue<int>();
+	assert(return_value == n * (n + 1) / 2);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &Sum,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT),
+		REGISTERMODE_STACK
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreSum);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostSum);
+
+	// Every recursion level gets its own frame
+	int return_value = Sum(5);
+	assert(return_value == 15);
+
+	// Sum(5) calls itself 5 times and the pre-hook calls Sum(2) once
+	assert(g_iPreSumCallCount == 9);
+	assert(g_iPostSumCallCount == 9);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
@@ -0,0 +1,137 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <thread>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> CHook::GetStats test
+// ============================================================================
+int MyFunc(int x, int y)
+{
+	return x + y;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	// Override calls with x == 0
+	if (pHook->GetArgument<int>(0) != 0)
+		return false;
+
+	pHook->SetReturnValue<int>(-1);
+	return true;
+}
+
+unsigned long long GetHistogramSum(const HookStats_t& stats)
+{
+	unsigned long long iSum = 0;
+	for(int i=0; i < HOOK_STATS_BUCKETS; i++)
+		iSum += stats.m_LatencyHistogram[i];
+
+	return iSum;
+}
+
+void CallMyFunc()
+{
+	for(int i=0; i < 50; i++)
+		assert(MyFunc(1, 2) == 3);
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT)
+	);
+
+	// Statistics are disabled by default
+	assert(MyFunc(1, 2) == 3);
+	assert(pHook->GetStats().m_iCalls == 0);
+
+	// Statistics don't require any callbacks
+	pHook->SetStatsEnabled(true);
+	for(int i=0; i < 100; i++)
+		assert(MyFunc(1, 2) == 3);
+
+	HookStats_t stats = pHook->GetStats();
+	assert(stats.m_iCalls == 100);
+	assert(stats.m_iOverrides == 0);
+	assert(GetHistogramSum(stats) == 100);
+
+	// Overridden calls don't call the original function
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	for(int i=0; i < 10; i++)
+	{
+		assert(MyFunc(0, 2) == -1);
+		assert(MyFunc(1, 2) == 3);
+	}
+
+	stats = pHook->GetStats();
+	assert(stats.m_iCalls == 120);
+	assert(stats.m_iOverrides == 10);
+	assert(GetHistogramSum(stats) == 110);
+
+	// The statistics of a thread are kept after it has exited
+	std::thread thread(CallMyFunc);
+	thread.join();
+
+	stats = pHook->GetStats();
+	assert(stats.m_iCalls == 170);
+	assert(GetHistogramSum(stats) == 160);
+
+	// Disabling the statistics keeps the counters
+	pHook->SetStatsEnabled(false);
+	assert(MyFunc(1, 2) == 3);
+	assert(pHook->GetStats().m_iCalls == 170);
+
+	pHookMngr->UnhookAllFunctions();
+	assert(MyFunc(1, 2) == 3);
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <atomic>
+#include <thread>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+// 1 = first thread is inside of the pre-hook, 2 = second thread is done
+std::atomic<int> g_iStage(0);
+
+
+// ============================================================================
+// >> REGISTERMODE_THREAD test
+// ============================================================================
+int MyFunc(int x, int y)
+{
+	return x + y;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	int x = pHook->GetArgument<int>(0);
+	int y = pHook->GetArgument<int>(1);
+	assert(x == 1 || x == 3);
+	assert(y == x + 1);
+
+	if (x == 1)
+	{
+		// Let the second thread call the function while we are still inside
+		// of the pre-hook.
+		g_iStage = 1;
+		while (g_iStage != 2);
+
+		// The second thread must not have touched our registers
+		assert(pHook->GetArgument<int>(0) == 1);
+		assert(pHook->GetArgument<int>(1) == 2);
+	}
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	int x = pHook->GetArgument<int>(0);
+	int y = pHook->GetArgument<int>(1);
+
+	int return_value = pHook->GetReturnValue<int>();
+	assert(return_value == x + y);
+
+	pHook->SetReturnValue<int>(return_value * 10);
+	return false;
+}
+
+void FirstThread()
+{
+	int return_value = MyFunc(1, 2);
+	assert(return_value == 30);
+}
+
+void SecondThread()
+{
+	while (g_iStage != 1);
+
+	int return_value = MyFunc(3, 4);
+	assert(return_value == 70);
+
+	g_iStage = 2;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT),
+		REGISTERMODE_THREAD
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Call the function from two threads
+	std::thread first(FirstThread);
+	std::thread second(SecondThread);
+	first.join();
+	second.join();
+
+	assert(g_iPreMyFuncCallCount == 2);
+	assert(g_iPostMyFuncCallCount == 2);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
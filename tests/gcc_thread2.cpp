@@ -0,0 +1,166 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <setjmp.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+#define THREAD_COUNT	4
+#define CALL_COUNT		20000
+
+std::atomic<int> g_iPreMyFuncCallCount(0);
+std::atomic<int> g_iPostMyFuncCallCount(0);
+
+// Arguments of the running calls of this thread. Argument registers don't
+// survive the call in 64-bit mode, so the pre-hook remembers them.
+thread_local std::vector<std::pair<int, int> > t_Arguments;
+
+jmp_buf g_JumpBuffer;
+
+
+// ============================================================================
+// >> Shadow return address stack test
+// ============================================================================
+int MyFunc(int x, int depth)
+{
+	if (depth == -1)
+		longjmp(g_JumpBuffer, 1);
+
+	// Nested calls push multiple return addresses
+	if (depth > 0)
+		return MyFunc(x, depth - 1) + 1;
+
+	return x;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+
+	// Calls with depth -1 never return
+	int depth = pHook->GetArgument<int>(1);
+	if (depth != -1)
+		t_Arguments.push_back(std::make_pair(pHook->GetArgument<int>(0), depth));
+
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	int x = t_Arguments.back().first;
+	int depth = t_Arguments.back().second;
+	t_Arguments.pop_back();
+
+	int return_value = pHook->GetReturnValue<int>();
+	assert(return_value == x + depth * 2);
+
+	pHook->SetReturnValue<int>(return_value + 1);
+	return false;
+}
+
+void Thread(int iThread)
+{
+	for (int i=0; i < CALL_COUNT; i++)
+	{
+		int x = iThread * CALL_COUNT + i;
+		int depth = i % 4;
+		assert(MyFunc(x, depth) == x + depth * 2 + 1);
+	}
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT),
+		REGISTERMODE_THREAD
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Call the function from multiple threads at the same time
+	std::thread threads[THREAD_COUNT];
+	for (int i=0; i < THREAD_COUNT; i++)
+		threads[i] = std::thread(Thread, i);
+
+	for (int i=0; i < THREAD_COUNT; i++)
+		threads[i].join();
+
+	// Every call is counted once per nesting level: depth 0..3
+	int iCallCount = THREAD_COUNT * (CALL_COUNT / 4) * (1 + 2 + 3 + 4);
+	assert(g_iPreMyFuncCallCount == iCallCount);
+	assert(g_iPostMyFuncCallCount == iCallCount);
+
+	// Leave the function without returning more often than the shadow stack
+	// can hold entries. The stale entries must be discarded.
+	g_iPreMyFuncCallCount = 0;
+	g_iPostMyFuncCallCount = 0;
+	for (int i=0; i < 2000; i++)
+	{
+		if (!setjmp(g_JumpBuffer))
+			MyFunc(0, -1);
+	}
+
+	assert(g_iPreMyFuncCallCount == 2000);
+	assert(g_iPostMyFuncCallCount == 0);
+
+	// Post-hooks must still be called
+	assert(MyFunc(5, 1) == 5 + 2 + 1);
+	assert(g_iPostMyFuncCallCount == 2);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
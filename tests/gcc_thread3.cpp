@@ -0,0 +1,131 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <atomic>
+#include <thread>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+#define THREAD_COUNT	4
+#define CHANGE_COUNT	2000
+
+std::atomic<bool> g_bDone(false);
+std::atomic<int> g_iPostMyFuncCallCount(0);
+
+
+// ============================================================================
+// >> Callback changes while the function is being called
+// ============================================================================
+int MyFunc(int x)
+{
+	return x;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	assert(pHook->GetArgument<int>(0) >= 0);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	pHook->SetReturnValue<int>(pHook->GetReturnValue<int>() + 1);
+	return false;
+}
+
+void Thread(int iThread)
+{
+	int iCalls = 0;
+	while (!g_bDone || iCalls == 0)
+	{
+		int x = iThread * 1000000 + (iCalls++ % 1000000);
+
+		// The post-hook might be added or removed during the call
+		int return_value = MyFunc(x);
+		assert(return_value == x || return_value == x + 1);
+	}
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new NativeCdecl(vecArgTypes, DATA_TYPE_INT),
+		REGISTERMODE_THREAD
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+
+	std::thread threads[THREAD_COUNT];
+	for (int i=0; i < THREAD_COUNT; i++)
+		threads[i] = std::thread(Thread, i);
+
+	// Add and remove the post-hook while the threads are calling the function
+	for (int i=0; i < CHANGE_COUNT; i++)
+	{
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+		assert(pHook->IsCallbackRegistered(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc));
+
+		pHook->RemoveCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+		assert(!pHook->IsCallbackRegistered(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc));
+	}
+
+	g_bDone = true;
+	for (int i=0; i < THREAD_COUNT; i++)
+		threads[i].join();
+
+	// The post-hook is no longer registered
+	int iPostMyFuncCallCount = g_iPostMyFuncCallCount;
+	assert(MyFunc(5) == 5);
+	assert(g_iPostMyFuncCallCount == iPostMyFuncCallCount);
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
@@ -0,0 +1,112 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "typedhook.h"
+#include "conventions/x86GccCdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+typedef CTypedHook<x86GccCdecl, long long(int, char, double, short)> MyFuncHook;
+
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> CTypedHook test
+// ============================================================================
+long long MyFunc(int x, char c, double d, short s)
+{
+	return x + c + (long long) d + s;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	MyFuncHook hook(pHook);
+
+	assert(hook.GetArgument<0>() == 1);
+	assert(hook.GetArgument<1>() == 2);
+	assert(hook.GetArgument<2>() == 3.0);
+	assert(hook.GetArgument<3>() == 4);
+
+	// Must be the same as the untyped access
+	assert(hook.GetArgument<3>() == pHook->GetArgument<short>(3));
+
+	hook.SetArgument<2>(10000000000.0);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	MyFuncHook hook(pHook);
+
+	long long return_value = hook.GetReturnValue();
+	assert(return_value == 1 + 2 + 10000000000LL + 4);
+
+	hook.SetReturnValue(return_value * 2);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	// The layout is known at compile time
+	static_assert(MyFuncHook::ARGUMENT_COUNT == 4, "Wrong argument count");
+	static_assert(MyFuncHook::STACK_SIZE == 4 + 4 + 8 + 4, "Wrong stack size");
+	static_assert(MyFuncHook::POP_SIZE == 0, "Wrong pop size");
+
+	// Hook the function
+	MyFuncHook hook = MyFuncHook::HookFunction((void *) &MyFunc);
+	assert(hook.GetHook()->m_pCallingConvention->GetPopSize() == MyFuncHook::POP_SIZE);
+
+	hook.AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	hook.AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Call the function
+	long long return_value = MyFunc(1, 2, 3.0, 4);
+
+	assert(g_iPreMyFuncCallCount == 1);
+	assert(g_iPostMyFuncCallCount == 1);
+	assert(return_value == (1 + 2 + 10000000000LL + 4) * 2);
+
+	GetHookManager()->UnhookAllFunctions();
+	return 0;
+}
@@ -0,0 +1,133 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+// ============================================================================
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "typedhook.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+// d -> stack, x -> ecx, y -> stack and uses up edx, z -> stack
+typedef CTypedHook<x86GccFastcall, int(double, int, long long, int)> MyFastcallHook;
+
+// x -> eax, y -> edx:ecx, f and z -> stack
+typedef CTypedHook<x86GccRegparm<3>, long long(int, long long, float, int)> MyRegparmHook;
+
+int g_iPreMyFastcallCallCount = 0;
+int g_iPreMyRegparmCallCount = 0;
+
+
+// ============================================================================
+// >> CTypedHook register test
+// ============================================================================
+__attribute__((noinline, fastcall))
+int MyFastcall(double d, int x, long long y, int z)
+{
+	return (int) d + x + (int) y + z;
+}
+
+__attribute__((noinline, regparm(3)))
+long long MyRegparm(int x, long long y, float f, int z)
+{
+	return x + y + (long long) f + z;
+}
+
+bool PreMyFastcall(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFastcallCallCount++;
+	MyFastcallHook hook(pHook);
+
+	assert(hook.GetArgument<0>() == 1.0);
+	assert(hook.GetArgument<1>() == 2);
+	assert(hook.GetArgument<2>() == 3);
+	assert(hook.GetArgument<3>() == 4);
+
+	// Must be the same as the untyped access
+	assert(hook.GetArgument<1>() == pHook->GetArgument<int>(1));
+	assert(hook.GetArgument<3>() == pHook->GetArgument<int>(3));
+
+	hook.SetArgument<1>(20);
+	hook.SetArgument<3>(40);
+	return false;
+}
+
+bool PreMyRegparm(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyRegparmCallCount++;
+	MyRegparmHook hook(pHook);
+
+	assert(hook.GetArgument<0>() == 1);
+	assert(hook.GetArgument<1>() == 0x200000002LL);
+	assert(hook.GetArgument<2>() == 3.0f);
+	assert(hook.GetArgument<3>() == 4);
+
+	// The split argument is assembled from edx and ecx
+	assert(hook.GetArgument<1>() == pHook->GetArgument<long long>(1));
+
+	hook.SetArgument<1>(0x300000003LL);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	// Only integral arguments use registers
+	static_assert(MyFastcallHook::STACK_SIZE == 8 + 8 + 4, "Wrong stack size");
+	static_assert(MyFastcallHook::POP_SIZE == MyFastcallHook::STACK_SIZE, "Wrong pop size");
+	static_assert(MyRegparmHook::STACK_SIZE == 4 + 4, "Wrong stack size");
+	static_assert(MyRegparmHook::POP_SIZE == 0, "Wrong pop size");
+
+	MyFastcallHook fastcall = MyFastcallHook::HookFunction((void *) &MyFastcall);
+	assert(fastcall.GetHook()->m_pCallingConvention->GetPopSize() == MyFastcallHook::POP_SIZE);
+	fastcall.AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFastcall);
+
+	MyRegparmHook regparm = MyRegparmHook::HookFunction((void *) &MyRegparm);
+	assert(regparm.GetHook()->m_pCallingConvention->GetPopSize() == MyRegparmHook::POP_SIZE);
+	regparm.AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyRegparm);
+
+	// Call the functions
+	assert(MyFastcall(1.0, 2, 3, 4) == 1 + 20 + 3 + 40);
+	assert(MyRegparm(1, 0x200000002LL, 3.0f, 4) == 1 + 0x300000003LL + 3 + 4);
+
+	assert(g_iPreMyFastcallCallCount == 1);
+	assert(g_iPreMyRegparmCallCount == 1);
+
+	GetHookManager()->UnhookAllFunctions();
+	return 0;
+}
@@ -0,0 +1,134 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <atomic>
+#include <thread>
+
+#include "manager.h"
+#include "native_cdecl.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iPostMyFuncCallCount = 0;
+
+// 1 = the thread is inside of the original function, 2 = it can return
+std::atomic<int> g_iStage(0);
+
+
+// ============================================================================
+// >> Unhook test
+// ============================================================================
+int MyFunc(int x)
+{
+	if (x == 1)
+	{
+		g_iStage = 1;
+		while (g_iStage != 2);
+	}
+	return x + 1;
+}
+
+int MyOtherFunc(int x)
+{
+	return x * 2;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	pHook->SetReturnValue<int>(pHook->GetReturnValue<int>() * 10);
+	return false;
+}
+
+void CallThread(int* pResult)
+{
+	*pResult = MyFunc(1);
+}
+
+CHook* Hook(CHookManager* pHookMngr, void* pFunc)
+{
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	return pHookMngr->HookFunction(pFunc, new NativeCdecl(vecArgTypes, DATA_TYPE_INT));
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	CHook* pHook = Hook(pHookMngr, (void *) &MyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Unhook the function while a call is running
+	int iResult = 0;
+	std::thread thread(CallThread, &iResult);
+	while (g_iStage != 1);
+
+	pHookMngr->UnhookFunction((void *) &MyFunc);
+	assert(pHookMngr->FindHook((void *) &MyFunc) == NULL);
+	assert(MyFunc(2) == 3);
+
+	// Hooking and unhooking other functions must not release the code the
+	// running call returns to
+	for(int i=0; i < 100; i++)
+	{
+		CHook* pOtherHook = Hook(pHookMngr, (void *) &MyOtherFunc);
+		pOtherHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+		pHookMngr->UnhookFunction((void *) &MyOtherFunc);
+	}
+	assert(g_iPostMyFuncCallCount == 0);
+
+	// The running call still returns through the post-hook code
+	g_iStage = 2;
+	thread.join();
+	assert(iResult == 20);
+	assert(g_iPostMyFuncCallCount == 1);
+
+	// The function can be hooked again
+	pHook = Hook(pHookMngr, (void *) &MyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+	assert(MyFunc(2) == 30);
+	assert(g_iPostMyFuncCallCount == 2);
+
+	pHookMngr->UnhookAllFunctions();
+	assert(MyFunc(2) == 3);
+	return 0;
+}
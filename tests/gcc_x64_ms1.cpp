@@ -0,0 +1,224 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x64MsFastcall.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> Microsoft x64 test
+// ============================================================================
+/*
+Every argument uses the register of its position. The fifth and sixth
+argument are passed above the shadow space.
+*/
+__attribute__((ms_abi)) long long MyFunc(int a, double b, long long c, float d, int e, double f)
+{
+	g_iMyFuncCallCount++;
+	assert(a == 10);
+	assert(b == 2.5);
+	assert(c == 0x100000003LL);
+	assert(d == 4.5f);
+	assert(e == 50);
+	assert(f == 6.0);
+
+	return a + (long long) b + c + (long long) d + e + (long long) f;
+}
+
+__attribute__((ms_abi)) double MyDoubleFunc(double x, double y)
+{
+	return x * y;
+}
+
+__attribute__((ms_abi)) int Add(int x, int y)
+{
+	return x + y;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	assert(pHook->GetArgument<int>(0) == 1);
+	assert(pHook->GetArgument<double>(1) == 2.5);
+	assert(pHook->GetArgument<long long>(2) == 0x100000003LL);
+	assert(pHook->GetArgument<float>(3) == 4.5f);
+	assert(pHook->GetArgument<int>(4) == 5);
+	assert(pHook->GetArgument<double>(5) == 6.0);
+
+	// Modify a register and a stack argument
+	pHook->SetArgument<int>(0, 10);
+	pHook->SetArgument<int>(4, 50);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	assert(pHook->GetReturnValue<long long>() == 0x100000003LL + 72);
+
+	pHook->SetReturnValue<long long>(1337);
+	return false;
+}
+
+bool PostMyDoubleFunc(HookType_t eHookType, CHook* pHook)
+{
+	assert(pHook->GetReturnValue<double>() == 6.0);
+	pHook->SetReturnValue<double>(pHook->GetReturnValue<double>() + 1);
+	return false;
+}
+
+bool ClobberRegisters(HookType_t eHookType, CHook* pHook)
+{
+	// A System V function is allowed to modify these registers
+	asm volatile(
+		"mov $-1, %%rsi\n"
+		"mov $-1, %%rdi\n"
+		"pcmpeqd %%xmm6, %%xmm6\n"
+		"pcmpeqd %%xmm15, %%xmm15\n"
+		::: "rsi", "rdi", "xmm6", "xmm15");
+	return false;
+}
+
+/*
+Calls Add(1, 2) like an ms_abi caller that keeps values in non-volatile
+registers. Returns true if they have been preserved.
+*/
+bool CallAddAndCheckRegisters()
+{
+	unsigned long long rsi, rdi, xmm6, xmm15;
+	int iResult;
+	asm volatile(
+		// Skip the red zone and align the stack
+		"mov %%rsp, %%rbx\n"
+		"sub $128, %%rsp\n"
+		"and $-16, %%rsp\n"
+		"mov $0x1111, %%rsi\n"
+		"mov $0x2222, %%rdi\n"
+		"mov $0x3333, %%rax\n"
+		"movq %%rax, %%xmm6\n"
+		"mov $0x4444, %%rax\n"
+		"movq %%rax, %%xmm15\n"
+		"mov $1, %%ecx\n"
+		"mov $2, %%edx\n"
+		"sub $32, %%rsp\n"
+		"call *%[func]\n"
+		"mov %%rbx, %%rsp\n"
+		"mov %%eax, %[result]\n"
+		"mov %%rsi, %[rsi]\n"
+		"mov %%rdi, %[rdi]\n"
+		"movq %%xmm6, %[xmm6]\n"
+		"movq %%xmm15, %[xmm15]\n"
+		: [result] "=m" (iResult), [rsi] "=m" (rsi), [rdi] "=m" (rdi), [xmm6] "=m" (xmm6), [xmm15] "=m" (xmm15)
+		: [func] "r" ((void *) &Add)
+		: "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", "memory", "cc",
+		  "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+		  "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15");
+
+	return iResult == 3 && rsi == 0x1111 && rdi == 0x2222 && xmm6 == 0x3333 && xmm15 == 0x4444;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_DOUBLE);
+	vecArgTypes.push_back(DATA_TYPE_LONG_LONG);
+	vecArgTypes.push_back(DATA_TYPE_FLOAT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_DOUBLE);
+
+	std::vector<DataType_t> vecDoubleArgTypes;
+	vecDoubleArgTypes.push_back(DATA_TYPE_DOUBLE);
+	vecDoubleArgTypes.push_back(DATA_TYPE_DOUBLE);
+
+	std::vector<DataType_t> vecAddArgTypes;
+	vecAddArgTypes.push_back(DATA_TYPE_INT);
+	vecAddArgTypes.push_back(DATA_TYPE_INT);
+
+	RegisterMode_t modes[] = {REGISTERMODE_SHARED, REGISTERMODE_THREAD, REGISTERMODE_STACK};
+	for(int iMode=0; iMode < 3; iMode++)
+	{
+		x64MsFastcall* pConvention = new x64MsFastcall(vecArgTypes, DATA_TYPE_LONG_LONG);
+		assert(pConvention->m_ArgumentLocations[0].m_eRegister == RCX);
+		assert(pConvention->m_ArgumentLocations[1].m_eRegister == XMM1);
+		assert(pConvention->m_ArgumentLocations[2].m_eRegister == R8);
+		assert(pConvention->m_ArgumentLocations[3].m_eRegister == XMM3);
+		assert(pConvention->m_ArgumentLocations[4].m_eRegister == RSP);
+		assert(pConvention->m_ArgumentLocations[4].m_iOffset == 40);
+		assert(pConvention->m_ArgumentLocations[5].m_iOffset == 48);
+
+		CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+		assert(MyFunc(1, 2.5, 0x100000003LL, 4.5f, 5, 6.0) == 1337);
+		assert(g_iMyFuncCallCount == iMode + 1);
+		assert(g_iPreMyFuncCallCount == iMode + 1);
+		assert(g_iPostMyFuncCallCount == iMode + 1);
+
+		pHook = pHookMngr->HookFunction((void *) &MyDoubleFunc, new x64MsFastcall(vecDoubleArgTypes, DATA_TYPE_DOUBLE), modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyDoubleFunc);
+		assert(MyDoubleFunc(2.0, 3.0) == 7.0);
+
+		// The handlers must not modify registers that are non-volatile in
+		// the Microsoft ABI
+		pHook = pHookMngr->HookFunction((void *) &Add, new x64MsFastcall(vecAddArgTypes, DATA_TYPE_INT), modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &ClobberRegisters);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &ClobberRegisters);
+		assert(CallAddAndCheckRegisters());
+
+		pHookMngr->UnhookAllFunctions();
+	}
+
+	// The original functions are restored
+	assert(MyFunc(10, 2.5, 0x100000003LL, 4.5f, 50, 6.0) == 0x100000003LL + 72);
+	assert(MyDoubleFunc(2.0, 3.0) == 6.0);
+	assert(CallAddAndCheckRegisters());
+	return 0;
+}
@@ -0,0 +1,161 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x64MsFastcall.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> Microsoft x64 object test
+// ============================================================================
+struct Vector
+{
+	double x, y, z;
+};
+
+struct Small
+{
+	int a, b;
+};
+
+/*
+The return value is passed via a hidden pointer in rcx, s via rdx, v by
+reference via r8, n via r9, w by reference on the stack and t on the stack.
+*/
+__attribute__((ms_abi, noinline))
+Vector MyFunc(Small s, Vector v, int n, Vector w, Small t)
+{
+	g_iMyFuncCallCount++;
+	assert(s.a == 10 && s.b == 2);
+	assert(v.x == 10.0 && v.y == 2.0 && v.z == 3.0);
+	assert(n == 4);
+	assert(w.x == 5.0 && w.y == 6.0 && w.z == 7.0);
+	assert(t.a == 8 && t.b == 9);
+
+	Vector result = {v.x + w.x, v.y + w.y, (double) (s.a + t.b + n)};
+	return result;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	Small s = pHook->GetArgument<Small>(0);
+	assert(s.a == 1 && s.b == 2);
+	s.a = 10;
+	pHook->SetArgument<Small>(0, s);
+
+	// Objects passed by reference are modified in place
+	Vector* pVector = (Vector *) pHook->GetArgumentPtr(1, pHook->GetRegisters());
+	assert(pVector->x == 1.0 && pVector->y == 2.0 && pVector->z == 3.0);
+	pVector->x = 10.0;
+
+	assert(pHook->GetArgument<int>(2) == 4);
+
+	Vector w = pHook->GetArgument<Vector>(3);
+	assert(w.x == 5.0 && w.y == 6.0 && w.z == 7.0);
+
+	Small t = pHook->GetArgument<Small>(4);
+	assert(t.a == 8 && t.b == 9);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	Vector result = pHook->GetReturnValue<Vector>();
+	assert(result.x == 15.0 && result.y == 8.0 && result.z == 23.0);
+
+	result.z = 1337.0;
+	pHook->SetReturnValue<Vector>(result);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	DataType_t vectorType = MakeObjectType(sizeof(Vector), __alignof__(Vector));
+	DataType_t smallType = MakeObjectType(sizeof(Small), __alignof__(Small));
+
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(smallType);
+	vecArgTypes.push_back(vectorType);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(vectorType);
+	vecArgTypes.push_back(smallType);
+
+	Small s = {1, 2};
+	Vector v = {1.0, 2.0, 3.0};
+	Vector w = {5.0, 6.0, 7.0};
+	Small t = {8, 9};
+
+	RegisterMode_t modes[] = {REGISTERMODE_SHARED, REGISTERMODE_THREAD, REGISTERMODE_STACK};
+	for(int iMode=0; iMode < 3; iMode++)
+	{
+		x64MsFastcall* pConvention = new x64MsFastcall(vecArgTypes, vectorType);
+
+		// Arguments passed by reference can't be described by the table
+		assert(pConvention->m_ArgumentLocations.empty());
+
+		CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+		Vector result = MyFunc(s, v, 4, w, t);
+		assert(result.x == 15.0 && result.y == 8.0 && result.z == 1337.0);
+		assert(g_iMyFuncCallCount == iMode + 1);
+		assert(g_iPreMyFuncCallCount == iMode + 1);
+		assert(g_iPostMyFuncCallCount == iMode + 1);
+
+		// The caller's copy was modified, not the original
+		assert(v.x == 1.0);
+
+		pHookMngr->UnhookAllFunctions();
+	}
+
+	return 0;
+}
@@ -0,0 +1,164 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x64SystemV.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> System V test
+// ============================================================================
+/*
+Uses all integer registers, two vector registers and the stack.
+*/
+long long MyFunc(int a, double b, long long c, int d, int e, int f, int g, float h, int i)
+{
+	g_iMyFuncCallCount++;
+	assert(a == 10);
+	assert(b == 2.5);
+	assert(c == 0x100000003LL);
+	assert(d == 4);
+	assert(e == 5);
+	assert(f == 6);
+	assert(g == 7);
+	assert(h == 8.5f);
+	assert(i == 90);
+
+	return a + (long long) b + c + d + e + f + g + (long long) h + i;
+}
+
+double MyDoubleFunc(double x, double y)
+{
+	return x * y;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	assert(eHookType == HOOKTYPE_PRE);
+	assert(pHook->GetArgument<int>(0) == 1);
+	assert(pHook->GetArgument<double>(1) == 2.5);
+	assert(pHook->GetArgument<long long>(2) == 0x100000003LL);
+	assert(pHook->GetArgument<int>(3) == 4);
+	assert(pHook->GetArgument<int>(6) == 7);
+	assert(pHook->GetArgument<float>(7) == 8.5f);
+	assert(pHook->GetArgument<int>(8) == 9);
+
+	// Modify a register and a stack argument
+	pHook->SetArgument<int>(0, 10);
+	pHook->SetArgument<int>(8, 90);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	assert(eHookType == HOOKTYPE_POST);
+	assert(pHook->GetReturnValue<long long>() == 0x100000003LL + 132);
+
+	pHook->SetReturnValue<long long>(1337);
+	return false;
+}
+
+bool PostMyDoubleFunc(HookType_t eHookType, CHook* pHook)
+{
+	assert(pHook->GetReturnValue<double>() == 6.0);
+	pHook->SetReturnValue<double>(pHook->GetReturnValue<double>() + 1);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_DOUBLE);
+	vecArgTypes.push_back(DATA_TYPE_LONG_LONG);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_FLOAT);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	std::vector<DataType_t> vecDoubleArgTypes;
+	vecDoubleArgTypes.push_back(DATA_TYPE_DOUBLE);
+	vecDoubleArgTypes.push_back(DATA_TYPE_DOUBLE);
+
+	RegisterMode_t modes[] = {REGISTERMODE_SHARED, REGISTERMODE_THREAD, REGISTERMODE_STACK};
+	for(int iMode=0; iMode < 3; iMode++)
+	{
+		x64SystemV* pConvention = new x64SystemV(vecArgTypes, DATA_TYPE_LONG_LONG);
+		assert(pConvention->m_ArgumentLocations[0].m_eRegister == RDI);
+		assert(pConvention->m_ArgumentLocations[1].m_eRegister == XMM0);
+		assert(pConvention->m_ArgumentLocations[2].m_eRegister == RSI);
+		assert(pConvention->m_ArgumentLocations[7].m_eRegister == XMM1);
+		assert(pConvention->m_ArgumentLocations[8].m_eRegister == RSP);
+		assert(pConvention->m_ArgumentLocations[8].m_iOffset == 8);
+
+		CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+		assert(MyFunc(1, 2.5, 0x100000003LL, 4, 5, 6, 7, 8.5f, 9) == 1337);
+		assert(g_iMyFuncCallCount == iMode + 1);
+		assert(g_iPreMyFuncCallCount == iMode + 1);
+		assert(g_iPostMyFuncCallCount == iMode + 1);
+
+		pHook = pHookMngr->HookFunction((void *) &MyDoubleFunc, new x64SystemV(vecDoubleArgTypes, DATA_TYPE_DOUBLE), modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyDoubleFunc);
+		assert(MyDoubleFunc(2.0, 3.0) == 7.0);
+
+		pHookMngr->UnhookAllFunctions();
+	}
+
+	// The original functions are restored
+	assert(MyFunc(10, 2.5, 0x100000003LL, 4, 5, 6, 7, 8.5f, 90) == 0x100000003LL + 132);
+	assert(MyDoubleFunc(2.0, 3.0) == 6.0);
+	return 0;
+}
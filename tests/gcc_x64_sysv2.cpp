@@ -0,0 +1,150 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <xmmintrin.h>
+
+#include "manager.h"
+#include "conventions/x64SystemV.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> System V vector test
+// ============================================================================
+bool Equal(__m128 a, __m128 b)
+{
+	return _mm_movemask_ps(_mm_cmpeq_ps(a, b)) == 0xF;
+}
+
+/*
+Uses all vector registers. The last int and vector go onto the stack and the
+vector needs to be 16 byte aligned.
+*/
+__attribute__((noinline))
+__m128 MyFunc(int a, int b, int c, int d, int e, int f, int g,
+	__m128 v0, __m128 v1, __m128 v2, __m128 v3, __m128 v4, __m128 v5, __m128 v6, float h, __m128 v7)
+{
+	g_iMyFuncCallCount++;
+	assert(a + b + c + d + e + f + g == 28);
+	assert(Equal(v0, _mm_set1_ps(10.0f)));
+	assert(Equal(v6, _mm_set1_ps(7.0f)));
+	assert(h == 8.5f);
+	assert(Equal(v7, _mm_set1_ps(80.0f)));
+
+	return _mm_add_ps(_mm_add_ps(v0, v1), _mm_add_ps(v7, _mm_set1_ps(h)));
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	assert(pHook->GetArgument<int>(6) == 7);
+	assert(Equal(pHook->GetArgument<__m128>(7), _mm_set1_ps(1.0f)));
+	assert(Equal(pHook->GetArgument<__m128>(8), _mm_set1_ps(2.0f)));
+	assert(Equal(pHook->GetArgument<__m128>(13), _mm_set1_ps(7.0f)));
+	assert(pHook->GetArgument<float>(14) == 8.5f);
+	assert(Equal(pHook->GetArgument<__m128>(15), _mm_set1_ps(8.0f)));
+
+	// Modify a register and a stack argument
+	pHook->SetArgument<__m128>(7, _mm_set1_ps(10.0f));
+	pHook->SetArgument<__m128>(15, _mm_set1_ps(80.0f));
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	assert(Equal(pHook->GetReturnValue<__m128>(), _mm_set1_ps(100.5f)));
+
+	pHook->SetReturnValue<__m128>(_mm_setr_ps(1.0f, 3.0f, 3.0f, 7.0f));
+	return false;
+}
+
+__m128 CallMyFunc()
+{
+	return MyFunc(1, 2, 3, 4, 5, 6, 7,
+		_mm_set1_ps(1.0f), _mm_set1_ps(2.0f), _mm_set1_ps(3.0f), _mm_set1_ps(4.0f),
+		_mm_set1_ps(5.0f), _mm_set1_ps(6.0f), _mm_set1_ps(7.0f), 8.5f, _mm_set1_ps(8.0f));
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	std::vector<DataType_t> vecArgTypes;
+	for(int i=0; i < 7; i++)
+		vecArgTypes.push_back(DATA_TYPE_INT);
+
+	for(int i=0; i < 7; i++)
+		vecArgTypes.push_back(DATA_TYPE_M128);
+
+	vecArgTypes.push_back(DATA_TYPE_FLOAT);
+	vecArgTypes.push_back(DATA_TYPE_M128);
+
+	RegisterMode_t modes[] = {REGISTERMODE_SHARED, REGISTERMODE_THREAD, REGISTERMODE_STACK};
+	for(int iMode=0; iMode < 3; iMode++)
+	{
+		x64SystemV* pConvention = new x64SystemV(vecArgTypes, DATA_TYPE_M128);
+		assert(pConvention->m_ArgumentLocations[6].m_eRegister == RSP);
+		assert(pConvention->m_ArgumentLocations[6].m_iOffset == 8);
+		assert(pConvention->m_ArgumentLocations[7].m_eRegister == XMM0);
+		assert(pConvention->m_ArgumentLocations[13].m_eRegister == XMM6);
+		assert(pConvention->m_ArgumentLocations[14].m_eRegister == XMM7);
+		assert(pConvention->m_ArgumentLocations[15].m_eRegister == RSP);
+		assert(pConvention->m_ArgumentLocations[15].m_iOffset == 24);
+
+		CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+		assert(Equal(CallMyFunc(), _mm_setr_ps(1.0f, 3.0f, 3.0f, 7.0f)));
+		assert(g_iMyFuncCallCount == iMode + 1);
+		assert(g_iPreMyFuncCallCount == iMode + 1);
+		assert(g_iPostMyFuncCallCount == iMode + 1);
+
+		pHookMngr->UnhookAllFunctions();
+	}
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x64SystemV.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> System V object test
+// ============================================================================
+struct Vector
+{
+	double x, y, z;
+};
+
+struct Pair
+{
+	int a;
+	long long b;
+};
+
+/*
+The return value is passed via a hidden pointer in rdi, p via rsi and rdx,
+v on the stack and n via rcx.
+*/
+__attribute__((noinline))
+Vector MyFunc(Pair p, Vector v, int n)
+{
+	g_iMyFuncCallCount++;
+	assert(p.a == 2);
+	assert(p.b == 0x100000000LL);
+	assert(v.x == 10.0 && v.y == 2.0 && v.z == 3.0);
+	assert(n == 4);
+
+	Vector result = {v.x * p.a, v.y * p.a, v.z * n};
+	return result;
+}
+
+/*
+Objects up to 16 bytes are returned via rax and rdx.
+*/
+__attribute__((noinline))
+Pair MyPairFunc(int a)
+{
+	Pair result = {a, (long long) a << 32};
+	return result;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	Pair p = pHook->GetArgument<Pair>(0);
+	assert(p.a == 2);
+	assert(p.b == 3);
+
+	// Both registers need to be written back
+	p.b = 0x100000000LL;
+	pHook->SetArgument<Pair>(0, p);
+
+	// Objects on the stack are modified in place
+	Vector* pVector = (Vector *) pHook->GetArgumentPtr(1, pHook->GetRegisters());
+	assert(pVector->x == 1.0 && pVector->y == 2.0 && pVector->z == 3.0);
+	pVector->x = 10.0;
+
+	assert(pHook->GetArgument<int>(2) == 4);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	Vector result = pHook->GetReturnValue<Vector>();
+	assert(result.x == 20.0 && result.y == 4.0 && result.z == 12.0);
+
+	// The result is written to the caller's object
+	Vector* pResult = (Vector *) pHook->m_pCallingConvention->GetReturnPtr(pHook->GetRegisters());
+	pResult->z = 1337.0;
+	return false;
+}
+
+bool PostMyPairFunc(HookType_t eHookType, CHook* pHook)
+{
+	Pair result = pHook->GetReturnValue<Pair>();
+	assert(result.a == 5);
+	assert(result.b == 5LL << 32);
+
+	result.b = 1337;
+	pHook->SetReturnValue<Pair>(result);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(MakeObjectType(sizeof(Pair), __alignof__(Pair)));
+	vecArgTypes.push_back(MakeObjectType(sizeof(Vector), __alignof__(Vector)));
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	std::vector<DataType_t> vecPairArgTypes;
+	vecPairArgTypes.push_back(DATA_TYPE_INT);
+
+	assert(GetDataTypeSize(vecArgTypes[1], 8) == 24);
+
+	Pair p = {2, 3};
+	Vector v = {1.0, 2.0, 3.0};
+
+	RegisterMode_t modes[] = {REGISTERMODE_SHARED, REGISTERMODE_THREAD, REGISTERMODE_STACK};
+	for(int iMode=0; iMode < 3; iMode++)
+	{
+		x64SystemV* pConvention = new x64SystemV(vecArgTypes, MakeObjectType(sizeof(Vector), __alignof__(Vector)));
+
+		// Split arguments can't be described by the table
+		assert(pConvention->m_ArgumentLocations.empty());
+
+		CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+		Vector result = MyFunc(p, v, 4);
+		assert(result.x == 20.0 && result.y == 4.0 && result.z == 1337.0);
+		assert(g_iMyFuncCallCount == iMode + 1);
+		assert(g_iPreMyFuncCallCount == iMode + 1);
+		assert(g_iPostMyFuncCallCount == iMode + 1);
+
+		pHook = pHookMngr->HookFunction((void *) &MyPairFunc,
+			new x64SystemV(vecPairArgTypes, MakeObjectType(sizeof(Pair), __alignof__(Pair))), modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyPairFunc);
+
+		Pair pair = MyPairFunc(5);
+		assert(pair.a == 5);
+		assert(pair.b == 1337);
+
+		pHookMngr->UnhookAllFunctions();
+	}
+
+	return 0;
+}
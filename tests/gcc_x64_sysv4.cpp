@@ -0,0 +1,205 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+
+#include "manager.h"
+#include "conventions/x64SystemV.h"
+
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> System V float object test
+// ============================================================================
+struct Vector
+{
+	float x, y, z;
+};
+
+struct Mixed
+{
+	double d;
+	long long n;
+};
+
+struct Vector2D
+{
+	float x, y;
+};
+
+/*
+m.d is passed via xmm0, m.n via rdi, v via xmm1 and xmm2 and n via rsi. The
+return value is returned via xmm0 and xmm1.
+*/
+__attribute__((noinline))
+Vector MyFunc(Mixed m, Vector v, int n)
+{
+	g_iMyFuncCallCount++;
+	assert(m.d == 2.0);
+	assert(m.n == 0x100000000LL);
+	assert(v.x == 10.0f && v.y == 2.0f && v.z == 3.0f);
+	assert(n == 4);
+
+	Vector result = {v.x * (float) m.d, v.y * (float) m.d, v.z * n};
+	return result;
+}
+
+/*
+v is passed and returned via xmm0.
+*/
+__attribute__((noinline))
+Vector2D MyVector2DFunc(Vector2D v)
+{
+	Vector2D result = {v.y, v.x};
+	return result;
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	Mixed m = pHook->GetArgument<Mixed>(0);
+	assert(m.d == 2.0);
+	assert(m.n == 3);
+
+	// Both registers need to be written back
+	m.n = 0x100000000LL;
+	pHook->SetArgument<Mixed>(0, m);
+
+	Vector v = pHook->GetArgument<Vector>(1);
+	assert(v.x == 1.0f && v.y == 2.0f && v.z == 3.0f);
+	v.x = 10.0f;
+	pHook->SetArgument<Vector>(1, v);
+
+	assert(pHook->GetArgument<int>(2) == 4);
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	Vector result = pHook->GetReturnValue<Vector>();
+	assert(result.x == 20.0f && result.y == 4.0f && result.z == 12.0f);
+
+	result.z = 1337.0f;
+	pHook->SetReturnValue<Vector>(result);
+	return false;
+}
+
+bool PreMyVector2DFunc(HookType_t eHookType, CHook* pHook)
+{
+	Vector2D v = pHook->GetArgument<Vector2D>(0);
+	assert(v.x == 1.0f && v.y == 2.0f);
+
+	v.y = 3.0f;
+	pHook->SetArgument<Vector2D>(0, v);
+	return false;
+}
+
+bool PostMyVector2DFunc(HookType_t eHookType, CHook* pHook)
+{
+	Vector2D result = pHook->GetReturnValue<Vector2D>();
+	assert(result.x == 3.0f && result.y == 1.0f);
+
+	result.y = 1337.0f;
+	pHook->SetReturnValue<Vector2D>(result);
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	DataType_t vectorType = MakeObjectType(sizeof(Vector), __alignof__(Vector), FLOAT_EIGHTBYTE_BOTH);
+	DataType_t vector2DType = MakeObjectType(sizeof(Vector2D), __alignof__(Vector2D), FLOAT_EIGHTBYTE_LOW);
+
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(MakeObjectType(sizeof(Mixed), __alignof__(Mixed), FLOAT_EIGHTBYTE_LOW));
+	vecArgTypes.push_back(vectorType);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+
+	std::vector<DataType_t> vecVector2DArgTypes;
+	vecVector2DArgTypes.push_back(vector2DType);
+
+	assert(GetObjectSize(vectorType) == 12);
+	assert(GetObjectAlignment(vectorType) == 4);
+	assert(GetObjectFloatEightbytes(vectorType) == FLOAT_EIGHTBYTE_BOTH);
+
+	Mixed m = {2.0, 3};
+	Vector v = {1.0f, 2.0f, 3.0f};
+	Vector2D v2 = {1.0f, 2.0f};
+
+	RegisterMode_t modes[] = {REGISTERMODE_SHARED, REGISTERMODE_THREAD, REGISTERMODE_STACK};
+	for(int iMode=0; iMode < 3; iMode++)
+	{
+		x64SystemV* pConvention = new x64SystemV(vecArgTypes, vectorType);
+
+		// Split arguments can't be described by the table
+		assert(pConvention->m_ArgumentLocations.empty());
+
+		CHook* pHook = pHookMngr->HookFunction((void *) &MyFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+		Vector result = MyFunc(m, v, 4);
+		assert(result.x == 20.0f && result.y == 4.0f && result.z == 1337.0f);
+		assert(g_iMyFuncCallCount == iMode + 1);
+		assert(g_iPreMyFuncCallCount == iMode + 1);
+		assert(g_iPostMyFuncCallCount == iMode + 1);
+
+		pConvention = new x64SystemV(vecVector2DArgTypes, vector2DType);
+		assert(pConvention->m_ArgumentLocations.size() == 1);
+		assert(pConvention->m_ArgumentLocations[0].m_eRegister == XMM0);
+
+		pHook = pHookMngr->HookFunction((void *) &MyVector2DFunc, pConvention, modes[iMode]);
+		pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyVector2DFunc);
+		pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyVector2DFunc);
+
+		Vector2D result2D = MyVector2DFunc(v2);
+		assert(result2D.x == 3.0f && result2D.y == 1337.0f);
+
+		pHookMngr->UnhookAllFunctions();
+	}
+
+	return 0;
+}
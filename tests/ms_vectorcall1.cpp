@@ -0,0 +1,144 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "assert.h"
+#include <xmmintrin.h>
+
+#include "manager.h"
+#include "conventions/x86MsVectorcall.h"
+
+// ============================================================================
+// >> GLOBAL VARIABLES
+// ============================================================================
+int g_iMyFuncCallCount = 0;
+int g_iPreMyFuncCallCount = 0;
+int g_iPostMyFuncCallCount = 0;
+
+
+// ============================================================================
+// >> vectorcall test
+// ============================================================================
+bool Equal(__m128 a, __m128 b)
+{
+	return _mm_movemask_ps(_mm_cmpeq_ps(a, b)) == 0xF;
+}
+
+// x -> ecx, v -> xmm0, d -> xmm1, l -> stack, y -> edx, w -> xmm2
+__declspec(noinline) __m128 __vectorcall MyFunc(int x, __m128 v, double d, long long l, int y, __m128 w)
+{
+	g_iMyFuncCallCount++;
+	assert(x == 3);
+	assert(Equal(v, _mm_set1_ps(4.0f)));
+	assert(d == 1.5);
+	assert(l == 0x100000002LL);
+	assert(y == 10);
+	assert(Equal(w, _mm_set1_ps(2.0f)));
+
+	return _mm_mul_ps(v, w);
+}
+
+bool PreMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPreMyFuncCallCount++;
+	int x = pHook->GetArgument<int>(0);
+	assert(x == 3);
+
+	__m128 v = pHook->GetArgument<__m128>(1);
+	assert(Equal(v, _mm_set1_ps(1.0f)));
+
+	double d = pHook->GetArgument<double>(2);
+	assert(d == 1.5);
+
+	long long l = pHook->GetArgument<long long>(3);
+	assert(l == 0x100000002LL);
+
+	int y = pHook->GetArgument<int>(4);
+	assert(y == 10);
+
+	__m128 w = pHook->GetArgument<__m128>(5);
+	assert(Equal(w, _mm_set1_ps(2.0f)));
+
+	pHook->SetArgument<__m128>(1, _mm_set1_ps(4.0f));
+	return false;
+}
+
+bool PostMyFunc(HookType_t eHookType, CHook* pHook)
+{
+	g_iPostMyFuncCallCount++;
+	long long l = pHook->GetArgument<long long>(3);
+	assert(l == 0x100000002LL);
+
+	__m128 return_value = pHook->GetReturnValue<__m128>();
+	assert(Equal(return_value, _mm_set1_ps(8.0f)));
+
+	pHook->SetReturnValue<__m128>(_mm_set1_ps(1337.0f));
+	return false;
+}
+
+
+// ============================================================================
+// >> main
+// ============================================================================
+int main()
+{
+	CHookManager* pHookMngr = GetHookManager();
+
+	// Prepare calling convention
+	std::vector<DataType_t> vecArgTypes;
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_M128);
+	vecArgTypes.push_back(DATA_TYPE_DOUBLE);
+	vecArgTypes.push_back(DATA_TYPE_LONG_LONG);
+	vecArgTypes.push_back(DATA_TYPE_INT);
+	vecArgTypes.push_back(DATA_TYPE_M128);
+
+	// Hook the function
+	CHook* pHook = pHookMngr->HookFunction(
+		(void *) &MyFunc,
+		new x86MsVectorcall(vecArgTypes, DATA_TYPE_M128)
+	);
+
+	pHook->AddCallback(HOOKTYPE_PRE, (HookHandlerFn *) (void *) &PreMyFunc);
+	pHook->AddCallback(HOOKTYPE_POST, (HookHandlerFn *) (void *) &PostMyFunc);
+
+	// Call the function
+	__m128 return_value = MyFunc(3, _mm_set1_ps(1.0f), 1.5, 0x100000002LL, 10, _mm_set1_ps(2.0f));
+
+	assert(g_iMyFuncCallCount == 1);
+	assert(g_iPreMyFuncCallCount == 1);
+	assert(g_iPostMyFuncCallCount == 1);
+	assert(Equal(return_value, _mm_set1_ps(1337.0f)));
+
+	pHookMngr->UnhookAllFunctions();
+	return 0;
+}
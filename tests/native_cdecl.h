@@ -0,0 +1,61 @@
+/**
+* =============================================================================
+* DynamicHooks
+* Copyright (C) 2015 Robin Gohmert. All rights reserved.
+* =============================================================================
+*
+* This software is provided 'as-is', without any express or implied warranty.
+* In no event will the authors be held liable for any damages arising from 
+* the use of this software.
+* 
+* Permission is granted to anyone to use this software for any purpose, 
+* including commercial applications, and to alter it and redistribute it 
+* freely, subject to the following restrictions:
+*
+* 1. The origin of this software must not be misrepresented; you must not 
+* claim that you wrote the original software. If you use this software in a 
+* product, an acknowledgment in the product documentation would be 
+* appreciated but is not required.
+*
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+*
+* 3. This notice may not be removed or altered from any source distribution.
+*
+* asm.h/cpp from devmaster.net (thanks cybermind) edited by pRED* to handle gcc
+* -fPIC thunks correctly
+*
+* Idea and trampoline code taken from DynDetours (thanks your-name-here).
+*/
+
+#ifndef _NATIVE_CDECL_H
+#define _NATIVE_CDECL_H
+
+// ============================================================================
+// >> INCLUDES
+// ============================================================================
+#include "native.h"
+
+#ifdef DYNAMICHOOKS_X64
+	#include "conventions/x64SystemV.h"
+#else
+	#include "conventions/x86GccCdecl.h"
+#endif
+
+
+// ============================================================================
+// >> CLASSES
+// ============================================================================
+/*
+The calling convention of ordinary GCC functions on the target architecture.
+Tests that don't depend on a specific calling convention use it, so they run
+in 32-bit and 64-bit builds.
+*/
+#ifdef DYNAMICHOOKS_X64
+	typedef x64SystemV NativeCdecl;
+#else
+	typedef x86GccCdecl NativeCdecl;
+#endif
+
+
+#endif // _NATIVE_CDECL_H